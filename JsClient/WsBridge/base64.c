@@ -201,7 +201,7 @@ size_t base64_decode( char *source, unsigned char *target, size_t targetlen )
 		tmplen = _base64_decode_triple( quadruple, ( unsigned char* )tmpresult );
 
 		/* check if the fit in the result buffer */
-		if ( targetlen < tmplen )
+		if ( targetlen < ( size_t ) tmplen )
 		{
 			free( src );
 			return -1;
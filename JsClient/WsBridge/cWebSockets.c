@@ -7,314 +7,447 @@ WebSocket Protocol Implementation
 + Dependencies:
 	- sha1.h and sha1.c from http://www.packetizer.com/security/sha1/ (included)
 	- base64.h and base64.c (included)
-+ Known bugs:
-	- WEBSOCKET_generate_handshake: sha.Message_Digest[i] => sha1_part fails if leading zero is found
 
 Author: Marcin Kelar ( marcin.kelar@gmail.com )
 *******************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
 #include "include/cWebSockets.h"
 
-int xdigit( char digit )
-{
-	int val;
-	if( '0' <= digit && digit <= '9' ) val = digit -'0';
-	else if( 'a' <= digit && digit <= 'f' ) val = digit -'a'+10;
-	else if( 'A' <= digit && digit <= 'F' ) val = digit -'A'+10;
-	else                                    val = -1;
-	return val;
+/*
+static int REQUEST_header_is( const char *name, unsigned int name_length, const char *expected )
+@name - header name found in the request, not null-terminated
+@name_length - size of @name
+@expected - null-terminated header name to compare with, header names are case-insensitive
+@return - 0 = false / 1 = true */
+static int REQUEST_header_is( const char *name, unsigned int name_length, const char *expected ) {
+	return ( name_length == strlen( expected ) && strncasecmp( name, expected, name_length ) == 0 );
 }
 
-int xstr2str( char *buf, unsigned bufsize, const char *in )
-{
-	if( !in ) return -1; // missing input string
-
-	unsigned inlen=strlen(in);
-	//if( inlen%2 != 0 ) return -2; // hex string must even sized
-
-	for( unsigned i=0; i<inlen; i++ )
-		if( xdigit(in[i])<0 ) return -3; // bad character in hex string
-
-	if( !buf || bufsize<inlen/2+1 ) return -4; // no buffer or too small
+/*
+static int REQUEST_has_token( const char *value, unsigned int value_length, const char *token )
+@value - comma-separated list of tokens, optionally followed by ";" parameters, not null-terminated
+@value_length - size of @value
+@token - null-terminated token to look for, tokens are case-insensitive
+@return - 0 = false / 1 = true */
+static int REQUEST_has_token( const char *value, unsigned int value_length, const char *token ) {
+	const char *end = value + value_length;
+	const char *start;
 
-	for( unsigned i=0,j=0; i<inlen; i+=2,j++ )
-		buf[j] = xdigit(in[i])*16 + xdigit(in[i+1]);
+	while( value < end ) {
+		while( value < end && ( *value == ' ' || *value == '\t' || *value == ',' ) ) {
+			value++;
+		}
+		start = value;
+		while( value < end && *value != ',' && *value != ' ' && *value != '\t' && *value != ';' ) {
+			value++;
+		}
+		if( value > start && REQUEST_header_is( start, value - start, token ) ) {
+			return 1;
+		}
+		/* Skip the token parameters */
+		while( value < end && *value != ',' ) {
+			value++;
+		}
+	}
 
-	buf[inlen/2] = '\0';
-	return inlen/2+1;
+	return 0;
 }
 
 /*
-void REQUEST_get_header_value( const char *data, const char *requested_key )
-@data - entire data received with socket
-@requested_key - requested key
-@dst - pointer to char array where the result will be stored,
-@dst_len - size of @dst */
-void REQUEST_get_header_value( const char *data, const char *requested_key, char *dst, unsigned int dst_len ) {
-	char *src = ( char * )malloc( 65535 * sizeof( char ) );
-	char *result_handler;
-	char *result;
-	char *tmp_header_key;
-	int i = 0;
-
-	strncpy( src, data, 65535 );
-
-	tmp_header_key = strstr( ( char* )src, requested_key );
-	if( tmp_header_key == NULL ) {
-		dst = NULL;
-		return;
+int WEBSOCKET_parse_request( const char *data, unsigned int data_length, t_websocket_request *request )
+@data - upgrade request received with socket, up to the empty line ending the headers (it does not need to be null-terminated)
+@data_length - size of @data
+@request - pointer to the structure where the fields will be stored, they point into @data so nothing is copied
+@return - 0 = request line and headers found / 1 = malformed request */
+int WEBSOCKET_parse_request( const char *data, unsigned int data_length, t_websocket_request *request ) {
+	const char *end = data + data_length;
+	const char *line, *line_end, *value_end, *colon, *value;
+	unsigned int value_length;
+
+	memset( request, 0, sizeof( t_websocket_request ) );
+	request->version = -1;
+
+	/* Request line : method, URI and HTTP version separated by spaces */
+	line = memchr( data, '\n', data_length );
+	if( line == NULL ) {
+		return 1;
+	}
+	value = memchr( data, ' ', line - data );
+	if( value == NULL ) {
+		return 1;
+	}
+	request->method = data;
+	request->method_length = value - data;
+	request->uri = value + 1;
+	value = memchr( request->uri, ' ', line - request->uri );
+	if( value == NULL ) {
+		return 1;
 	}
+	request->uri_length = value - request->uri;
+	line++;
 
-	result_handler = ( char * )malloc( 1024 * sizeof( char ) );
-	result = ( char* )calloc( 256, sizeof( char ) );
+	while( line < end ) {
+		line_end = memchr( line, '\n', end - line );
+		if( line_end == NULL ) {
+			line_end = end;
+		}
+		value_end = line_end;
+		if( value_end > line && value_end[ -1 ] == '\r' ) {
+			value_end--;
+		}
 
-	strncpy( result_handler, tmp_header_key, 1024 );
-	tmp_header_key = NULL;
+		/* An empty line ends the headers */
+		if( value_end == line ) {
+			break;
+		}
 
-	while( ( result[ i ] = result_handler[ i ] ) != '\015' ) {
-		if( result_handler[ i ] != '\015' ) {
-			 i++;
+		colon = memchr( line, ':', value_end - line );
+		if( colon != NULL ) {
+			value = colon + 1;
+			while( value < value_end && ( *value == ' ' || *value == '\t' ) ) {
+				value++;
+			}
+			value_length = value_end - value;
+			while( value_length > 0 && ( value[ value_length - 1 ] == ' ' || value[ value_length - 1 ] == '\t' ) ) {
+				value_length--;
+			}
+
+			if( REQUEST_header_is( line, colon - line, "Sec-WebSocket-Key" ) ) {
+				request->key = value;
+				request->key_length = value_length;
+			} else if( REQUEST_header_is( line, colon - line, "Sec-WebSocket-Version" ) ) {
+				request->version = 0;
+				while( value_length > 0 && *value >= '0' && *value <= '9' && request->version < 1000 ) {
+					request->version = request->version * 10 + *value - '0';
+					value++;
+					value_length--;
+				}
+			} else if( REQUEST_header_is( line, colon - line, "Connection" ) ) {
+				request->connection_upgrade = REQUEST_has_token( value, value_length, "Upgrade" );
+			} else if( REQUEST_header_is( line, colon - line, "Origin" ) ) {
+				request->origin = value;
+				request->origin_length = value_length;
+			} else if( REQUEST_header_is( line, colon - line, "Host" ) ) {
+				request->host = value;
+				request->host_length = value_length;
+			} else if( REQUEST_header_is( line, colon - line, "Accept-Encoding" ) ) {
+				request->accept_gzip = REQUEST_has_token( value, value_length, "gzip" );
+			} else if( REQUEST_header_is( line, colon - line, "If-None-Match" ) ) {
+				request->if_none_match = value;
+				request->if_none_match_length = value_length;
+			}
 		}
-	}
-	result[ i ]= '\0';
 
-	free( result_handler );
-	result_handler = NULL;
+		line = line_end + 1;
+	}
 
-	strncpy( dst, strstr( result, ": " ) + 2, dst_len );
-	free( src );
-	src = NULL;
-	free( result );
-	result = NULL;
+	return 0;
+}
 
+/*
+short WEBSOCKET_valid_connection( const t_websocket_request *request )
+@request - parsed upgrade request
+@return - 0 = false / 1 = true */
+short WEBSOCKET_valid_connection( const t_websocket_request *request ) {
+	return ( request->key != NULL && request->key_length > 0 && request->connection_upgrade );
 }
 
 /*
-int WEBSOCKET_generate_handshake( const char *data, char *dst, unsigned int dst_len )
-@data - entire data received with socket
-@dst - pointer to char array where the result will be stored
-@dst_len - size of @dst */
-int WEBSOCKET_generate_handshake( const char *data, char *dst, const unsigned int dst_len ) {
-	char origin[ 512 ];
-	char host[ 512 ];
-	char additional_headers[ 2048 ];
-	char sec_websocket_key[ 512 ];
-	char sec_websocket_key_sha1[ 512 ];
-	char sha1_part[ 32 ];
+int WEBSOCKET_accept_key( const char *key, unsigned int key_length, char *dst )
+@key - value of the client's Sec-WebSocket-Key header, not null-terminated
+@key_length - size of @key
+@dst - pointer to char array where the null-terminated Sec-WebSocket-Accept value will be stored, it must be WEBSOCKET_ACCEPT_KEY_SIZE bytes long
+@return - 0 = success / 1 = failure */
+int WEBSOCKET_accept_key( const char *key, unsigned int key_length, char *dst ) {
 	SHA1Context sha;
-	char sha1_hex[ 512 ];
-	char sha1_tmp[ 1024 ];
-	char sec_websocket_accept[ 512 ];
-	int source_len;
+	unsigned char digest[ 20 ];
 	int i;
 
-	memset( sha1_hex, '\0', 512 );
-	memset( sha1_tmp, '\0', 32 );
-	memset( sec_websocket_accept, '\0', 512 );
-
-	REQUEST_get_header_value( data, "Origin:", origin, 512 );
-	REQUEST_get_header_value( data, "Host:", host, 512 );
-
-	if( origin != NULL && host != NULL ) {
-		sprintf( additional_headers, "Origin: %s\r\nHost: %s", origin, host );
-	} else {
-		sprintf( additional_headers, "Origin: %s\r\nHost: %s", "null", "null" );
-	}
-
-	REQUEST_get_header_value(data, WEBSOCKET_KEY_HEADER, sec_websocket_key, 512 );
-	if( sec_websocket_key == NULL ) {
-		printf("[%s:%d] Error : get sec_websocket_key failed.\n", __FUNCTION__, __LINE__);
+	/* The key and the magic string are hashed in place, without building the concatenated string */
+	SHA1Reset( &sha );
+	SHA1Input( &sha, ( const unsigned char * ) key, key_length );
+	SHA1Input( &sha, ( const unsigned char * ) WEBSOCKET_MAGIC_STRING, sizeof( WEBSOCKET_MAGIC_STRING ) - 1 );
+	if( !SHA1Result( &sha ) ) {
 		return 1;
 	}
 
-	strncat( sec_websocket_key, WEBSOCKET_MAGIC_STRING, 512 );
-
-	SHA1Reset( &sha );
-	SHA1Input( &sha, ( const unsigned char * ) sec_websocket_key, strlen( sec_websocket_key ) );
-	SHA1Result( &sha );
-
+	/* The digest words are big-endian, base64 is computed on the raw bytes */
 	for( i = 0; i < 5; i++ ) {
-		snprintf( sha1_part, 32, "%x", sha.Message_Digest[i] );
-		strncat( sha1_tmp, sha1_part, 512 );
+		digest[ i * 4 ] = ( sha.Message_Digest[ i ] >> 24 ) & 0xFF;
+		digest[ i * 4 + 1 ] = ( sha.Message_Digest[ i ] >> 16 ) & 0xFF;
+		digest[ i * 4 + 2 ] = ( sha.Message_Digest[ i ] >> 8 ) & 0xFF;
+		digest[ i * 4 + 3 ] = sha.Message_Digest[ i ] & 0xFF;
 	}
 
-	strncpy( sec_websocket_key_sha1, sha1_tmp, 512 );
-	source_len = xstr2str( sha1_hex, 512, sec_websocket_key_sha1 );
+	return base64_encode( digest, sizeof( digest ), dst, WEBSOCKET_ACCEPT_KEY_SIZE ) ? 0 : 1;
+}
 
-    if(source_len != 21)
-	{
-		printf("[%s:%d] Error : computing handshake sha1 failed.\n", __FUNCTION__, __LINE__);
-		return 1;
+/*
+int WEBSOCKET_generate_handshake( const t_websocket_request *request, char *dst, const unsigned int dst_len )
+@request - parsed upgrade request
+@dst - pointer to char array where the result will be stored
+@dst_len - size of @dst
+@return - response size / -1 = failure */
+int WEBSOCKET_generate_handshake( const t_websocket_request *request, char *dst, const unsigned int dst_len ) {
+	char sec_websocket_accept[ WEBSOCKET_ACCEPT_KEY_SIZE ];
+	const char *origin = "null";
+	const char *host = "null";
+	unsigned int origin_length = 4;
+	unsigned int host_length = 4;
+	int length;
+
+	if( request->key == NULL || WEBSOCKET_accept_key( request->key, request->key_length, sec_websocket_accept ) != 0 ) {
+		printf("[%s:%d] Error : computing sec_websocket_accept failed.\n", __FUNCTION__, __LINE__);
+		return -1;
 	}
 
-	base64_encode( (unsigned char *) sha1_hex, source_len - 1, sec_websocket_accept, 512 );
-	if(strlen(sec_websocket_accept) == 0)
-	{
-		printf("[%s:%d] Error : set sec_websocket_accept failed.\n", __FUNCTION__, __LINE__);
-		return 1;
+	if( request->origin_length > 0 && request->host_length > 0 ) {
+		origin = request->origin;
+		origin_length = request->origin_length;
+		host = request->host;
+		host_length = request->host_length;
 	}
 
-	snprintf( dst, dst_len, WEBSOCKET_HANDSHAKE_RESPONSE, additional_headers, sec_websocket_accept );
-	return 0;
+	length = snprintf( dst, dst_len, WEBSOCKET_HANDSHAKE_RESPONSE, ( int ) origin_length, origin, ( int ) host_length, host, sec_websocket_accept );
+	if( length < 0 || ( unsigned int ) length >= dst_len ) {
+		printf("[%s:%d] Error : handshake response does not fit.\n", __FUNCTION__, __LINE__);
+		return -1;
+	}
+
+	return length;
 }
 
 /*
-int WEBSOCKET_set_content( const char *data, int data_length, unsigned char *dst )
-@data - entire data received with socket
-@data_length - size of @data
-@dst - pointer to char array where the result will be stored
-@dst_len - size of @dst
-@return - WebSocket frame size */
-int WEBSOCKET_set_content( const char *data, int data_length, unsigned char *dst, const unsigned int dst_len ) {
-	unsigned char *message = ( unsigned char * )malloc( 65535 * sizeof( char ) );
+int WEBSOCKET_set_header( unsigned char *dst, unsigned char opcode, unsigned long long data_length )
+@dst - pointer to char array where the header will be stored, it must be WEBSOCKET_MAX_HEADER_SIZE bytes long
+@opcode - frame opcode (WEBSOCKET_OPCODE_xxx), the frame is always final
+@data_length - size of the payload following the header
+@return - WebSocket header size */
+int WEBSOCKET_set_header( unsigned char *dst, unsigned char opcode, unsigned long long data_length ) {
 	int i;
-	int data_start_index;
 
-	message[0] = 129;
+	dst[0] = WEBSOCKET_FIN | opcode;
 
 	if( data_length <= 125 ) {
-		message[1] = ( unsigned char )data_length;
-		data_start_index = 2;
-	} else if( data_length > 125 && data_length <= 65535 ) {
-		message[1] = 126;
-		message[2] = ( unsigned char )( ( data_length >> 8 ) & 255 );
-		message[3] = ( unsigned char )( ( data_length ) & 255 );
-		data_start_index = 4;
-	} else {
-		message[1] = 127;
-		message[2] = ( unsigned char )( ( data_length >> 56 ) & 255 );
-		message[3] = ( unsigned char )( ( data_length >> 48 ) & 255 );
-		message[4] = ( unsigned char )( ( data_length >> 40 ) & 255 );
-		message[5] = ( unsigned char )( ( data_length >> 32 ) & 255 );
-		message[6] = ( unsigned char )( ( data_length >> 24 ) & 255 );
-		message[7] = ( unsigned char )( ( data_length >> 16 ) & 255 );
-		message[8] = ( unsigned char )( ( data_length >> 8 ) & 255 );
-		message[9] = ( unsigned char )( ( data_length ) & 255 );
-		data_start_index = 10;
+		dst[1] = ( unsigned char )data_length;
+		return 2;
 	}
 
-	for( i = 0; i < data_length; i++ ) {
-		message[ data_start_index + i ] = ( unsigned char )data[i];
+	if( data_length <= 65535 ) {
+		dst[1] = 126;
+		dst[2] = ( unsigned char )( ( data_length >> 8 ) & 255 );
+		dst[3] = ( unsigned char )( ( data_length ) & 255 );
+		return 4;
 	}
 
-	for( i = 0; i < data_length+ data_start_index; i++ ) {
-		dst[i] = ( unsigned char )message[ i ];
+	dst[1] = 127;
+	for( i = 0; i < 8; i++ ) {
+		dst[ 2 + i ] = ( unsigned char )( ( data_length >> ( 56 - 8 * i ) ) & 255 );
 	}
-
-	if( message ) {
-		free( message );
-		message = NULL;
-	}
-
-	return i;
+	return 10;
 }
 
 /*
-int WEBSOCKET_get_content( const char *data, int data_length, unsigned char *dst )
-@data - entire data received with socket
+int WEBSOCKET_write_frame( int fd, unsigned char opcode, const char *data, int data_length )
+@fd - socket to send the frame to
+@opcode - frame opcode (WEBSOCKET_OPCODE_xxx)
+@data - payload to send
 @data_length - size of @data
-@dst - pointer to char array, where the result will be stored
-@return - size of @dst */
-int WEBSOCKET_get_content( const char *data, int data_length, unsigned char *dst, const unsigned int dst_len ) {
-	unsigned int i, j;
-	unsigned char mask[4];
-	unsigned int packet_length = 0;
-	unsigned int length_code = 0;
-	int index_first_mask = 0;
-	int index_first_data_byte = 0;
-
-	if( ( unsigned char )data[0] != 129 ) {
-		dst = NULL;
-		if( ( unsigned char )data[0] == 136 ) {
-			/* WebSocket client disconnected */
-			return -2;
-		}
-		/* Unknown error */
-		return -1;
-	}
-
-	length_code = ((unsigned char) data[1]) & 127;
-
-	if( length_code <= 125 ) {
-		index_first_mask = 2;
+@return - written bytes count, -1 on error
+The header is built on the stack and sent with the payload in a single system call, without copying the payload */
+int WEBSOCKET_write_frame( int fd, unsigned char opcode, const char *data, int data_length ) {
+	unsigned char header[ WEBSOCKET_MAX_HEADER_SIZE ];
+	struct iovec iov[2];
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = WEBSOCKET_set_header( header, opcode, data_length );
+	iov[1].iov_base = ( void * )data;
+	iov[1].iov_len = data_length;
+
+	return writev( fd, iov, 2 );
+}
 
-		mask[0] = data[2];
-		mask[1] = data[3];
-		mask[2] = data[4];
-		mask[3] = data[5];
-	} else if( length_code == 126 ) {
-		index_first_mask = 4;
-
-		mask[0] = data[4];
-		mask[1] = data[5];
-		mask[2] = data[6];
-		mask[3] = data[7];
-	} else if( length_code == 127 ) {
-		index_first_mask = 10;
-
-		mask[0] = data[10];
-		mask[1] = data[11];
-		mask[2] = data[12];
-		mask[3] = data[13];
+/*
+void WEBSOCKET_unmask( unsigned char *data, unsigned long long data_length, const unsigned char mask[4] )
+@data - masked payload, unmasked in place
+@data_length - size of @data
+@mask - the 4 bytes masking key of the frame
+The payload is processed 8 bytes at a time, the mask phase is kept because 8 is a multiple of 4 */
+void WEBSOCKET_unmask( unsigned char *data, unsigned long long data_length, const unsigned char mask[4] ) {
+	uint64_t mask_word, word;
+	unsigned long long i = 0;
+
+	memcpy( &mask_word, mask, 4 );
+	memcpy( ( unsigned char * )&mask_word + 4, mask, 4 );
+
+	for( ; i + 8 <= data_length; i += 8 ) {
+		memcpy( &word, data + i, 8 );
+		word ^= mask_word;
+		memcpy( data + i, &word, 8 );
 	}
 
-	index_first_data_byte = index_first_mask + 4;
-
-	packet_length = data_length - index_first_data_byte;
-
-	for( i = index_first_data_byte, j = 0; i < data_length && j < dst_len; i++, j++ ) {
-		dst[ j ] = ( unsigned char )data[ i ] ^ mask[ j % 4];
+	for( ; i < data_length; i++ ) {
+		data[ i ] ^= mask[ i % 4 ];
 	}
+}
 
-	return packet_length;
+/*
+void WEBSOCKET_parser_init( t_websocket_parser *parser )
+@parser - parser of a connection, to initialize before feeding the first received bytes */
+void WEBSOCKET_parser_init( t_websocket_parser *parser ) {
+	memset( parser, 0, sizeof( *parser ) );
 }
 
 /*
-short WEBSOCKET_valid_connection( const char *data )
-@data - entire data received with socket
-@return - 0 = false / 1 = true */
-short WEBSOCKET_valid_connection( const char *data ) {
-	char *connection_header = ( char * )malloc( 64 * sizeof( char ) );
-	short result = 0;
+static int WEBSOCKET_parser_decode_header( t_websocket_parser *parser )
+@parser - parser with a complete header
+@return - 0 on success, -1 if the frame breaks the protocol */
+static int WEBSOCKET_parser_decode_header( t_websocket_parser *parser ) {
+	unsigned char *header = parser->header;
+	unsigned int length_code = header[1] & 127;
+	unsigned int mask_index;
+	int is_final = ( header[0] & WEBSOCKET_FIN ) != 0;
+	int i;
 
-	REQUEST_get_header_value( data, "Connection:", connection_header, 64 );
+	parser->opcode = header[0] & 15;
 
-	if( connection_header == NULL ) {
-		return 0;
+	/* Client frames must be masked */
+	if( !( header[1] & WEBSOCKET_MASKED ) ) {
+		return -1;
+	}
+
+	if( length_code <= 125 ) {
+		parser->remaining = length_code;
+		mask_index = 2;
+	} else if( length_code == 126 ) {
+		parser->remaining = ( header[2] << 8 ) | header[3];
+		mask_index = 4;
+	} else {
+		parser->remaining = 0;
+		for( i = 2; i < 10; i++ ) {
+			parser->remaining = ( parser->remaining << 8 ) | header[i];
+		}
+		mask_index = 10;
 	}
+	memcpy( parser->mask, header + mask_index, 4 );
+	parser->offset = 0;
 
-	result = ( strstr( data, WEBSOCKET_KEY_HEADER ) != NULL && ( strstr( connection_header, "Upgrade" ) != NULL || strstr( connection_header, "upgrade" ) != NULL) );
+	if( parser->opcode & WEBSOCKET_OPCODE_CONTROL ) {
+		/* Control frames can't be fragmented and are small enough to be buffered */
+		if( !is_final || parser->remaining > sizeof( parser->control ) ) {
+			return -1;
+		}
+		parser->control_length = 0;
+		return 0;
+	}
 
-	if( connection_header ) {
-		free( connection_header );
-		connection_header = NULL;
+	if( parser->opcode == WEBSOCKET_OPCODE_CONTINUATION ) {
+		/* A continuation frame must follow a non final frame */
+		if( parser->message_opcode == WEBSOCKET_OPCODE_CONTINUATION ) {
+			return -1;
+		}
+	} else {
+		/* A new message can't start before the previous one ended */
+		if( parser->message_opcode != WEBSOCKET_OPCODE_CONTINUATION ) {
+			return -1;
+		}
+		parser->message_opcode = parser->opcode;
 	}
+	parser->message_final = is_final;
 
-	return result;
+	return 0;
 }
 
 /*
-int WEBSOCKET_client_version( const char *data )
-@data - entire data received with socket
-@return - value from client's Sec-WebSocket-Version key */
-int WEBSOCKET_client_version( const char *data ) {
-	char *version_header = ( char * )malloc( 32 * sizeof( char ) );
-	int result;
+int WEBSOCKET_parser_next( t_websocket_parser *parser, unsigned char **data, unsigned int *data_length, t_websocket_chunk *chunk )
+@parser - parser of the connection the data was received from
+@data - received bytes, advanced past the parsed bytes; payloads are unmasked in place
+@data_length - size of @data, decreased by the parsed bytes count
+@chunk - on output, the payload chunk found
+@return - 1 if a chunk was found, 0 if all bytes were parsed, -1 if the connection broke the protocol
+Frames can be split or coalesced in any way across the calls. Data frames payload is returned as soon as
+received, so a chunk can be a part of a frame, and continuation frames chunks take the opcode of the message
+first frame. Control frames are returned whole. */
+int WEBSOCKET_parser_next( t_websocket_parser *parser, unsigned char **data, unsigned int *data_length, t_websocket_chunk *chunk ) {
+	unsigned int size, i;
+	unsigned char mask[4];
 
-	REQUEST_get_header_value( data, "Sec-WebSocket-Version:", version_header, 32 );
+	while( *data_length > 0 ) {
+		/* Gather the frame header */
+		if( !parser->in_payload ) {
+			parser->header[ parser->header_length++ ] = **data;
+			( *data )++;
+			( *data_length )--;
+
+			/* The header size is known once the length code is received */
+			if( parser->header_length < 2 ) {
+				continue;
+			}
+			size = 2 + 4;
+			if( ( parser->header[1] & 127 ) == 126 ) {
+				size += 2;
+			} else if( ( parser->header[1] & 127 ) == 127 ) {
+				size += 8;
+			}
+			if( parser->header_length < size ) {
+				continue;
+			}
+
+			parser->header_length = 0;
+			if( WEBSOCKET_parser_decode_header( parser ) != 0 ) {
+				return -1;
+			}
+			parser->in_payload = 1;
+		}
 
-	if( version_header == NULL ) {
-		return -1;
-	}
+		/* Unmask the available part of the payload, keeping the mask phase across the chunks */
+		size = *data_length;
+		if( size > parser->remaining ) {
+			size = ( unsigned int )parser->remaining;
+		}
+		for( i = 0; i < 4; i++ ) {
+			mask[i] = parser->mask[ ( parser->offset + i ) % 4 ];
+		}
 
-	result = atoi( version_header );
+		if( parser->opcode & WEBSOCKET_OPCODE_CONTROL ) {
+			memcpy( parser->control + parser->control_length, *data, size );
+			WEBSOCKET_unmask( parser->control + parser->control_length, size, mask );
+			parser->control_length += size;
+		} else {
+			WEBSOCKET_unmask( *data, size, mask );
+			chunk->opcode = parser->message_opcode;
+			chunk->payload = *data;
+			chunk->payload_length = size;
+		}
+		*data += size;
+		*data_length -= size;
+		parser->offset += size;
+		parser->remaining -= size;
+
+		if( parser->remaining == 0 ) {
+			parser->in_payload = 0;
+
+			if( parser->opcode & WEBSOCKET_OPCODE_CONTROL ) {
+				chunk->opcode = parser->opcode;
+				chunk->payload = parser->control;
+				chunk->payload_length = parser->control_length;
+				return 1;
+			}
+			if( parser->message_final ) {
+				parser->message_opcode = WEBSOCKET_OPCODE_CONTINUATION;
+			}
+		}
 
-	if( version_header ) {
-		free( version_header );
-		version_header = NULL;
+		/* Empty data frames carry nothing to relay */
+		if( !( parser->opcode & WEBSOCKET_OPCODE_CONTROL ) && size > 0 ) {
+			return 1;
+		}
 	}
 
-	return result;
+	return 0;
 }
@@ -0,0 +1,309 @@
+/*
+ * Measure how fast WebSocket upgrade requests are handled.
+ *
+ * Without argument, the request parsing and the response generation are timed in-process.
+ * With a bridge address, a reconnect storm is simulated : the given number of clients
+ * connect and send their upgrade request, with at most 'concurrency' handshakes in flight,
+ * and each response is checked against the expected accept key.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cWebSockets.h"
+
+#define PARSE_ITERATIONS 200000
+#define MAX_EVENTS 256
+
+/* A request like the ones sent by browsers */
+static const char request_format[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: Upgrade\r\n"
+    "Pragma: no-cache\r\n"
+    "Cache-Control: no-cache\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Upgrade: websocket\r\n"
+    "Origin: http://localhost:8000\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Sec-WebSocket-Key: %s\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+    "\r\n";
+
+typedef struct {
+    int fd;
+    char key[25];
+    char accept[WEBSOCKET_ACCEPT_KEY_SIZE];
+    char request[1024];
+    int request_len;
+    int sent;
+    char response[1024];
+    int response_len;
+    double start;
+} t_handshake;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Build a random 16-byte key, base64 encoded */
+static void make_key(char *key)
+{
+    unsigned char nonce[16];
+    unsigned int i;
+
+    for(i = 0; i < sizeof(nonce); i++)
+        nonce[i] = rand() & 0xFF;
+    base64_encode(nonce, sizeof(nonce), key, 25);
+}
+
+static int benchmark_parse(void)
+{
+    static const char rfc_key[] = "dGhlIHNhbXBsZSBub25jZQ==";
+    static const char rfc_accept[] = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+    char request[1024], response[1024], accept[WEBSOCKET_ACCEPT_KEY_SIZE];
+    t_websocket_request parsed;
+    int request_len, i;
+    double start, elapsed;
+
+    // Known answer from RFC 6455
+    if((WEBSOCKET_accept_key(rfc_key, strlen(rfc_key), accept) != 0) || (strcmp(accept, rfc_accept) != 0))
+    {
+        printf("[%s:%d] Error : wrong accept key for the RFC 6455 sample.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
+
+    request_len = snprintf(request, sizeof(request), request_format, rfc_key);
+    start = now();
+    for(i = 0; i < PARSE_ITERATIONS; i++)
+    {
+        if((WEBSOCKET_parse_request(request, request_len, &parsed) != 0) || !WEBSOCKET_valid_connection(&parsed) || (parsed.version != 13))
+        {
+            printf("[%s:%d] Error : request rejected.\n", __FUNCTION__, __LINE__);
+            return 1;
+        }
+        if(WEBSOCKET_generate_handshake(&parsed, response, sizeof(response)) < 0)
+            return 1;
+    }
+    elapsed = now() - start;
+
+    if(strstr(response, rfc_accept) == NULL)
+    {
+        printf("[%s:%d] Error : wrong handshake response.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
+
+    printf("parse + response : %d handshakes in %.3f s, %.2f us each, %.0f handshakes/s\n",
+        PARSE_ITERATIONS, elapsed, elapsed * 1e6 / PARSE_ITERATIONS, PARSE_ITERATIONS / elapsed);
+    return 0;
+}
+
+static int handshake_start(t_handshake *hs, struct sockaddr_in *addr, int epoll_fd)
+{
+    struct epoll_event ev;
+    int one = 1;
+
+    hs->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(hs->fd == -1)
+    {
+        printf("[%s:%d] Error : socket() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
+    }
+    setsockopt(hs->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    make_key(hs->key);
+    WEBSOCKET_accept_key(hs->key, strlen(hs->key), hs->accept);
+    hs->request_len = snprintf(hs->request, sizeof(hs->request), request_format, hs->key);
+    hs->sent = 0;
+    hs->response_len = 0;
+    hs->start = now();
+
+    if((connect(hs->fd, (struct sockaddr *) addr, sizeof(*addr)) != 0) && (errno != EINPROGRESS))
+    {
+        printf("[%s:%d] Error : connect() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        close(hs->fd);
+        hs->fd = -1;
+        return 1;
+    }
+
+    ev.events = EPOLLOUT | EPOLLIN;
+    ev.data.ptr = hs;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, hs->fd, &ev) != 0)
+    {
+        printf("[%s:%d] Error : epoll_ctl() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        close(hs->fd);
+        hs->fd = -1;
+        return 1;
+    }
+    return 0;
+}
+
+/* Return 1 when the handshake is over, -1 on failure, 0 if it is still in progress */
+static int handshake_progress(t_handshake *hs, int epoll_fd)
+{
+    struct epoll_event ev;
+    char expected[64];
+    int n;
+
+    if(hs->sent < hs->request_len)
+    {
+        n = send(hs->fd, hs->request + hs->sent, hs->request_len - hs->sent, MSG_NOSIGNAL);
+        if(n == -1)
+            return ((errno == EAGAIN) || (errno == EINPROGRESS)) ? 0 : -1;
+        hs->sent += n;
+        if(hs->sent == hs->request_len)
+        {
+            ev.events = EPOLLIN;
+            ev.data.ptr = hs;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, hs->fd, &ev);
+        }
+        return 0;
+    }
+
+    n = recv(hs->fd, hs->response + hs->response_len, sizeof(hs->response) - 1 - hs->response_len, 0);
+    if(n == -1)
+        return (errno == EAGAIN) ? 0 : -1;
+    if(n == 0)
+        return -1;
+    hs->response_len += n;
+    hs->response[hs->response_len] = '\0';
+    if(strstr(hs->response, "\r\n\r\n") == NULL)
+        return (hs->response_len < (int) sizeof(hs->response) - 1) ? 0 : -1;
+
+    snprintf(expected, sizeof(expected), "Sec-WebSocket-Accept: %s\r\n", hs->accept);
+    if((strncmp(hs->response, "HTTP/1.1 101", 12) != 0) || (strstr(hs->response, expected) == NULL))
+        return -1;
+    return 1;
+}
+
+static int benchmark_storm(const char *host, int port, int connections, int concurrency)
+{
+    struct sockaddr_in addr;
+    struct epoll_event events[MAX_EVENTS];
+    t_handshake *handshakes;
+    double *latencies;
+    double start, elapsed, total = 0;
+    int epoll_fd, started = 0, done = 0, failed = 0, in_flight = 0;
+    int i, n, result;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+    {
+        printf("[%s:%d] Error : invalid address %s.\n", __FUNCTION__, __LINE__, host);
+        return 1;
+    }
+
+    handshakes = calloc(concurrency, sizeof(t_handshake));
+    latencies = calloc(connections, sizeof(double));
+    epoll_fd = epoll_create1(0);
+    if((handshakes == NULL) || (latencies == NULL) || (epoll_fd == -1))
+    {
+        printf("[%s:%d] Error : initialization failed.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
+    for(i = 0; i < concurrency; i++)
+        handshakes[i].fd = -1;
+
+    start = now();
+    while(done + failed < connections)
+    {
+        // Keep the wanted number of handshakes in flight
+        for(i = 0; (i < concurrency) && (started < connections); i++)
+        {
+            if(handshakes[i].fd != -1)
+                continue;
+            started++;
+            if(handshake_start(&handshakes[i], &addr, epoll_fd) != 0)
+                failed++;
+            else
+                in_flight++;
+        }
+        if(in_flight == 0)
+            continue;
+
+        n = epoll_wait(epoll_fd, events, MAX_EVENTS, 5000);
+        if(n == 0)
+        {
+            printf("[%s:%d] Error : no answer for 5 s, %d handshakes stuck.\n", __FUNCTION__, __LINE__, in_flight);
+            break;
+        }
+        for(i = 0; i < n; i++)
+        {
+            t_handshake *hs = events[i].data.ptr;
+
+            result = handshake_progress(hs, epoll_fd);
+            if(result == 0)
+                continue;
+            if(result == 1)
+            {
+                latencies[done] = now() - hs->start;
+                total += latencies[done];
+                done++;
+            }
+            else
+                failed++;
+            close(hs->fd);
+            hs->fd = -1;
+            in_flight--;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("storm : %d handshakes (%d failed) in %.3f s with %d in flight, %.0f handshakes/s\n",
+        done, failed, elapsed, concurrency, done / elapsed);
+    if(done > 0)
+    {
+        qsort(latencies, done, sizeof(double), compare_doubles);
+        printf("latency : average %.1f us, median %.1f us, p99 %.1f us\n",
+            total * 1e6 / done, latencies[done / 2] * 1e6, latencies[(done * 99) / 100] * 1e6);
+    }
+
+    for(i = 0; i < concurrency; i++)
+        if(handshakes[i].fd != -1)
+            close(handshakes[i].fd);
+    close(epoll_fd);
+    free(handshakes);
+    free(latencies);
+    return (failed > 0) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(time(NULL));
+
+    if(argc == 1)
+        return benchmark_parse();
+
+    if(argc != 5)
+    {
+        printf("usage : %s [bridge_ip bridge_port connections concurrency]\n", argv[0]);
+        return 1;
+    }
+
+    return benchmark_storm(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+}
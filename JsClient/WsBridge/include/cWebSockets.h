@@ -11,17 +11,70 @@ Author: Marcin Kelar ( marcin.kelar@gmail.com )
 #include "sha1.h"
 
 #define WEBSOCKET_MAGIC_STRING				"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
-#define WEBSOCKET_KEY_HEADER				"Sec-WebSocket-Key: "
-#define WEBSOCKET_CONNECTION_HEADER			"Connection: Upgrade"
-#define WEBSOCKET_HANDSHAKE_RESPONSE		"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n%s\r\nServer: Voyager 7\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n"
+#define WEBSOCKET_HANDSHAKE_RESPONSE		"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nOrigin: %.*s\r\nHost: %.*s\r\nServer: Voyager 7\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n"
+#define WEBSOCKET_ACCEPT_KEY_SIZE			29
 #define WEBSOCKET_CONN_CLOSE				"\x88\x00"
+#define WEBSOCKET_MAX_HEADER_SIZE			10
 
-void	REQUEST_get_header_value( const char *data, const char *requested_value_name, char *dst, const unsigned int dst_len );
+#define WEBSOCKET_FIN						0x80
+#define WEBSOCKET_MASKED					0x80
+#define WEBSOCKET_OPCODE_CONTINUATION		0x0
+#define WEBSOCKET_OPCODE_TEXT				0x1
+#define WEBSOCKET_OPCODE_BINARY				0x2
+#define WEBSOCKET_OPCODE_CONTROL			0x8
+#define WEBSOCKET_OPCODE_CLOSE				0x8
+#define WEBSOCKET_OPCODE_PING				0x9
+#define WEBSOCKET_OPCODE_PONG				0xA
 
-int 	WEBSOCKET_generate_handshake( const char *data, char *dst, const unsigned int dst_len );
-int		WEBSOCKET_set_content( const char *data, int data_length, unsigned char *dst, const unsigned int dst_len );
-int		WEBSOCKET_get_content( const char *data, int data_length, unsigned char *dst, const unsigned int dst_len );
-short	WEBSOCKET_valid_connection( const char *data );
-int		WEBSOCKET_client_version( const char *data );
+/* A part of a received message payload */
+typedef struct {
+	unsigned char opcode;
+	unsigned char *payload;
+	unsigned int payload_length;
+} t_websocket_chunk;
+
+/* Incremental frame parser state, one per connection */
+typedef struct {
+	unsigned char header[ 14 ];
+	unsigned int header_length;
+	int in_payload;
+	unsigned char opcode;
+	unsigned char message_opcode;
+	int message_final;
+	unsigned char mask[4];
+	unsigned long long remaining;
+	unsigned long long offset;
+	unsigned char control[ 125 ];
+	unsigned int control_length;
+} t_websocket_parser;
+
+/* Request fields, they point into the received request. The plain HTTP ones allow serving files on the same port */
+typedef struct {
+	const char *method;
+	unsigned int method_length;
+	const char *uri;
+	unsigned int uri_length;
+	const char *key;
+	unsigned int key_length;
+	const char *origin;
+	unsigned int origin_length;
+	const char *host;
+	unsigned int host_length;
+	const char *if_none_match;
+	unsigned int if_none_match_length;
+	int version;
+	int connection_upgrade;
+	int accept_gzip;
+} t_websocket_request;
+
+int		WEBSOCKET_parse_request( const char *data, unsigned int data_length, t_websocket_request *request );
+short	WEBSOCKET_valid_connection( const t_websocket_request *request );
+int		WEBSOCKET_accept_key( const char *key, unsigned int key_length, char *dst );
+int 	WEBSOCKET_generate_handshake( const t_websocket_request *request, char *dst, const unsigned int dst_len );
+int		WEBSOCKET_set_header( unsigned char *dst, unsigned char opcode, unsigned long long data_length );
+int		WEBSOCKET_write_frame( int fd, unsigned char opcode, const char *data, int data_length );
+void	WEBSOCKET_unmask( unsigned char *data, unsigned long long data_length, const unsigned char mask[4] );
+void	WEBSOCKET_parser_init( t_websocket_parser *parser );
+int		WEBSOCKET_parser_next( t_websocket_parser *parser, unsigned char **data, unsigned int *data_length, t_websocket_chunk *chunk );
 
 #endif
@@ -14,10 +14,20 @@
 #include <netinet/in.h>
 #include <signal.h>
 #include <errno.h>
-#include <pthread.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 
 #include "cWebSockets.h"
+#include "Configuration.h"
+#include "Protocol.h"
+#include "Ring.h"
 
 #if DEBUG
 #define DBG_STR(buf) printf("[DEBUG] %s: %s\n", __FUNCTION__, buf);
@@ -25,34 +35,167 @@
 #define DBG_STR(buf)
 #endif
 
-// Max number of simultaneous client connections authorized
-#define MAX_BRIDGE_CONNECTIONS 50
+// Default max number of simultaneous client connections, can be changed with -c
+#define DEFAULT_MAX_BRIDGE_CONNECTIONS 1024
+
+// File descriptors needed besides the client ones (standard streams, listen socket, epoll)
+#define RESERVED_FDS 16
+
+// Max number of socket events handled per reactor iteration
+#define MAX_REACTOR_EVENTS 64
+
+// Max number of pre-connected remote server sockets (-p), for each remote server
+#define MAX_POOL_SIZE 256
+
+// Remote servers the clients are spread over (remote_ip remote_port pairs)
+#define MAX_BACKENDS 16
+#define HEALTH_CHECK_PERIOD 2 // Seconds between two connect probes of each remote server, when there are several ones
+
+// Multiplexed link (-m), the frames are described in the server Protocol.h
+#define LINK_CHANNELS 65536
+#define LINK_BUFFER_SIZE 65536
+
+// Data received from the remote server for a client is sent in a single WebSocket frame, up to this size
+#define UPSTREAM_BUFFER_SIZE 4096
+
+// Output queues, one per connection and direction
+#define QUEUE_HIGH_WATERMARK (64 * 1024) // Stop reading from the other side of the client connection above this
+#define QUEUE_LOW_WATERMARK (16 * 1024) // Read again below this
+#define QUEUE_MAX_SIZE (1024 * 1024) // The peer does not read its data, drop the client
+
+// Static files served to plain HTTP requests (-d)
+#define HTTP_DEFAULT_FILE "bomberbox.html" // Sent for "/"
+#define HTTP_MAX_PATH 256
+#define HTTP_MAX_REQUEST_SIZE 8192 // Browsers page loads send many headers (user agent hints, fetch metadata, cookies...)
+#define HTTP_CACHE_REVALIDATE "no-cache" // Checked with the ETag at each page load, a changed file is seen at once
+#define HTTP_CACHE_IMMUTABLE "public, max-age=31536000, immutable" // Sprites never change during a LAN event
 
 /* Program structs */
 
+typedef enum {
+    CLIENT_STATE_HANDSHAKE, // Waiting for the whole WebSocket upgrade request
+    CLIENT_STATE_CONNECTING, // Handshake done, waiting for the remote server connection
+    CLIENT_STATE_CONNECTED, // Relaying data
+    CLIENT_STATE_HTTP, // Sending a file requested with plain HTTP, the next request is read when it is done
+    CLIENT_STATE_CLOSING // The remote server is gone, sending the queued data and the close frame before deleting the client
+} t_client_state;
+
+typedef struct {
+    unsigned char *data; // Allocated when something can't be sent at once
+    unsigned int len;
+    unsigned int size;
+    unsigned int peak; // Highest len reached, for the metrics
+} t_out_queue;
+
 typedef struct {
     int ws_fd; // Websocket fd, we use this value as unique 'id'
     int tcp_fd; // Remote server socket
+    t_client_state state;
+    char handshake[HTTP_MAX_REQUEST_SIZE]; // Requests received so far
+    unsigned int handshake_len;
+    t_websocket_parser parser; // Frames received from the WebSocket client
+    t_out_queue ws_out; // Data waiting for the WebSocket socket to be writable
+    t_out_queue tcp_out; // Data waiting for the remote server socket to be writable or connected
+    unsigned int ws_events; // Events watched by the reactor for each socket
+    unsigned int tcp_events;
+    bool ws_paused; // Reading from the WebSocket socket is stopped until tcp_out is drained
+    bool tcp_paused; // Reading from the remote server socket is stopped until ws_out is drained
+    unsigned int pauses; // How many times the remote server socket reading was stopped
+    int channel; // Channel on the multiplexed link, -1 if the client has its own remote server socket
+    unsigned char upstream[UPSTREAM_BUFFER_SIZE]; // Data received from the remote server, not sent to the WebSocket client yet
+    unsigned int upstream_len;
+    int upstream_queue_index; // Position in the upstream queue, -1 if the client is not queued
+    int file_fd; // File being sent to a plain HTTP client, -1 if there is none
+    off_t file_offset;
+    off_t file_end;
+    int backend; // Remote server the client is routed to, -1 if it is not routed yet or uses the multiplexed link
+    unsigned int lobby_id; // Lobby the client was grouped in (-g)
 } t_client;
 
 typedef struct {
-    unsigned int client_nb;
-    t_client client_socket[MAX_BRIDGE_CONNECTIONS];
-    const char *remote_ip;
-    const char *remote_port;
-} t_ws_bridge;
+    const char *extension;
+    const char *content_type;
+    const char *cache_control;
+} t_mime_type;
+
+typedef struct {
+    int fd;
+    bool connected; // false while the connection is in progress
+    unsigned int backend;
+} t_pooled_socket;
+
+typedef struct {
+    const char *ip;
+    const char *port;
+    struct sockaddr_storage addr; // Resolved once at startup
+    socklen_t addr_len;
+    unsigned int clients; // Clients connected or connecting to this remote server
+    unsigned int pooled; // Pool sockets of this remote server
+    bool healthy; // Cleared when a connection fails, set again by a successful one or by a probe
+    int probe_fd; // Health check connection in progress, -1 if there is none
+} t_backend;
 
-// polling struct : contain fds to poll and client associated fd
 typedef struct {
-        struct pollfd pfds[MAX_BRIDGE_CONNECTIONS];
-        int sock_fd[MAX_BRIDGE_CONNECTIONS];
-} t_wsb_poll_struct;
+    unsigned int client_nb;
+    unsigned int max_clients;
+    t_client *client_socket; // Pool of max_clients entries
+    unsigned int *free_slots; // Stack of the free client_socket indexes
+    unsigned int free_nb;
+    t_client **fd_table; // Client owning each fd (WebSocket or remote server one), indexed by fd
+    unsigned int fd_table_size;
+    const char *remote_unix_path; // Remote server Unix socket (-u), NULL to use remote_ip and remote_port
+    t_backend backends[MAX_BACKENDS]; // The multiplexed link and the Unix socket only use the first one
+    unsigned int backend_nb;
+    int health_timer_fd; // Starts the connect probes, -1 when there is a single remote server
+    unsigned int lobby_size; // Clients grouped on the same remote server before using another one (-g), 0 to route by least connections
+    int lobby_backend; // Remote server of the lobby being filled, -1 if there is none
+    unsigned int lobby_clients;
+    unsigned int lobby_id; // Incremented each time a lobby is started
+    t_pooled_socket pool[MAX_POOL_SIZE * MAX_BACKENDS]; // Remote server sockets connected in advance
+    unsigned int pool_nb;
+    unsigned int pool_size; // Number of sockets to keep in the pool of each remote server
+    bool mux; // All clients share a single multiplexed link to the remote server
+    int link_fd; // -1 when the link is down
+    bool link_connected;
+    unsigned char link_in[LINK_BUFFER_SIZE]; // Frames received from the remote server, not processed yet
+    unsigned int link_in_len;
+    unsigned char link_out[LINK_BUFFER_SIZE]; // Frames waiting to be sent to the remote server
+    unsigned int link_out_len;
+    bool link_out_watched; // EPOLLOUT is set while queued frames could not be sent
+    bool shm; // The link frames go through shared memory rings instead of the socket (-s)
+    TRingPair *rings; // Shared with the server while the link is up
+    int ring_event_fd; // Written by the server when it used the rings, -1 when the link is down
+    t_client **channels; // Client of each channel ID
+    unsigned int next_channel;
+    t_client **upstream_queue; // Clients having upstream data to send, max_clients entries
+    unsigned int upstream_queue_nb;
+    unsigned int coalesce_window; // Milliseconds the upstream data is kept to be sent at once (-w), 0 to send it at the end of each reactor iteration
+    int coalesce_timer_fd; // -1 when there is no coalescing window
+    bool coalesce_timer_armed;
+    int epoll_fd; // Reactor watching the listen socket, all WebSocket and remote server sockets
+    int docroot_fd; // Directory served to plain HTTP requests (-d), -1 to accept WebSocket connections only
+} t_ws_bridge;
 
 /* Global variables */
 
 static t_ws_bridge wsb;
 
+static const t_mime_type mime_types[] = {
+    { ".html", "text/html; charset=utf-8", HTTP_CACHE_REVALIDATE },
+    { ".js", "application/javascript; charset=utf-8", HTTP_CACHE_REVALIDATE },
+    { ".css", "text/css; charset=utf-8", HTTP_CACHE_REVALIDATE },
+    { ".txt", "text/plain; charset=utf-8", HTTP_CACHE_REVALIDATE },
+    { ".png", "image/png", HTTP_CACHE_IMMUTABLE },
+    { ".ico", "image/x-icon", HTTP_CACHE_IMMUTABLE },
+    { NULL, "application/octet-stream", HTTP_CACHE_REVALIDATE } // Any other file
+};
+
+static int link_queue(int channel, unsigned char type, const unsigned char *payload, unsigned int len);
+static void client_leave_backend(t_client *cli);
+static void upstream_unqueue(t_client *cli);
+
 static bool dead = false;
+static volatile sig_atomic_t metrics_requested = 0;
 
 /* Signaling stuff to stop the server */
 
@@ -60,531 +203,2090 @@ static void intHandler()
 {
     dead = true;
 }
-/* ----------------- */
-
-/* Wrapper functions */
 
-static int server_write(int fd, const char* msg, int msgSize)
+static void metricsHandler()
 {
-    int n;
-
-    DBG_STR(msg);
-    n = write(fd, msg, msgSize);
-    if(n == -1)
-        printf("[%s:%d] Error : failed to write to the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-    return n;
+    metrics_requested = 1;
 }
+/* ----------------- */
+
+/* Wrapper functions */
 
 static int server_read(int fd, char* buffer,int bufferSize)
 {
     int n;
 
-    memset(buffer, 0, bufferSize);
     n = read(fd,buffer,bufferSize-1);
     if(n == -1)
-        printf("[%s:%d] Error : failed to read from the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+    {
+        if(errno != EAGAIN)
+            printf("[%s:%d] Error : failed to read from the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return n;
+    }
+    buffer[n] = '\0';
     DBG_STR(buffer);
     return n;
 }
-/* ----------------- */
 
-/* Add/Delete client functions */
-static int add_client(int sock_fd)
+static int reactor_ctl(int op, int fd, unsigned int events)
 {
-    unsigned int i;
+    struct epoll_event ev;
 
-    if(wsb.client_nb >= MAX_BRIDGE_CONNECTIONS)
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if(epoll_ctl(wsb.epoll_fd, op, fd, &ev) == -1)
     {
-        printf("[%s:%d] Error : Maximum number of clients already connected.\n", __FUNCTION__, __LINE__);
+        printf("[%s:%d] Error : epoll_ctl() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
         return 1;
     }
+    return 0;
+}
 
-    // Find the first free element into the list
-    for(i=0; i<MAX_BRIDGE_CONNECTIONS; i++)
-    {
-        if(wsb.client_socket[i].ws_fd == -1)
-        {
-            wsb.client_nb++;
-            wsb.client_socket[i].ws_fd = sock_fd;
-            printf("[%s:%d] Info : new client with id %d is connected.\n", __FUNCTION__, __LINE__, sock_fd);
-            printf("[%s:%d] Info : %d client(s) connected.\n", __FUNCTION__, __LINE__, wsb.client_nb);
+static int reactor_add(int fd)
+{
+    return reactor_ctl(EPOLL_CTL_ADD, fd, EPOLLIN);
+}
+/* ----------------- */
 
-            return 0;
-        }
-    }
+/* Output queues */
 
-    printf("[%s:%d] Error : Unknown error.\n", __FUNCTION__, __LINE__);
+static int queue_append(t_out_queue *q, const unsigned char *data, unsigned int len)
+{
+    unsigned int size;
+    unsigned char *new_data;
 
-    return 1;
-}
+    if(len == 0)
+        return 0;
 
-static int set_client_remote_fd(int cli_id, int sock_fd)
-{
-    unsigned int i;
+    if(q->len + len > QUEUE_MAX_SIZE)
+    {
+        printf("[%s:%d] Error : the output queue is full.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
 
-    // Find fd to delete into wsb struct
-    for(i=0; i<MAX_BRIDGE_CONNECTIONS; i++)
+    if(q->len + len > q->size)
     {
-        if(wsb.client_socket[i].ws_fd == cli_id)
+        size = (q->size == 0) ? 4096 : q->size;
+        while(size < q->len + len)
+            size *= 2;
+        new_data = realloc(q->data, size);
+        if(new_data == NULL)
         {
-            wsb.client_socket[i].tcp_fd = sock_fd;
-            return 0;
+            printf("[%s:%d] Error : failed to grow the output queue.\n", __FUNCTION__, __LINE__);
+            return 1;
         }
+        q->data = new_data;
+        q->size = size;
     }
 
-    printf("[%s:%d] Error : client to set remote socket not found.\n", __FUNCTION__, __LINE__);
-    return 1;
+    memcpy(q->data + q->len, data, len);
+    q->len += len;
+    if(q->len > q->peak)
+        q->peak = q->len;
+    return 0;
 }
 
-static int delete_client(int sock_fd)
+/* Send as much queued data as the socket accepts, return 1 on error */
+static int queue_send(int fd, t_out_queue *q)
 {
-    unsigned int i;
+    int n;
 
-    // Find fd to delete into wsb struct
-    for(i=0; i<MAX_BRIDGE_CONNECTIONS; i++)
+    if(q->len == 0)
+        return 0;
+
+    n = write(fd, q->data, q->len);
+    if(n == -1)
     {
-        if(wsb.client_socket[i].ws_fd == sock_fd)
-        {
-            wsb.client_nb--;
-            printf("[%s:%d] Info : client connection with id %d is terminated.\n", __FUNCTION__, __LINE__, sock_fd);
-            printf("[%s:%d] Info : %d client(s) connected.\n", __FUNCTION__, __LINE__, wsb.client_nb);
-            wsb.client_socket[i].ws_fd = -1;
-            wsb.client_socket[i].tcp_fd = -1;
+        if(errno == EAGAIN)
             return 0;
-        }
+        printf("[%s:%d] Error : failed to write to the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
     }
 
-    printf("[%s:%d] Error : client to delete not found.\n", __FUNCTION__, __LINE__);
-    return 1;
+    q->len -= n;
+    memmove(q->data, q->data + n, q->len);
+    return 0;
 }
 
+static void queue_free(t_out_queue *q)
+{
+    free(q->data);
+    memset(q, 0, sizeof(*q));
+}
 
-/* Remote server thread handler */
-static void *remote_server_thread_handler(void *arg)
+/* Watch the events the client sockets need : stop reading from one side while the other side queue is above the high watermark */
+static void client_update_events(t_client *cli)
 {
-    int num_events, ws_frame_size;
-    unsigned int nb, i, rd_bytes;
-    unsigned int events_found = 0;
-    char server_msg[4096], data[4096];
-    t_wsb_poll_struct ps;
+    unsigned int events;
 
-    // Clear/Init all file descriptors
-    for(i=0; i< MAX_BRIDGE_CONNECTIONS; i++)
+    if(cli->ws_out.len > QUEUE_HIGH_WATERMARK)
     {
-        ps.pfds[i].fd = -1;
+        if(!cli->tcp_paused)
+            cli->pauses++;
+        cli->tcp_paused = true;
     }
+    else if(cli->ws_out.len < QUEUE_LOW_WATERMARK)
+        cli->tcp_paused = false;
+
+    if(cli->tcp_out.len > QUEUE_HIGH_WATERMARK)
+        cli->ws_paused = true;
+    else if(cli->tcp_out.len < QUEUE_LOW_WATERMARK)
+        cli->ws_paused = false;
+
+    // The next plain HTTP request is not read while a file is being sent, and nothing is read from a closing client
+    events = ((cli->ws_paused || (cli->state == CLIENT_STATE_HTTP) || (cli->state == CLIENT_STATE_CLOSING)) ? 0 : EPOLLIN) | (((cli->ws_out.len > 0) || (cli->file_fd != -1)) ? EPOLLOUT : 0);
+    if((events != cli->ws_events) && (reactor_ctl(EPOLL_CTL_MOD, cli->ws_fd, events) == 0))
+        cli->ws_events = events;
+
+    // The remote server socket is watched for writing while connecting
+    if((cli->tcp_fd == -1) || (cli->state == CLIENT_STATE_CONNECTING))
+        return;
+    events = (cli->tcp_paused ? 0 : EPOLLIN) | (cli->tcp_out.len > 0 ? EPOLLOUT : 0);
+    if((events != cli->tcp_events) && (reactor_ctl(EPOLL_CTL_MOD, cli->tcp_fd, events) == 0))
+        cli->tcp_events = events;
+}
 
-    while(!dead)
+/* Send data to one of the client sockets without blocking, what can't be sent now is queued. Return 1 if the client must be dropped */
+static int client_send(t_client *cli, bool to_ws, const unsigned char *header, unsigned int header_len, const unsigned char *data, unsigned int len)
+{
+    int n = 0, fd = to_ws ? cli->ws_fd : cli->tcp_fd;
+    t_out_queue *q = to_ws ? &cli->ws_out : &cli->tcp_out;
+    struct iovec iov[2];
+
+    // Queued data must be sent first, and a connecting socket can't be written yet
+    if((q->len == 0) && (to_ws || (cli->state != CLIENT_STATE_CONNECTING)))
     {
-        // Refresh list of fds to poll
-        nb = 0;
-        for(i=0; nb<wsb.client_nb; i++)
+        iov[0].iov_base = (void *) header;
+        iov[0].iov_len = header_len;
+        iov[1].iov_base = (void *) data;
+        iov[1].iov_len = len;
+        n = writev(fd, iov, 2);
+        if(n == -1)
         {
-            if(wsb.client_socket[i].tcp_fd != -1)
+            if(errno != EAGAIN)
             {
-                ps.pfds[nb].fd = wsb.client_socket[i].tcp_fd;
-                ps.pfds[nb].events = POLLIN | POLLPRI;
-                ps.sock_fd[nb] = wsb.client_socket[i].ws_fd;
-                nb++;
+                printf("[%s:%d] Error : failed to write to the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+                return 1;
             }
+            n = 0;
         }
+    }
 
-        // Poll the client sockets, timeout fixed to 3s
-        num_events = poll(ps.pfds, wsb.client_nb, 3000);
-
-        if(num_events == -1)
-        {
-            printf("[%s:%d] Error : poll() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        }
-        else if(num_events > 0)
-        {
-            /* Service all the sockets with input pending. */
-            events_found = 0;
-            for(i=0; events_found < num_events; i++)
-            {
-                if(ps.pfds[i].revents & POLLIN)
-                {
-                    // Receive message from remote server
-                    rd_bytes = server_read(ps.pfds[i].fd, server_msg, sizeof(server_msg));
+    // Queue what remains
+    if((unsigned int) n < header_len)
+    {
+        if(queue_append(q, header + n, header_len - n) != 0)
+            return 1;
+        n = 0;
+    }
+    else
+        n -= header_len;
+    if(queue_append(q, data + n, len - n) != 0)
+        return 1;
 
-                    // read error
-                    if(rd_bytes < 0)
-                    {
-                        printf("[%s:%d] Error : read failed - do not process.\n", __FUNCTION__, __LINE__);
+    client_update_events(cli);
+    return 0;
+}
 
-                    }
-                    else if(rd_bytes == 0)
-                    {
-                        // Server disconnected => send conn close msg to Websocket client
-                        server_write(ps.sock_fd[i], WEBSOCKET_CONN_CLOSE, sizeof(WEBSOCKET_CONN_CLOSE));
-                    }
-                    else
-                    {
-#if DEBUG
-                        printf("[%s:%d] remote server send msg to client id=%d : %s\n", __FUNCTION__, __LINE__, ps.sock_fd[i], server_msg);
-#endif
-                        // Encode msg to Websocket format
-                        ws_frame_size = WEBSOCKET_set_content(server_msg, rd_bytes, (unsigned char*) data, sizeof(data));
-
-                        // Send message to the client
-                        if(ws_frame_size > 0)
-                        {
-                            server_write(ps.sock_fd[i], data, ws_frame_size);
-                        }
-                        else
-                        {
-                            printf("[%s:%d] Error : WebSocket msg to send is empty.\n", __FUNCTION__, __LINE__);
-                        }
-                    }
-                    events_found++;
-                }
-            }
-        }
-    }
-    printf("[%s:%d] Exit remote server thread\n", __FUNCTION__, __LINE__);
+/* Send a WebSocket frame to the client */
+static int client_send_frame(t_client *cli, unsigned char opcode, const unsigned char *data, unsigned int len)
+{
+    unsigned char header[WEBSOCKET_MAX_HEADER_SIZE];
 
-    return NULL;
+    return client_send(cli, true, header, WEBSOCKET_set_header(header, opcode, len), data, len);
 }
 
-/* Websocket thread handler */
-static void *websocket_thread_handler(void *arg)
+/* Tell the client the connection is closing, after the data queued for it. Return 1 if the client can be deleted now, 0 if it is deleted once its queue is drained */
+static int client_close(t_client *cli)
 {
-    int num_events, ret, rd_bytes;
-    unsigned int nb, i;
-    unsigned int events_found = 0;
-    char client_ws_msg[4096], data[4096];
-    t_wsb_poll_struct ps;
+    // Nothing can follow the close frame
+    upstream_unqueue(cli);
+    if(client_send(cli, true, NULL, 0, (const unsigned char *) WEBSOCKET_CONN_CLOSE, sizeof(WEBSOCKET_CONN_CLOSE) - 1) != 0)
+        return 1;
+    if(cli->ws_out.len == 0)
+        return 1;
 
-    // Clear/Init all file descriptors
-    for(i=0; i< MAX_BRIDGE_CONNECTIONS; i++)
+    // Stop reading both sides : the remote server is released now, the client socket is only watched for writing
+    cli->state = CLIENT_STATE_CLOSING;
+    if(cli->channel != -1)
     {
-        ps.pfds[i].fd = -1;
+        link_queue(cli->channel, NETWORK_LINK_FRAME_TYPE_CLOSE, NULL, 0);
+        wsb.channels[cli->channel] = NULL;
+        cli->channel = -1;
     }
+    client_leave_backend(cli);
+    client_update_events(cli);
+    return 0;
+}
 
-    while(!dead)
+/* Print the queue depths of all connections (SIGUSR1) */
+static void print_metrics(void)
+{
+    unsigned int i;
+    t_client *cli;
+
+    printf("[%s:%d] Info : %u client(s) connected, multiplexed link queue %u bytes.\n", __FUNCTION__, __LINE__, wsb.client_nb, wsb.link_out_len);
+    for(i=0; i<wsb.backend_nb; i++)
+        printf("  remote server %s:%s : %u client(s), %u pooled socket(s), %s\n", wsb.backends[i].ip, wsb.backends[i].port,
+            wsb.backends[i].clients, wsb.backends[i].pooled, wsb.backends[i].healthy ? "up" : "down");
+    for(i=0; i<wsb.max_clients; i++)
     {
-        // Refresh list of fds to poll
-        nb = 0;
-        for(i=0; nb<wsb.client_nb; i++)
-        {
-            if(wsb.client_socket[i].ws_fd != -1)
-            {
-                ps.pfds[nb].fd = wsb.client_socket[i].ws_fd;
-                ps.pfds[nb].events = POLLIN | POLLPRI;
-                ps.sock_fd[nb] = wsb.client_socket[i].tcp_fd;
-                nb++;
-            }
-        }
+        cli = &wsb.client_socket[i];
+        if(cli->ws_fd == -1)
+            continue;
+        printf("  client id=%d : to client %u bytes (peak %u), to server %u bytes (peak %u), server reading %s (paused %u times), client reading %s\n",
+            cli->ws_fd, cli->ws_out.len, cli->ws_out.peak, cli->tcp_out.len, cli->tcp_out.peak,
+            cli->tcp_paused ? "paused" : "active", cli->pauses, cli->ws_paused ? "paused" : "active");
+    }
+    fflush(stdout);
+}
 
-        // Poll the client sockets, timeout fixed to 3s
-        num_events = poll(ps.pfds, wsb.client_nb, 3000);
+/* Add/Delete client functions */
+static t_client *add_client(int sock_fd)
+{
+    t_client *cli;
 
-        if(num_events == -1)
-        {
-            printf("[%s:%d] Error : poll() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        }
-        else if(num_events > 0)
-        {
-            /* Service all the sockets with input pending. */
-            events_found = 0;
-            for(i=0; events_found < num_events; i++)
-            {
-                if(ps.pfds[i].revents & POLLIN)
-                {
-                    // Clear recv buffers
-                    client_ws_msg[0] = '\0';
-                    data[0] = '\0';
+    if(wsb.free_nb == 0)
+    {
+        printf("[%s:%d] Error : Maximum number of clients already connected.\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
 
-                    // Receive Ws message from client
-                    rd_bytes = server_read(ps.pfds[i].fd, client_ws_msg, sizeof(client_ws_msg));
+    // The fd table is sized from the fd limit, so this should never happen
+    if((unsigned int) sock_fd >= wsb.fd_table_size)
+    {
+        printf("[%s:%d] Error : fd %d is out of the connection table.\n", __FUNCTION__, __LINE__, sock_fd);
+        return NULL;
+    }
 
-                    // read error
-                    if(rd_bytes < 0)
-                    {
-                        printf("[%s:%d] Error : read failed - do not process.\n", __FUNCTION__, __LINE__);
+    // Pop a free element from the pool
+    wsb.free_nb--;
+    cli = &wsb.client_socket[wsb.free_slots[wsb.free_nb]];
+    wsb.client_nb++;
+
+    cli->ws_fd = sock_fd;
+    cli->tcp_fd = -1;
+    cli->state = CLIENT_STATE_HANDSHAKE;
+    cli->handshake_len = 0;
+    memset(&cli->ws_out, 0, sizeof(cli->ws_out));
+    memset(&cli->tcp_out, 0, sizeof(cli->tcp_out));
+    cli->ws_events = EPOLLIN;
+    cli->tcp_events = 0;
+    cli->ws_paused = false;
+    cli->tcp_paused = false;
+    cli->pauses = 0;
+    cli->channel = -1;
+    cli->upstream_len = 0;
+    cli->upstream_queue_index = -1;
+    cli->file_fd = -1;
+    cli->backend = -1;
+    WEBSOCKET_parser_init(&cli->parser);
+    wsb.fd_table[sock_fd] = cli;
+
+    printf("[%s:%d] Info : new client with id %d is connected.\n", __FUNCTION__, __LINE__, sock_fd);
+    printf("[%s:%d] Info : %d client(s) connected.\n", __FUNCTION__, __LINE__, wsb.client_nb);
+
+    return cli;
+}
 
-                    }
-                    else if(rd_bytes == 0)
-                    {
-                        // client disconnected
-                        delete_client(ps.pfds[i].fd);
-                        close(ps.pfds[i].fd);
-                        ps.pfds[i].fd = -1;
-                    }
-                    else
-                    {
-                        // Message received
-                        ret = WEBSOCKET_get_content(client_ws_msg, sizeof(client_ws_msg), (unsigned char*) data, sizeof(data));
-
-                        // Client send Ws close msg
-                        if(ret == -2)
-                        {
-                            delete_client(ps.pfds[i].fd);
-                            close(ps.pfds[i].fd);
-                            ps.pfds[i].fd = -1;
-                        }
-                        else if(ret == -1)
-                        {
-                            printf("[%s:%d] Unknown error get webSocket content\n", __FUNCTION__, __LINE__);
-                        }
-                        else
-                        {
-#if DEBUG
-                            printf("[%s:%d] client id=%d Receive msg : %s\n", __FUNCTION__, __LINE__, ps.pfds[i].fd, data);
-#endif
-                            // Send the msg to the remote server
-                            if(ps.sock_fd[i] != -1)
-                            {
-                                server_write(ps.sock_fd[i], data, strlen(data));
-                            }
-                        }
-                    }
-                    events_found++;
-                }
-            }
-        }
+static int set_client_remote_fd(t_client *cli, int remote_fd)
+{
+    if((unsigned int) remote_fd >= wsb.fd_table_size)
+    {
+        printf("[%s:%d] Error : fd %d is out of the connection table.\n", __FUNCTION__, __LINE__, remote_fd);
+        close(remote_fd);
+        return 1;
     }
-    printf("[%s:%d] Exit websocket thread\n", __FUNCTION__, __LINE__);
 
-    return NULL;
+    cli->tcp_fd = remote_fd;
+    wsb.fd_table[remote_fd] = cli;
+    return 0;
 }
 
+static t_client *find_client(int fd)
+{
+    // The fd can be either the WebSocket or the remote server one
+    if((fd < 0) || ((unsigned int) fd >= wsb.fd_table_size))
+        return NULL;
+
+    return wsb.fd_table[fd];
+}
 
-/* Remote TCP server connect */
-static int connect_to_remote_server(int *sockfd)
+static void delete_client(t_client *cli)
 {
-    int rv;
-    struct addrinfo hints, *servinfo, *p;
+    // Losing the multiplexed link may have deleted the client already
+    if(cli->ws_fd == -1)
+        return;
 
-    *sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if(*sockfd < 0)
+    // Forget the upstream data not sent yet
+    upstream_unqueue(cli);
+
+    wsb.client_nb--;
+    printf("[%s:%d] Info : client connection with id %d is terminated.\n", __FUNCTION__, __LINE__, cli->ws_fd);
+    printf("[%s:%d] Info : %d client(s) connected.\n", __FUNCTION__, __LINE__, wsb.client_nb);
+
+    // Tell the remote server the client is gone
+    if(cli->channel != -1)
     {
-        printf("[%s:%d] Error : failed to create the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        return 1;
+        link_queue(cli->channel, NETWORK_LINK_FRAME_TYPE_CLOSE, NULL, 0);
+        wsb.channels[cli->channel] = NULL;
+        cli->channel = -1;
     }
 
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+    // Closing the sockets also removes them from the reactor
+    wsb.fd_table[cli->ws_fd] = NULL;
+    close(cli->ws_fd);
+    client_leave_backend(cli);
+    cli->ws_fd = -1;
+    if(cli->file_fd != -1)
+    {
+        close(cli->file_fd);
+        cli->file_fd = -1;
+    }
+    queue_free(&cli->ws_out);
+    queue_free(&cli->tcp_out);
+
+    // Give the element back to the pool
+    wsb.free_slots[wsb.free_nb] = cli - wsb.client_socket;
+    wsb.free_nb++;
+}
 
-    if((rv = getaddrinfo(wsb.remote_ip, wsb.remote_port, &hints, &servinfo)) != 0)
+/* Allocate the connection table and raise the fd limit so that max_clients clients can be connected */
+static int connection_table_init(unsigned int max_clients)
+{
+    unsigned int i;
+    struct rlimit limit;
+    rlim_t needed_fds = (rlim_t) max_clients * 2 + RESERVED_FDS; // A WebSocket and a remote server socket per client
+
+    if(getrlimit(RLIMIT_NOFILE, &limit) == -1)
     {
-        printf("[%s:%d] Error : getaddrinfo(%s, %s, ...) failed (%s).\n", __FUNCTION__, __LINE__, wsb.remote_ip, wsb.remote_port, gai_strerror(rv));
+        printf("[%s:%d] Error : getrlimit() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
         return 1;
     }
 
-    // loop through all the results and connect to the first we can
-    for(p = servinfo; p != NULL; p = p->ai_next)
+    if(limit.rlim_cur < needed_fds)
     {
-        if((*sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
-        {
-            printf("[%s:%d] Error : failed to create the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-            continue;
-        }
+        // Only the hard limit can be reached without privileges
+        limit.rlim_cur = (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed_fds) ? limit.rlim_max : needed_fds;
+        if(setrlimit(RLIMIT_NOFILE, &limit) == -1)
+            printf("[%s:%d] Error : setrlimit() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        getrlimit(RLIMIT_NOFILE, &limit);
 
-        if(connect(*sockfd, p->ai_addr, p->ai_addrlen) == -1)
+        if(limit.rlim_cur < needed_fds)
         {
-            close(*sockfd);
-            printf("[%s:%d] Error : connect() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-            continue;
+            max_clients = (limit.rlim_cur - RESERVED_FDS) / 2;
+            printf("[%s:%d] Warning : the fd limit is %lu, only %u clients can be connected.\n", __FUNCTION__, __LINE__, (unsigned long) limit.rlim_cur, max_clients);
         }
-        break;
     }
 
-    if(!p)
+    // Every fd the process can open has an entry
+    wsb.fd_table_size = limit.rlim_cur;
+    wsb.fd_table = calloc(wsb.fd_table_size, sizeof(t_client *));
+    wsb.client_socket = calloc(max_clients, sizeof(t_client));
+    wsb.free_slots = malloc(max_clients * sizeof(unsigned int));
+    wsb.upstream_queue = malloc(max_clients * sizeof(t_client *));
+    if((wsb.fd_table == NULL) || (wsb.client_socket == NULL) || (wsb.free_slots == NULL) || (wsb.upstream_queue == NULL))
     {
-        printf("[%s:%d] Error : failed to connect to the remote server.\n", __FUNCTION__, __LINE__);
+        printf("[%s:%d] Error : failed to allocate the connection table for %u clients.\n", __FUNCTION__, __LINE__, max_clients);
         return 1;
     }
 
-    freeaddrinfo(servinfo);
+    // All elements are free
+    wsb.client_nb = 0;
+    wsb.max_clients = max_clients;
+    wsb.free_nb = max_clients;
+    wsb.upstream_queue_nb = 0;
+    for(i=0; i<max_clients; i++)
+    {
+        wsb.client_socket[i].ws_fd = -1;
+        wsb.client_socket[i].tcp_fd = -1;
+        wsb.free_slots[i] = max_clients - 1 - i;
+    }
 
     return 0;
 }
 
-/* Function to wait client */
-static int server_wait_client(int sockfd)
+/* Resolve the remote TCP server address once, so that connecting never blocks on DNS */
+static int resolve_remote_server(t_backend *backend)
 {
-    int cli_fd;
-    int remote_fd = -1;
-    struct sockaddr_in cli_addr;
-    socklen_t clilen;
-    char buffer[1024], response[1024];
-    int events_count;
-    fd_set fds;
-    struct timeval timeout;
-
-    // Create the set of file descriptors (it must created for each call)
-    FD_ZERO(&fds);
-    FD_SET(sockfd, &fds);
-
-    // Set the timeout value to zero to make select() instantly return (it must be reset each time too)
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-
-    // Use select() as it can poll a blocking socket without blocking the program
-    events_count = select(sockfd + 1, &fds, NULL, NULL, &timeout);
-    if (events_count == -1)
-    {
-        printf("[%s:%d] Error : select() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+    int rv;
+    struct addrinfo hints, *servinfo;
+    struct sockaddr_un *unix_addr;
+
+    // The server runs on the same host, skip the TCP stack
+    if(wsb.remote_unix_path != NULL)
+    {
+        unix_addr = (struct sockaddr_un *) &backend->addr;
+        if(strlen(wsb.remote_unix_path) >= sizeof(unix_addr->sun_path))
+        {
+            printf("[%s:%d] Error : the Unix socket path is too long.\n", __FUNCTION__, __LINE__);
+            return 1;
+        }
+        memset(unix_addr, 0, sizeof(*unix_addr));
+        unix_addr->sun_family = AF_UNIX;
+        strcpy(unix_addr->sun_path, wsb.remote_unix_path);
+        backend->addr_len = sizeof(*unix_addr);
+        backend->ip = wsb.remote_unix_path;
+        backend->port = "unix";
         return 0;
     }
 
-    // No client attempted to connect
-    if (events_count == 0) return 0;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
 
-    cli_fd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-    if(cli_fd == -1)
+    if((rv = getaddrinfo(backend->ip, backend->port, &hints, &servinfo)) != 0)
     {
-        printf("[%s:%d] Error : accept() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        printf("[%s:%d] Error : getaddrinfo(%s, %s, ...) failed (%s).\n", __FUNCTION__, __LINE__, backend->ip, backend->port, gai_strerror(rv));
         return 1;
     }
 
-    memset(buffer, 0, sizeof(buffer));
-    server_read(cli_fd, buffer, sizeof(buffer));
+    // Use the first address
+    memcpy(&backend->addr, servinfo->ai_addr, servinfo->ai_addrlen);
+    backend->addr_len = servinfo->ai_addrlen;
 
-    if(WEBSOCKET_client_version(buffer) != 13)
-    {
-        printf("[%s:%d] Error : unsupported Websocket client version.\n", __FUNCTION__, __LINE__);
-        goto err;
-    }
+    freeaddrinfo(servinfo);
+
+    return 0;
+}
+
+/* Remote TCP server connect, *connected is set to false while the connection is in progress */
+static int connect_to_remote_server(int *sockfd, bool *connected, unsigned int backend)
+{
+    t_backend *b = &wsb.backends[backend];
 
-    if(!WEBSOCKET_valid_connection(buffer))
+    *sockfd = socket(b->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(*sockfd < 0)
     {
-        printf("[%s:%d] Error : not valid Websocket connection.\n", __FUNCTION__, __LINE__);
-        goto err;
+        printf("[%s:%d] Error : failed to create the socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
     }
 
-    // Calculate response handshake
-    if(WEBSOCKET_generate_handshake(buffer, response, sizeof(response)) != 0)
+    // The reactor tells when the connection is done
+    *connected = true;
+    if(connect(*sockfd, (struct sockaddr *) &b->addr, b->addr_len) == -1)
     {
-        printf("[%s:%d] Error : generate Websocket handshake failed.\n", __FUNCTION__, __LINE__);
-        goto err;
+        if(errno != EINPROGRESS)
+        {
+            printf("[%s:%d] Error : connect() to %s:%s failed (%s).\n", __FUNCTION__, __LINE__, b->ip, b->port, strerror(errno));
+            close(*sockfd);
+            return 1;
+        }
+        *connected = false;
     }
 
-    // Send handshake response
-    server_write(cli_fd, response, strlen(response));
+    return 0;
+}
 
-    // Add client to the list
-    if(add_client(cli_fd) != 0)
-        goto err;
+/* Tell whether a non-blocking connect succeeded (0), failed (1) or is still in progress (2) */
+static int check_remote_server_connection(int sockfd)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    struct sockaddr_storage addr;
 
-    // No we can connect the client to the remote server
-    if(connect_to_remote_server(&remote_fd) != 0)
+    if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+        err = errno;
+    if(err != 0)
     {
-        delete_client(cli_fd);
-        goto err;
+        printf("[%s:%d] Error : failed to connect to the remote server (%s).\n", __FUNCTION__, __LINE__, strerror(err));
+        return 1;
     }
 
-    set_client_remote_fd(cli_fd, remote_fd);
+    // The event may be a stale one from a previous socket with the same fd
+    len = sizeof(addr);
+    if((getpeername(sockfd, (struct sockaddr *) &addr, &len) == -1) && (errno == ENOTCONN))
+        return 2;
 
     return 0;
+}
 
-err:
-    // Close connection
-    server_write(cli_fd, WEBSOCKET_CONN_CLOSE, sizeof(WEBSOCKET_CONN_CLOSE));
-    close(cli_fd);
-    return 1;
+/* Remote server backends */
+
+/* Record whether a remote server accepts connections. A single remote server is always used, so it is never marked down */
+static void backend_set_health(unsigned int backend, bool healthy)
+{
+    t_backend *b = &wsb.backends[backend];
+
+    if((wsb.backend_nb == 1) || (b->healthy == healthy))
+        return;
+    b->healthy = healthy;
+    printf("[%s:%d] Info : remote server %s:%s is %s.\n", __FUNCTION__, __LINE__, b->ip, b->port, healthy ? "up" : "down");
 }
 
+static bool backend_any_healthy(void)
+{
+    unsigned int i;
+
+    for(i=0; i<wsb.backend_nb; i++)
+        if(wsb.backends[i].healthy)
+            return true;
+    return false;
+}
 
-int main(int argc, const char *argv[])
+/* Choose the remote server of a new client : the one with the fewest clients, or the one whose lobby is being filled (-g).
+ * Remote servers that are down are only used when all of them are */
+static unsigned int backend_choose(void)
 {
-    int i, bridge_sockfd;
-    int option_Value = 1;
-    struct sockaddr_in server;
-    pthread_t ws_thread;
-    pthread_t tcp_thread;
+    unsigned int i;
+    int best = -1;
+    bool any_healthy = backend_any_healthy();
 
-    // Check parameters
-    if(argc != 4)
+    // Keep filling the current lobby, so that its game can start
+    if((wsb.lobby_size > 0) && (wsb.lobby_backend != -1) && (wsb.lobby_clients < wsb.lobby_size) && (wsb.backends[wsb.lobby_backend].healthy || !any_healthy))
+        return wsb.lobby_backend;
+
+    for(i=0; i<wsb.backend_nb; i++)
     {
-        printf("Usage : %s  local_port remote_ip remote_port\n", argv[0]);
-        return EXIT_FAILURE;
+        if(any_healthy && !wsb.backends[i].healthy)
+            continue;
+        if((best == -1) || (wsb.backends[i].clients < wsb.backends[best].clients))
+            best = i;
     }
 
-    // Init Server struct, clear all fds
-    wsb.client_nb = 0;
-    for(i=0; i<MAX_BRIDGE_CONNECTIONS; i++)
+    // The next lobby is started on the least loaded remote server
+    if(wsb.lobby_size > 0)
     {
-        wsb.client_socket[i].ws_fd = -1;
-        wsb.client_socket[i].tcp_fd = -1;
+        wsb.lobby_backend = best;
+        wsb.lobby_clients = 0;
+        wsb.lobby_id++;
     }
+    return best;
+}
 
-    // Remote TCP server to connect
-    wsb.remote_ip = argv[2];
-    wsb.remote_port = argv[3];
-
-    // Create TCP socket dedicated to the bridge server
-    bridge_sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if(bridge_sockfd < 0)
+/* Count a client on its remote server */
+static void client_join_backend(t_client *cli, unsigned int backend)
+{
+    cli->backend = backend;
+    wsb.backends[backend].clients++;
+    if((wsb.lobby_size > 0) && ((int) backend == wsb.lobby_backend))
     {
-        printf("[%s:%d] Error : failed to create the socket server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        return 1;
+        wsb.lobby_clients++;
+        cli->lobby_id = wsb.lobby_id;
     }
+}
 
-    // Make the socket instantly reusable
-    if(setsockopt(bridge_sockfd, SOL_SOCKET, SO_REUSEADDR, &option_Value, sizeof(option_Value)) == -1)
+/* Close the client remote server socket and forget its routing */
+static void client_leave_backend(t_client *cli)
+{
+    if(cli->tcp_fd != -1)
     {
-        printf("[%s:%d] Error : failed to set the server socket as reusable (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        return 1;
+        wsb.fd_table[cli->tcp_fd] = NULL;
+        close(cli->tcp_fd);
+        cli->tcp_fd = -1;
     }
+    if(cli->backend == -1)
+        return;
+
+    // A client leaving the lobby being filled frees its place
+    wsb.backends[cli->backend].clients--;
+    if((wsb.lobby_size > 0) && (cli->backend == wsb.lobby_backend) && (cli->lobby_id == wsb.lobby_id))
+        wsb.lobby_clients--;
+    cli->backend = -1;
+}
 
-    // Try to bind the server
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(atoi(argv[1]));
+/* Start a connect probe to each remote server, a probe still in progress since the previous period means the server does not answer */
+static void health_check_start(void)
+{
+    uint64_t expirations;
+    unsigned int i;
+    bool connected;
+    t_backend *b;
 
-    if(bind(bridge_sockfd, (const struct sockaddr *) &server, sizeof(server)) != 0)
+    if(read(wsb.health_timer_fd, &expirations, sizeof(expirations)) == -1)
+        return;
+
+    for(i=0; i<wsb.backend_nb; i++)
     {
-        printf("[%s:%d] Error : failed to bind the server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-        close(bridge_sockfd);
-        return 1;
+        b = &wsb.backends[i];
+        if(b->probe_fd != -1)
+        {
+            close(b->probe_fd);
+            b->probe_fd = -1;
+            backend_set_health(i, false);
+        }
+
+        if(connect_to_remote_server(&b->probe_fd, &connected, i) != 0)
+        {
+            b->probe_fd = -1;
+            backend_set_health(i, false);
+            continue;
+        }
+        if(connected || (reactor_ctl(EPOLL_CTL_ADD, b->probe_fd, EPOLLOUT) != 0))
+        {
+            close(b->probe_fd);
+            b->probe_fd = -1;
+            backend_set_health(i, connected);
+        }
+    }
+}
+
+/* Handle a connect probe event, return false if fd is not a probe socket */
+static bool health_check_event(int fd)
+{
+    unsigned int i;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    struct sockaddr_storage addr;
+
+    for(i=0; i<wsb.backend_nb; i++)
+    {
+        if(wsb.backends[i].probe_fd != fd)
+            continue;
+
+        // The event may be a stale one from a previous socket with the same fd
+        if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+            err = errno;
+        len = sizeof(addr);
+        if((err == 0) && (getpeername(fd, (struct sockaddr *) &addr, &len) == -1) && (errno == ENOTCONN))
+            return true;
+
+        // The server sees an empty connection, which it drops silently
+        close(fd);
+        wsb.backends[i].probe_fd = -1;
+        backend_set_health(i, err == 0);
+        return true;
+    }
+    return false;
+}
+
+/* Upstream data coalescing */
+
+/* Size of the complete server commands at the beginning of data, the bridge never splits one across WebSocket frames */
+static unsigned int upstream_complete_size(const unsigned char *data, unsigned int len)
+{
+    unsigned int offset = 0, size;
+
+    while(offset < len)
+    {
+        switch(data[offset])
+        {
+            case NETWORK_COMMAND_DRAW_TILE:
+                size = NETWORK_COMMAND_DRAW_TILE_SIZE;
+                break;
+
+            case NETWORK_COMMAND_DRAW_TEXT:
+                if(len - offset < NETWORK_COMMAND_DRAW_TEXT_HEADER_SIZE)
+                    return offset;
+                size = NETWORK_COMMAND_DRAW_TEXT_HEADER_SIZE + data[offset + 1];
+                break;
+
+            case NETWORK_COMMAND_LOAD_MAP:
+                size = NETWORK_COMMAND_LOAD_MAP_SIZE;
+                break;
+
+            case NETWORK_COMMAND_ACKNOWLEDGE_EVENT:
+                size = NETWORK_COMMAND_ACKNOWLEDGE_EVENT_SIZE;
+                break;
+
+            default:
+                // Unknown command, the following commands can't be found
+                return len;
+        }
+        if(len - offset < size)
+            return offset;
+        offset += size;
+    }
+    return offset;
+}
+
+/* Send the complete commands received from the remote server in a single frame, an incomplete one is kept for the next frame. Return 1 if the client must be dropped */
+static int upstream_flush(t_client *cli)
+{
+    unsigned int len;
+
+    len = upstream_complete_size(cli->upstream, cli->upstream_len);
+    if(len == 0)
+        return 0;
+
+    if(client_send_frame(cli, WEBSOCKET_OPCODE_BINARY, cli->upstream, len) != 0)
+        return 1;
+
+    cli->upstream_len -= len;
+    memmove(cli->upstream, cli->upstream + len, cli->upstream_len);
+    return 0;
+}
+
+/* Send the data of all queued clients */
+static void upstream_flush_queue(void)
+{
+    t_client *cli;
+
+    while(wsb.upstream_queue_nb > 0)
+    {
+        wsb.upstream_queue_nb--;
+        cli = wsb.upstream_queue[wsb.upstream_queue_nb];
+        cli->upstream_queue_index = -1;
+        if(upstream_flush(cli) != 0)
+            delete_client(cli);
+    }
+}
+
+/* Remove a client from the upstream queue, its data not sent yet is forgotten */
+static void upstream_unqueue(t_client *cli)
+{
+    t_client *last;
+
+    cli->upstream_len = 0;
+    if(cli->upstream_queue_index == -1)
+        return;
+
+    wsb.upstream_queue_nb--;
+    last = wsb.upstream_queue[wsb.upstream_queue_nb];
+    wsb.upstream_queue[cli->upstream_queue_index] = last;
+    last->upstream_queue_index = cli->upstream_queue_index;
+    cli->upstream_queue_index = -1;
+}
+
+/* Make room in the upstream buffer of a client, the data is sent even if it ends with an incomplete command when there is no other way. Return 1 if the client must be dropped */
+static int upstream_make_room(t_client *cli)
+{
+    if(cli->upstream_len < sizeof(cli->upstream))
+        return 0;
+
+    if(upstream_flush(cli) != 0)
+        return 1;
+    if(cli->upstream_len == sizeof(cli->upstream))
+    {
+        if(client_send_frame(cli, WEBSOCKET_OPCODE_BINARY, cli->upstream, cli->upstream_len) != 0)
+            return 1;
+        cli->upstream_len = 0;
+    }
+    return 0;
+}
+
+/* Schedule the sending of a client upstream data */
+static void upstream_queue(t_client *cli)
+{
+    struct itimerspec timer;
+
+    if((cli->upstream_len == 0) || (cli->upstream_queue_index != -1))
+        return;
+
+    cli->upstream_queue_index = wsb.upstream_queue_nb;
+    wsb.upstream_queue[wsb.upstream_queue_nb] = cli;
+    wsb.upstream_queue_nb++;
+
+    // The window starts with the first data of a server tick, so the whole tick is sent at once
+    if((wsb.coalesce_timer_fd != -1) && !wsb.coalesce_timer_armed)
+    {
+        memset(&timer, 0, sizeof(timer));
+        timer.it_value.tv_sec = wsb.coalesce_window / 1000;
+        timer.it_value.tv_nsec = (wsb.coalesce_window % 1000) * 1000000L;
+        if(timerfd_settime(wsb.coalesce_timer_fd, 0, &timer, NULL) == -1)
+            printf("[%s:%d] Error : timerfd_settime() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        else
+            wsb.coalesce_timer_armed = true;
+    }
+}
+
+/* Append data received from the remote server to a client upstream buffer, return 1 if the client must be dropped */
+static int upstream_append(t_client *cli, const unsigned char *data, unsigned int len)
+{
+    unsigned int n;
+
+    while(len > 0)
+    {
+        if(upstream_make_room(cli) != 0)
+            return 1;
+        n = sizeof(cli->upstream) - cli->upstream_len;
+        if(n > len)
+            n = len;
+        memcpy(cli->upstream + cli->upstream_len, data, n);
+        cli->upstream_len += n;
+        data += n;
+        len -= n;
+    }
+    upstream_queue(cli);
+    return 0;
+}
+
+static void coalesce_timer_event(void)
+{
+    uint64_t expirations;
+
+    if(read(wsb.coalesce_timer_fd, &expirations, sizeof(expirations)) == -1)
+        return;
+    wsb.coalesce_timer_armed = false;
+    upstream_flush_queue();
+}
+
+/* Remote server sockets pool */
+static void pool_remove(unsigned int i)
+{
+    close(wsb.pool[i].fd);
+    wsb.backends[wsb.pool[i].backend].pooled--;
+    wsb.pool_nb--;
+    wsb.pool[i] = wsb.pool[wsb.pool_nb];
+}
+
+static void pool_refill(void)
+{
+    int fd;
+    unsigned int i;
+    bool connected;
+
+    // A remote server that is down gets its pool back once a probe succeeds
+    for(i=0; i<wsb.backend_nb; i++)
+    {
+        while(wsb.backends[i].healthy && (wsb.backends[i].pooled < wsb.pool_size))
+        {
+            if(connect_to_remote_server(&fd, &connected, i) != 0)
+            {
+                backend_set_health(i, false);
+                break;
+            }
+
+            // Wait for the connection, then watch the socket to discard it if the server closes it
+            if(reactor_ctl(EPOLL_CTL_ADD, fd, connected ? EPOLLIN : EPOLLOUT) != 0)
+            {
+                close(fd);
+                return;
+            }
+            wsb.pool[wsb.pool_nb].fd = fd;
+            wsb.pool[wsb.pool_nb].connected = connected;
+            wsb.pool[wsb.pool_nb].backend = i;
+            wsb.pool_nb++;
+            wsb.backends[i].pooled++;
+        }
+    }
+}
+
+/* Hand out a connected socket to the given remote server, or -1 if none is ready */
+static int pool_take(unsigned int backend)
+{
+    unsigned int i;
+    int fd;
+
+    for(i=0; i<wsb.pool_nb; i++)
+    {
+        if(wsb.pool[i].connected && (wsb.pool[i].backend == backend))
+        {
+            fd = wsb.pool[i].fd;
+            wsb.backends[backend].pooled--;
+            wsb.pool_nb--;
+            wsb.pool[i] = wsb.pool[wsb.pool_nb];
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/* Handle a pooled socket event, return false if fd is not a pooled socket */
+static bool pool_event(int fd)
+{
+    unsigned int i;
+    int ret;
+    char buffer[256];
+
+    for(i=0; i<wsb.pool_nb; i++)
+    {
+        if(wsb.pool[i].fd != fd)
+            continue;
+
+        // The socket is not replaced when it fails, to avoid a connection loop with a failing server. The pool is refilled on next client.
+        if(!wsb.pool[i].connected)
+        {
+            ret = check_remote_server_connection(fd);
+            if(ret == 0)
+                ret = reactor_ctl(EPOLL_CTL_MOD, fd, EPOLLIN);
+
+            if(ret == 0)
+            {
+                wsb.pool[i].connected = true;
+                backend_set_health(wsb.pool[i].backend, true);
+            }
+            else if(ret == 1)
+            {
+                backend_set_health(wsb.pool[i].backend, false);
+                pool_remove(i);
+            }
+        }
+        else
+        {
+            // The server must not send anything before the client connection command, so this is a disconnection
+            ret = read(fd, buffer, sizeof(buffer));
+            if((ret != -1) || (errno != EAGAIN))
+                pool_remove(i);
+        }
+        return true;
+    }
+    return false;
+}
+
+/* Multiplexed link to the remote server */
+static void link_close(void)
+{
+    unsigned int i;
+    t_client *cli;
+
+    printf("[%s:%d] Error : the multiplexed link to the remote server is down.\n", __FUNCTION__, __LINE__);
+    close(wsb.link_fd);
+    wsb.link_fd = -1;
+    wsb.link_connected = false;
+    if(wsb.rings != NULL)
+    {
+        RingPairUnmap(wsb.rings);
+        wsb.rings = NULL;
+        close(wsb.ring_event_fd);
+        wsb.ring_event_fd = -1;
+    }
+
+    // All clients lose their remote server, they get the commands already received
+    for(i=0; i<LINK_CHANNELS; i++)
+    {
+        cli = wsb.channels[i];
+        if(cli == NULL)
+            continue;
+        wsb.channels[i] = NULL;
+        cli->channel = -1;
+        if((upstream_flush(cli) != 0) || client_close(cli))
+            delete_client(cli);
+    }
+}
+
+/* Hand the shared memory rings and the eventfd to the server with the hello byte */
+static int link_share_rings(void)
+{
+    int fds[2];
+    unsigned char hello = NETWORK_LINK_HELLO_SHARED_MEMORY;
+    union
+    {
+        struct cmsghdr header; // Alignment
+        unsigned char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+
+    // A Unix socket connection is done at once, unless the server backlog is full
+    if(!wsb.link_connected)
+    {
+        printf("[%s:%d] Error : the remote server Unix socket is busy.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
+
+    wsb.rings = RingPairCreate(&fds[0]);
+    if(wsb.rings == NULL)
+        return 1;
+    wsb.ring_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wsb.ring_event_fd == -1)
+    {
+        printf("[%s:%d] Error : eventfd() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        close(fds[0]);
+        return 1;
+    }
+    fds[1] = wsb.ring_event_fd;
+
+    iov.iov_base = &hello;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // The server keeps its own copy of the shared memory
+    if(sendmsg(wsb.link_fd, &msg, 0) != 1)
+    {
+        printf("[%s:%d] Error : failed to send the rings to the remote server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        close(fds[0]);
+        return 1;
+    }
+    close(fds[0]);
+
+    return reactor_add(wsb.ring_event_fd);
+}
+
+static int link_connect(void)
+{
+    if(connect_to_remote_server(&wsb.link_fd, &wsb.link_connected, 0) != 0)
+    {
+        wsb.link_fd = -1;
+        return 1;
+    }
+    if(reactor_ctl(EPOLL_CTL_ADD, wsb.link_fd, wsb.link_connected ? EPOLLIN : EPOLLOUT) != 0)
+    {
+        close(wsb.link_fd);
+        wsb.link_fd = -1;
+        return 1;
+    }
+    wsb.link_out_watched = false;
+    wsb.link_in_len = 0;
+    wsb.link_out_len = 0;
+
+    if(wsb.shm)
+    {
+        if(link_share_rings() != 0)
+        {
+            link_close();
+            return 1;
+        }
+        return 0;
+    }
+
+    // The hello byte makes the server handle this connection as a link, frames are queued behind it until the connection is done
+    wsb.link_out[0] = NETWORK_LINK_HELLO;
+    wsb.link_out_len = 1;
+    return 0;
+}
+
+/* Send the queued frames, the remaining ones are sent when the socket becomes writable */
+static void link_flush(void)
+{
+    int n;
+
+    if(!wsb.link_connected || (wsb.link_out_len == 0))
+        return;
+
+    // The server polls its ring at each tick, the frames that don't fit are sent when the server tells it read the ring
+    if(wsb.rings != NULL)
+    {
+        n = RingWrite(&wsb.rings->To_Server, wsb.link_out, wsb.link_out_len);
+        wsb.link_out_len -= n;
+        memmove(wsb.link_out, wsb.link_out + n, wsb.link_out_len);
+        return;
+    }
+
+    n = write(wsb.link_fd, wsb.link_out, wsb.link_out_len);
+    if(n == -1)
+    {
+        if(errno == EAGAIN)
+            n = 0;
+        else
+        {
+            link_close();
+            return;
+        }
+    }
+
+    wsb.link_out_len -= n;
+    memmove(wsb.link_out, wsb.link_out + n, wsb.link_out_len);
+
+    // Wait for the socket to be writable only when needed
+    if((wsb.link_out_len > 0) != wsb.link_out_watched)
+    {
+        wsb.link_out_watched = (wsb.link_out_len > 0);
+        reactor_ctl(EPOLL_CTL_MOD, wsb.link_fd, wsb.link_out_watched ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+}
+
+/* Queue a frame, it is sent at the end of the reactor iteration */
+static int link_queue(int channel, unsigned char type, const unsigned char *payload, unsigned int len)
+{
+    unsigned char *frame;
+
+    if(wsb.link_fd == -1)
+        return 1;
+
+    if(wsb.link_out_len + NETWORK_LINK_FRAME_HEADER_SIZE + len > sizeof(wsb.link_out))
+    {
+        link_flush();
+        if((wsb.link_fd == -1) || (wsb.link_out_len + NETWORK_LINK_FRAME_HEADER_SIZE + len > sizeof(wsb.link_out)))
+        {
+            printf("[%s:%d] Error : the multiplexed link is congested.\n", __FUNCTION__, __LINE__);
+            return 1;
+        }
+    }
+
+    frame = wsb.link_out + wsb.link_out_len;
+    frame[0] = channel >> 8;
+    frame[1] = channel & 0xFF;
+    frame[2] = type;
+    frame[3] = len >> 8;
+    frame[4] = len & 0xFF;
+    if(len > 0)
+        memcpy(frame + NETWORK_LINK_FRAME_HEADER_SIZE, payload, len);
+    wsb.link_out_len += NETWORK_LINK_FRAME_HEADER_SIZE + len;
+    return 0;
+}
+
+/* Give a channel to a new client and tell the remote server about it */
+static int link_open_channel(t_client *cli)
+{
+    unsigned int i, channel = 0;
+
+    if((wsb.link_fd == -1) && (link_connect() != 0))
+        return 1;
+
+    // Use the channel IDs in turn, so that a closed channel ID is not reused while the server may still send data for it
+    for(i=0; i<LINK_CHANNELS; i++)
+    {
+        channel = (wsb.next_channel + i) % LINK_CHANNELS;
+        if(wsb.channels[channel] == NULL)
+            break;
+    }
+    if(i == LINK_CHANNELS)
+    {
+        printf("[%s:%d] Error : no free channel on the multiplexed link.\n", __FUNCTION__, __LINE__);
+        return 1;
+    }
+    wsb.next_channel = channel + 1;
+
+    wsb.channels[channel] = cli;
+    cli->channel = channel;
+    return link_queue(channel, NETWORK_LINK_FRAME_TYPE_OPEN, NULL, 0);
+}
+
+/* Dispatch the frames received from the remote server to the channels clients */
+static void link_process_frames(void)
+{
+    unsigned int offset = 0, channel, len;
+    unsigned char *frame;
+    t_client *cli;
+
+    while(wsb.link_in_len - offset >= NETWORK_LINK_FRAME_HEADER_SIZE)
+    {
+        frame = wsb.link_in + offset;
+        channel = (frame[0] << 8) | frame[1];
+        len = (frame[3] << 8) | frame[4];
+        if(len > NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE)
+        {
+            printf("[%s:%d] Error : received a too big frame (%u bytes) on the multiplexed link.\n", __FUNCTION__, __LINE__, len);
+            link_close();
+            return;
+        }
+        if(wsb.link_in_len - offset < NETWORK_LINK_FRAME_HEADER_SIZE + len)
+            break;
+        offset += NETWORK_LINK_FRAME_HEADER_SIZE + len;
+
+        // The client may be gone already
+        cli = wsb.channels[channel];
+        if(cli == NULL)
+            continue;
+
+        if(frame[2] == NETWORK_LINK_FRAME_TYPE_DATA)
+        {
+            // The link is shared, so a client that does not read its data can't slow the other ones down
+            if(upstream_append(cli, frame + NETWORK_LINK_FRAME_HEADER_SIZE, len) != 0)
+                delete_client(cli);
+        }
+        else if(frame[2] == NETWORK_LINK_FRAME_TYPE_CLOSE)
+        {
+            // The server closed the channel, no need to tell it back. Its last commands are sent before the close frame.
+            wsb.channels[channel] = NULL;
+            cli->channel = -1;
+            if((upstream_flush(cli) != 0) || client_close(cli))
+                delete_client(cli);
+        }
+    }
+
+    wsb.link_in_len -= offset;
+    memmove(wsb.link_in, wsb.link_in + offset, wsb.link_in_len);
+}
+
+static void link_event(unsigned int events)
+{
+    int n;
+
+    // Connection done
+    if(!wsb.link_connected)
+    {
+        n = check_remote_server_connection(wsb.link_fd);
+        if(n == 1)
+            link_close();
+        if(n != 0)
+            return;
+        wsb.link_connected = true;
+        wsb.link_out_watched = false;
+        reactor_ctl(EPOLL_CTL_MOD, wsb.link_fd, EPOLLIN);
+        link_flush();
+        return;
+    }
+
+    if(events & EPOLLOUT)
+        link_flush();
+
+    if((wsb.link_fd != -1) && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        n = read(wsb.link_fd, wsb.link_in + wsb.link_in_len, sizeof(wsb.link_in) - wsb.link_in_len);
+        if((n == -1) && (errno == EAGAIN))
+            return;
+        // The server sends nothing on the socket when the rings are used
+        if((n <= 0) || (wsb.rings != NULL))
+        {
+            link_close();
+            return;
+        }
+        wsb.link_in_len += n;
+        link_process_frames();
+    }
+}
+
+/* The server wrote frames to the ring or made room in its own ring */
+static void ring_event(void)
+{
+    uint64_t value;
+    int n;
+
+    if(read(wsb.ring_event_fd, &value, sizeof(value)) == -1)
+        return;
+
+    do
+    {
+        n = RingRead(&wsb.rings->To_Bridge, wsb.link_in + wsb.link_in_len, sizeof(wsb.link_in) - wsb.link_in_len);
+        wsb.link_in_len += n;
+        link_process_frames();
+    } while((n > 0) && (wsb.rings != NULL));
+}
+
+/* Accept all pending clients */
+static void server_accept_clients(int sockfd)
+{
+    int cli_fd;
+
+    while(1)
+    {
+        cli_fd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK);
+        if(cli_fd == -1)
+        {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                printf("[%s:%d] Error : accept() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+            return;
+        }
+
+        // The handshake is handled by the reactor when the request arrives
+        if(add_client(cli_fd) == NULL)
+        {
+            close(cli_fd);
+            continue;
+        }
+
+        if(reactor_add(cli_fd) != 0)
+            delete_client(find_client(cli_fd));
+    }
+}
+
+/* Relay the frames received from a WebSocket client, return 1 if the client must be dropped */
+static int websocket_relay(t_client *cli, unsigned char *data, unsigned int data_len)
+{
+    int ret;
+    unsigned int offset, len;
+    t_websocket_chunk chunk;
+
+    while((ret = WEBSOCKET_parser_next(&cli->parser, &data, &data_len, &chunk)) == 1)
+    {
+        switch(chunk.opcode)
+        {
+            case WEBSOCKET_OPCODE_TEXT:
+            case WEBSOCKET_OPCODE_BINARY:
+#if DEBUG
+                printf("[%s:%d] client id=%d Receive %u bytes\n", __FUNCTION__, __LINE__, cli->ws_fd, chunk.payload_length);
+#endif
+                // Send the exact payload to the remote server
+                if(cli->channel != -1)
+                {
+                    for(offset=0; offset<chunk.payload_length; offset+=len)
+                    {
+                        len = chunk.payload_length - offset;
+                        if(len > NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE)
+                            len = NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE;
+                        if(link_queue(cli->channel, NETWORK_LINK_FRAME_TYPE_DATA, chunk.payload + offset, len) != 0)
+                            return 1;
+                    }
+                }
+                else if(client_send(cli, false, NULL, 0, chunk.payload, chunk.payload_length) != 0) // Queued until the remote server is connected
+                    return 1;
+                break;
+
+            case WEBSOCKET_OPCODE_PING:
+                if(client_send_frame(cli, WEBSOCKET_OPCODE_PONG, chunk.payload, chunk.payload_length) != 0)
+                    return 1;
+                break;
+
+            case WEBSOCKET_OPCODE_CLOSE:
+                // Echo the close status code, then drop the client
+                if(cli->ws_out.len == 0)
+                    WEBSOCKET_write_frame(cli->ws_fd, WEBSOCKET_OPCODE_CLOSE, (char *) chunk.payload, chunk.payload_length >= 2 ? 2 : 0);
+                return 1;
+
+            default:
+                break;
+        }
+    }
+
+    if(ret == -1)
+    {
+        printf("[%s:%d] Error : client id=%d broke the WebSocket protocol.\n", __FUNCTION__, __LINE__, cli->ws_fd);
+        return client_close(cli);
+    }
+
+    return 0;
+}
+
+/* Connect a client to the chosen remote server, using a pre-connected socket if there is one.
+ * Another remote server is tried when the connection fails at once. Return 1 on failure */
+static int client_connect(t_client *cli)
+{
+    int remote_fd;
+    unsigned int backend;
+    bool connected;
+
+    while(1)
+    {
+        backend = backend_choose();
+        client_join_backend(cli, backend);
+
+        if((remote_fd = pool_take(backend)) != -1)
+        {
+            if(set_client_remote_fd(cli, remote_fd) != 0)
+                return 1;
+            cli->state = CLIENT_STATE_CONNECTED;
+            cli->tcp_events = EPOLLIN; // Watched by the pool
+            return 0;
+        }
+
+        if(connect_to_remote_server(&remote_fd, &connected, backend) == 0)
+            break;
+        client_leave_backend(cli);
+        backend_set_health(backend, false);
+        if((wsb.backend_nb == 1) || !backend_any_healthy())
+            return 1;
+    }
+
+    if(set_client_remote_fd(cli, remote_fd) != 0)
+        return 1;
+    cli->tcp_events = connected ? EPOLLIN : EPOLLOUT;
+    if(reactor_ctl(EPOLL_CTL_ADD, remote_fd, cli->tcp_events) != 0)
+        return 1;
+    cli->state = connected ? CLIENT_STATE_CONNECTED : CLIENT_STATE_CONNECTING;
+    return 0;
+}
+
+/* Send the rest of the file requested with plain HTTP, return 1 if the client must be dropped */
+static int http_send_file(t_client *cli)
+{
+    ssize_t n;
+
+    // The kernel copies the file pages to the socket, until the socket buffer is full
+    while(cli->file_offset < cli->file_end)
+    {
+        n = sendfile(cli->ws_fd, cli->file_fd, &cli->file_offset, cli->file_end - cli->file_offset);
+        if(n == -1)
+        {
+            if(errno == EAGAIN)
+            {
+                client_update_events(cli);
+                return 0;
+            }
+            printf("[%s:%d] Error : sendfile() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+            return 1;
+        }
+        // The file was truncated, the announced length can't be sent
+        if(n == 0)
+            return 1;
+    }
+
+    close(cli->file_fd);
+    cli->file_fd = -1;
+    cli->state = CLIENT_STATE_HANDSHAKE;
+    client_update_events(cli);
+    return 0;
+}
+
+/* Open a docroot file, or its precompressed variant if the client accepts it. Return the file descriptor, -1 if there is no such file */
+static int http_open_file(const char *path, bool accept_gzip, struct stat *st, bool *gzip)
+{
+    int fd, gz_fd;
+    char gz_path[HTTP_MAX_PATH + 4];
+    struct stat gz_st;
+
+    *gzip = false;
+    fd = openat(wsb.docroot_fd, path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+        return -1;
+    if((fstat(fd, st) != 0) || !S_ISREG(st->st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+    if(!accept_gzip)
+        return fd;
+
+    // A variant older than the file is stale
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+    gz_fd = openat(wsb.docroot_fd, gz_path, O_RDONLY | O_CLOEXEC);
+    if(gz_fd == -1)
+        return fd;
+    if((fstat(gz_fd, &gz_st) != 0) || !S_ISREG(gz_st.st_mode) || (gz_st.st_mtime < st->st_mtime))
+    {
+        close(gz_fd);
+        return fd;
+    }
+
+    close(fd);
+    *st = gz_st;
+    *gzip = true;
+    return gz_fd;
+}
+
+/* Convert the request URI to a docroot relative path, return 1 if it can't be served */
+static int http_uri_to_path(const t_websocket_request *request, char *path)
+{
+    unsigned int len = 0;
+
+    // The query string is not used
+    while((len < request->uri_length) && (request->uri[len] != '?') && (request->uri[len] != '#'))
+        len++;
+    if((len == 0) || (len > HTTP_MAX_PATH) || (request->uri[0] != '/') || (memchr(request->uri, '\0', len) != NULL))
+        return 1;
+
+    if(len == 1)
+    {
+        strcpy(path, HTTP_DEFAULT_FILE);
+        return 0;
     }
+    memcpy(path, request->uri + 1, len - 1);
+    path[len - 1] = '\0';
+
+    // Nothing outside the docroot can be reached
+    if((path[0] == '/') || (strstr(path, "..") != NULL))
+        return 1;
+    return 0;
+}
 
-    if((listen(bridge_sockfd, MAX_BRIDGE_CONNECTIONS)) != 0)
+/* Answer a plain HTTP request with a docroot file, the connection is kept for the next request. Return 1 if the client must be dropped */
+static int http_request(t_client *cli, const t_websocket_request *request, unsigned int request_len)
+{
+    char path[HTTP_MAX_PATH + 1], etag[64], header[512];
+    const t_mime_type *mime;
+    const char *extension;
+    struct stat st;
+    bool head, gzip;
+    int fd = -1, ret, len;
+
+    head = (request->method_length == 4) && (memcmp(request->method, "HEAD", 4) == 0);
+    if(!head && !((request->method_length == 3) && (memcmp(request->method, "GET", 3) == 0)))
+        len = snprintf(header, sizeof(header), "HTTP/1.1 405 Method Not Allowed\r\nServer: ws-bridge\r\nAllow: GET, HEAD\r\nContent-Length: 0\r\n\r\n");
+    else if((http_uri_to_path(request, path) != 0) || ((fd = http_open_file(path, request->accept_gzip, &st, &gzip)) == -1))
+        len = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nServer: ws-bridge\r\nContent-Length: 0\r\n\r\n");
+    else
     {
-        printf("[%s:%d] Error : listen() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        extension = strrchr(path, '.');
+        for(mime = mime_types; mime->extension != NULL; mime++)
+            if((extension != NULL) && (strcmp(extension, mime->extension) == 0))
+                break;
+
+        // The ETag changes with the file, and differs for the compressed variant
+        snprintf(etag, sizeof(etag), "\"%llx-%llx%s\"", (unsigned long long) st.st_mtime, (unsigned long long) st.st_size, gzip ? "-gz" : "");
+        if((request->if_none_match != NULL) && (memmem(request->if_none_match, request->if_none_match_length, etag, strlen(etag)) != NULL))
+        {
+            len = snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nServer: ws-bridge\r\nETag: %s\r\nCache-Control: %s\r\nVary: Accept-Encoding\r\n\r\n",
+                etag, mime->cache_control);
+            head = true;
+        }
+        else
+            len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nServer: ws-bridge\r\nContent-Type: %s\r\nContent-Length: %llu\r\nETag: %s\r\nCache-Control: %s\r\nVary: Accept-Encoding\r\n%s\r\n",
+                mime->content_type, (unsigned long long) st.st_size, etag, mime->cache_control, gzip ? "Content-Encoding: gzip\r\n" : "");
+
+        // The file is sent after its headers
+        if(!head && (st.st_size > 0))
+        {
+            cli->file_fd = fd;
+            cli->file_offset = 0;
+            cli->file_end = st.st_size;
+            cli->state = CLIENT_STATE_HTTP;
+            fd = -1;
+        }
+    }
+    if(fd != -1)
+        close(fd);
+
+    ret = client_send(cli, true, NULL, 0, (unsigned char *) header, len);
+
+    // Keep the requests the client sent after this one
+    cli->handshake_len -= request_len;
+    memmove(cli->handshake, cli->handshake + request_len, cli->handshake_len);
+    cli->handshake[cli->handshake_len] = '\0';
+
+    if(ret != 0)
+        return 1;
+    if((cli->state == CLIENT_STATE_HTTP) && (cli->ws_out.len == 0))
+        return http_send_file(cli);
+    client_update_events(cli);
+    return 0;
+}
+
+/* Handle the complete requests received on a new connection : plain HTTP ones when a docroot is set (-d), then the WebSocket upgrade one.
+ * Only the bytes from scan are searched for the end of the request. Return 1 if the client must be dropped */
+static int request_process(t_client *cli, unsigned int scan)
+{
+    int n;
+    char response[1024];
+    char *end;
+    t_websocket_request request;
+
+    while(1)
+    {
+        // Wait for the end of the request headers
+        end = memmem(cli->handshake + scan, cli->handshake_len - scan, "\r\n\r\n", 4);
+        if(end == NULL)
+        {
+            if(cli->handshake_len < sizeof(cli->handshake) - 1)
+                return 0;
+
+            // Tell the client why, then close the connection once the response is sent
+            printf("[%s:%d] Error : the request headers are too long.\n", __FUNCTION__, __LINE__);
+            n = snprintf(response, sizeof(response), "HTTP/1.1 431 Request Header Fields Too Large\r\nServer: ws-bridge\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            if((client_send(cli, true, NULL, 0, (unsigned char *) response, n) != 0) || (cli->ws_out.len == 0))
+                return 1;
+            cli->state = CLIENT_STATE_CLOSING;
+            client_update_events(cli);
+            return 0;
+        }
+        end += 4;
+        DBG_STR(cli->handshake);
+
+        // The headers are parsed in a single pass, the request fields point into the handshake buffer
+        if(WEBSOCKET_parse_request(cli->handshake, end - cli->handshake, &request) != 0)
+        {
+            printf("[%s:%d] Error : malformed Websocket upgrade request.\n", __FUNCTION__, __LINE__);
+            goto err;
+        }
+
+        if(WEBSOCKET_valid_connection(&request) || (wsb.docroot_fd == -1))
+            break;
+
+        // A file of the web client is requested, the next request is handled once it is sent
+        if(http_request(cli, &request, end - cli->handshake) != 0)
+            return 1;
+        if(cli->state != CLIENT_STATE_HANDSHAKE)
+            return 0;
+        scan = 0;
+    }
+
+    if(request.version != 13)
+    {
+        printf("[%s:%d] Error : unsupported Websocket client version.\n", __FUNCTION__, __LINE__);
+        goto err;
+    }
+
+    if(!WEBSOCKET_valid_connection(&request))
+    {
+        printf("[%s:%d] Error : not valid Websocket connection.\n", __FUNCTION__, __LINE__);
+        goto err;
+    }
+
+    // Calculate response handshake
+    n = WEBSOCKET_generate_handshake(&request, response, sizeof(response));
+    if(n < 0)
+    {
+        printf("[%s:%d] Error : generate Websocket handshake failed.\n", __FUNCTION__, __LINE__);
+        goto err;
+    }
+
+    // Send handshake response
+    if(client_send(cli, true, NULL, 0, (unsigned char *) response, n) != 0)
         return 1;
+
+    // No we can connect the client to the remote server
+    if(wsb.mux)
+    {
+        if(link_open_channel(cli) != 0)
+            goto err;
+        cli->state = CLIENT_STATE_CONNECTED;
     }
+    else if(client_connect(cli) != 0)
+        goto err;
+    pool_refill();
 
-    // register signal handler
-    signal(SIGINT, intHandler);
+    // The client may have sent frames right after its request
+    return websocket_relay(cli, (unsigned char *) end, cli->handshake_len - (end - cli->handshake));
+
+err:
+    // Close connection
+    return client_close(cli);
+}
+
+/* Read the requests of a new connection, return 1 if the client must be dropped */
+static int websocket_handshake(t_client *cli)
+{
+    int n;
+    unsigned int scan;
+
+    n = read(cli->ws_fd, cli->handshake + cli->handshake_len, sizeof(cli->handshake) - 1 - cli->handshake_len);
+    if((n == -1) && (errno == EAGAIN))
+        return 0;
+    if(n <= 0)
+        return 1;
+
+    // Only the new bytes (and the 3 before, in case the end marker is split) are scanned
+    scan = (cli->handshake_len > 3) ? cli->handshake_len - 3 : 0;
+    cli->handshake_len += n;
+    cli->handshake[cli->handshake_len] = '\0';
+    return request_process(cli, scan);
+}
+
+/* WebSocket client socket event, return 1 if the client must be dropped */
+static int websocket_event(t_client *cli, unsigned int events)
+{
+    int rd_bytes;
+    char client_ws_msg[4096];
+
+    // Send the queued data, the remote server socket is read again when enough was sent
+    if(events & EPOLLOUT)
+    {
+        if(queue_send(cli->ws_fd, &cli->ws_out) != 0)
+            return 1;
+
+        // A requested file is sent once its headers are, then the next request can be handled
+        if((cli->state == CLIENT_STATE_HTTP) && (cli->ws_out.len == 0))
+        {
+            if(http_send_file(cli) != 0)
+                return 1;
+            if((cli->state == CLIENT_STATE_HANDSHAKE) && (cli->handshake_len > 0) && (request_process(cli, 0) != 0))
+                return 1;
+        }
+        // A closing client is deleted once everything was sent
+        if((cli->state == CLIENT_STATE_CLOSING) && (cli->ws_out.len == 0))
+            return 1;
+        client_update_events(cli);
+    }
+    if(!(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        return 0;
+    if((cli->state == CLIENT_STATE_HTTP) || (cli->state == CLIENT_STATE_CLOSING))
+        return 1; // Only errors are watched while a file or the last data is sent
+
+    if(cli->state == CLIENT_STATE_HANDSHAKE)
+        return websocket_handshake(cli);
+
+    // Receive Ws frames from client, they can be split or coalesced in any way
+    rd_bytes = server_read(cli->ws_fd, client_ws_msg, sizeof(client_ws_msg));
+    if((rd_bytes < 0) && (errno == EAGAIN))
+        return 0;
 
-    // Start thread to handle websocket client msg
-    if(pthread_create(&ws_thread , NULL, websocket_thread_handler, NULL) < 0)
+    // read error, drop the client to avoid being woken up again for the same error
+    if(rd_bytes < 0)
     {
-        printf("[%s:%d] Error : pthread_create() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        printf("[%s:%d] Error : read failed - do not process.\n", __FUNCTION__, __LINE__);
         return 1;
     }
-    printf("[%s:%d] Info : WebSocket thread created.\n", __FUNCTION__, __LINE__);
 
-    // Start thread to handle remote server msg
-    if(pthread_create(&tcp_thread , NULL, remote_server_thread_handler, NULL) < 0)
+    // client disconnected
+    if(rd_bytes == 0)
+        return 1;
+
+    return websocket_relay(cli, (unsigned char *) client_ws_msg, rd_bytes);
+}
+
+/* Remote server connection is done, return 1 if the client must be dropped */
+static int remote_server_connected(t_client *cli)
+{
+    int ret;
+
+    ret = check_remote_server_connection(cli->tcp_fd);
+    if(ret == 2)
+        return 0;
+    if(ret != 0)
     {
-        printf("[%s:%d] Error : pthread_create() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        // Nothing was sent yet, so another remote server can take the client with the data it has queued
+        backend_set_health(cli->backend, false);
+        client_leave_backend(cli);
+        if((wsb.backend_nb == 1) || !backend_any_healthy() || (client_connect(cli) != 0))
+        {
+            return client_close(cli);
+        }
+        if(cli->state == CLIENT_STATE_CONNECTING)
+            return 0;
+    }
+    else
+        backend_set_health(cli->backend, true);
+    cli->state = CLIENT_STATE_CONNECTED;
+
+    // Forward what the client sent in the meantime
+    if(queue_send(cli->tcp_fd, &cli->tcp_out) != 0)
         return 1;
+    client_update_events(cli);
+
+    return 0;
+}
+
+/* Remote server socket event, return 1 if the client must be dropped */
+static int remote_server_event(t_client *cli, unsigned int events)
+{
+    int rd_bytes;
+
+    if(cli->state == CLIENT_STATE_CONNECTING)
+        return remote_server_connected(cli);
+
+    // Send the queued data, the WebSocket socket is read again when enough was sent
+    if(events & EPOLLOUT)
+    {
+        if(queue_send(cli->tcp_fd, &cli->tcp_out) != 0)
+            return 1;
+        client_update_events(cli);
+    }
+    if(!(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        return 0;
+
+    // A paused socket is not read, but epoll keeps reporting its errors : release the server now, the queued data and the close frame are still sent
+    if(cli->tcp_paused && (events & (EPOLLERR | EPOLLHUP)))
+    {
+        if(upstream_flush(cli) != 0)
+            return 1;
+        return client_close(cli);
+    }
+
+    // Drain the socket, the data is sent in a single frame later. Stop when the client does not read fast enough, so the server feels it.
+    while(!cli->tcp_paused)
+    {
+        if(upstream_make_room(cli) != 0)
+            return 1;
+        rd_bytes = read(cli->tcp_fd, cli->upstream + cli->upstream_len, sizeof(cli->upstream) - cli->upstream_len);
+
+        // Everything has been received, the socket is non-blocking
+        if((rd_bytes < 0) && (errno == EAGAIN))
+            break;
+
+        // read error, drop the client to avoid being woken up again for the same error
+        if(rd_bytes < 0)
+        {
+            printf("[%s:%d] Error : read failed - do not process.\n", __FUNCTION__, __LINE__);
+            return 1;
+        }
+
+        if(rd_bytes == 0)
+        {
+            // Server disconnected => send its last commands and conn close msg to Websocket client
+            if(upstream_flush(cli) != 0)
+                return 1;
+            return client_close(cli);
+        }
+        cli->upstream_len += rd_bytes;
     }
-    printf("[%s:%d] Info : Remote server thread created.\n", __FUNCTION__, __LINE__);
 
-    // Loop : wait for clients
+    upstream_queue(cli);
+    return 0;
+}
+
+/* Reactor loop : wait for and dispatch all socket events */
+static void server_run(int bridge_sockfd)
+{
+    int i, num_events, fd, drop, accept_pending;
+    struct epoll_event events[MAX_REACTOR_EVENTS];
+    t_client *cli;
+
     while(!dead)
     {
-        server_wait_client(bridge_sockfd);
+        // Sleep until a socket is ready, no timeout needed
+        num_events = epoll_wait(wsb.epoll_fd, events, MAX_REACTOR_EVENTS, -1);
+        if(metrics_requested)
+        {
+            metrics_requested = 0;
+            print_metrics();
+        }
+        if(num_events == -1)
+        {
+            if(errno != EINTR)
+                printf("[%s:%d] Error : epoll_wait() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+            continue;
+        }
+
+        accept_pending = 0;
+        for(i=0; i<num_events; i++)
+        {
+            fd = events[i].data.fd;
+
+            if(fd == bridge_sockfd)
+            {
+                accept_pending = 1;
+                continue;
+            }
+
+            if((fd == wsb.link_fd) && (fd != -1))
+            {
+                link_event(events[i].events);
+                continue;
+            }
+
+            if((fd == wsb.ring_event_fd) && (fd != -1))
+            {
+                ring_event();
+                continue;
+            }
+
+            if((fd == wsb.coalesce_timer_fd) && (fd != -1))
+            {
+                coalesce_timer_event();
+                continue;
+            }
+
+            if((fd == wsb.health_timer_fd) && (fd != -1))
+            {
+                health_check_start();
+                continue;
+            }
+
+            // The client may have been dropped by a previous event of this batch
+            cli = find_client(fd);
+            if(cli == NULL)
+            {
+                if(!health_check_event(fd))
+                    pool_event(fd);
+                continue;
+            }
+
+            if(fd == cli->ws_fd)
+                drop = websocket_event(cli, events[i].events);
+            else
+                drop = remote_server_event(cli, events[i].events);
+
+            if(drop)
+                delete_client(cli);
+        }
+
+        // Accept after the batch, so a fd closed by this batch can't be reused while stale events still refer to it
+        if(accept_pending)
+            server_accept_clients(bridge_sockfd);
+
+        // Send everything the batch produced for the remote server at once
+        if(wsb.link_fd != -1)
+            link_flush();
+
+        // Send everything the batch received from the remote server, one frame per client
+        if(wsb.coalesce_timer_fd == -1)
+            upstream_flush_queue();
+    }
+}
+
+
+static void usage(const char *program)
+{
+    printf("Usage : %s [-c max_connections] [-p pool_size] [-m] [-u remote_unix_socket [-s]] [-w window] [-d docroot] [-g lobby_size] local_port [remote_ip remote_port ...]\n", program);
+    printf("  -c max_connections : max number of simultaneous clients (default %d)\n", DEFAULT_MAX_BRIDGE_CONNECTIONS);
+    printf("  -p pool_size : number of connections opened in advance to each remote server (default 0, max %d)\n", MAX_POOL_SIZE);
+    printf("  -m : share a single multiplexed link to the remote server between all clients (-p is ignored, needs a single remote server)\n");
+    printf("  -u remote_unix_socket : connect to the remote server Unix socket instead of remote_ip and remote_port\n");
+    printf("  -s : exchange the multiplexed link data through shared memory (needs -u, implies -m)\n");
+    printf("  -g lobby_size : send new clients to the same remote server until lobby_size of them are there, so its game can start (2 to %d), instead of the least loaded remote server\n", CONFIGURATION_MAXIMUM_PLAYERS_COUNT);
+    printf("  -d docroot : serve the files of this directory (the JsClient one) to plain HTTP requests on local_port\n");
+    printf("  -w window : milliseconds to wait for the rest of a server tick before sending its commands to a client (default 0, less than the %ld ms tick)\n", CONFIGURATION_GAME_TICK / 1000000);
+    printf("  Up to %d remote servers can be given, clients are spread over those answering the connect probes sent every %d s\n", MAX_BACKENDS, HEALTH_CHECK_PERIOD);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, bridge_sockfd;
+    unsigned int i;
+    int option_Value = 1;
+    int max_clients = DEFAULT_MAX_BRIDGE_CONNECTIONS;
+    int pool_size = 0;
+    const char *docroot = NULL;
+    struct sockaddr_in server;
+
+    // Check parameters
+    while((opt = getopt(argc, argv, "c:p:mu:sw:d:g:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                max_clients = atoi(optarg);
+                if(max_clients <= 0)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'p':
+                pool_size = atoi(optarg);
+                if((pool_size < 0) || (pool_size > MAX_POOL_SIZE))
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'm':
+                wsb.mux = true;
+                break;
+
+            case 'u':
+                wsb.remote_unix_path = optarg;
+                break;
+
+            case 's':
+                wsb.shm = true;
+                wsb.mux = true;
+                break;
+
+            case 'w':
+                // A window as long as the server tick would merge several ticks and only add latency
+                if((atoi(optarg) < 0) || (atoi(optarg) >= CONFIGURATION_GAME_TICK / 1000000))
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                wsb.coalesce_window = atoi(optarg);
+                break;
+
+            case 'd':
+                docroot = optarg;
+                break;
+
+            case 'g':
+                wsb.lobby_size = atoi(optarg);
+                if((wsb.lobby_size < 2) || (wsb.lobby_size > CONFIGURATION_MAXIMUM_PLAYERS_COUNT))
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    // local_port, then the remote servers address and port
+    wsb.backend_nb = (wsb.remote_unix_path != NULL) ? 1 : (argc - optind - 1) / 2;
+    if((wsb.remote_unix_path != NULL) ? (argc - optind != 1) : ((argc - optind < 3) || ((argc - optind) % 2 == 0)))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if((wsb.backend_nb > MAX_BACKENDS) || (wsb.mux && (wsb.backend_nb > 1)) || (wsb.shm && (wsb.remote_unix_path == NULL)))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Init Server struct, clear all fds
+    if(connection_table_init(max_clients) != 0)
+        return EXIT_FAILURE;
+
+    // Files are opened relative to the docroot, so it can't be changed while the bridge runs
+    wsb.docroot_fd = -1;
+    if(docroot != NULL)
+    {
+        wsb.docroot_fd = open(docroot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(wsb.docroot_fd == -1)
+        {
+            printf("[%s:%d] Error : failed to open the docroot %s (%s).\n", __FUNCTION__, __LINE__, docroot, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Remote TCP servers to connect
+    for(i=0; i<wsb.backend_nb; i++)
+    {
+        if(wsb.remote_unix_path == NULL)
+        {
+            wsb.backends[i].ip = argv[optind + 1 + i * 2];
+            wsb.backends[i].port = argv[optind + 2 + i * 2];
+        }
+        if(resolve_remote_server(&wsb.backends[i]) != 0)
+            return EXIT_FAILURE;
+        wsb.backends[i].healthy = true;
+        wsb.backends[i].probe_fd = -1;
+    }
+    wsb.lobby_backend = -1;
+
+    // Create TCP socket dedicated to the bridge server, the reactor accepts clients until the backlog is empty
+    bridge_sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(bridge_sockfd < 0)
+    {
+        printf("[%s:%d] Error : failed to create the socket server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
+    }
+
+    // Make the socket instantly reusable
+    if(setsockopt(bridge_sockfd, SOL_SOCKET, SO_REUSEADDR, &option_Value, sizeof(option_Value)) == -1)
+    {
+        printf("[%s:%d] Error : failed to set the server socket as reusable (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
+    }
+
+    // Try to bind the server
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(atoi(argv[optind]));
+
+    if(bind(bridge_sockfd, (const struct sockaddr *) &server, sizeof(server)) != 0)
+    {
+        printf("[%s:%d] Error : failed to bind the server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        close(bridge_sockfd);
+        return 1;
     }
 
-    // Waiting thread terminating
-    if(pthread_join(tcp_thread, NULL) != 0)
+    if((listen(bridge_sockfd, SOMAXCONN)) != 0)
     {
-        printf("[%s:%d] Error : pthread_join() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        printf("[%s:%d] Error : listen() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
         return 1;
     }
 
-    if(pthread_join(ws_thread, NULL) != 0)
+    // register signal handlers, SIGUSR1 prints the queues metrics
+    signal(SIGINT, intHandler);
+    signal(SIGUSR1, metricsHandler);
+    signal(SIGPIPE, SIG_IGN); // Write errors are handled where they happen
+
+    // Create the reactor
+    wsb.epoll_fd = epoll_create1(0);
+    if(wsb.epoll_fd == -1)
     {
-        printf("[%s:%d] Error : pthread_join() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        printf("[%s:%d] Error : epoll_create1() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+        return 1;
+    }
+
+    if(reactor_add(bridge_sockfd) != 0)
         return 1;
+
+    // The coalescing window timer is armed by the first data of a server tick
+    wsb.coalesce_timer_fd = -1;
+    if(wsb.coalesce_window > 0)
+    {
+        wsb.coalesce_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if((wsb.coalesce_timer_fd == -1) || (reactor_add(wsb.coalesce_timer_fd) != 0))
+        {
+            printf("[%s:%d] Error : failed to create the coalescing window timer (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+            return 1;
+        }
+    }
+
+    // Probe the remote servers, so that clients are only sent to those answering
+    wsb.health_timer_fd = -1;
+    if(wsb.backend_nb > 1)
+    {
+        struct itimerspec period = { { HEALTH_CHECK_PERIOD, 0 }, { HEALTH_CHECK_PERIOD, 0 } };
+
+        wsb.health_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if((wsb.health_timer_fd == -1) || (timerfd_settime(wsb.health_timer_fd, 0, &period, NULL) != 0) || (reactor_add(wsb.health_timer_fd) != 0))
+        {
+            printf("[%s:%d] Error : failed to create the health check timer (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+            return 1;
+        }
+    }
+
+    // Connect the pool sockets or the multiplexed link
+    wsb.pool_nb = 0;
+    wsb.link_fd = -1;
+    wsb.ring_event_fd = -1;
+    if(wsb.mux)
+    {
+        wsb.channels = calloc(LINK_CHANNELS, sizeof(t_client *));
+        if(wsb.channels == NULL)
+        {
+            printf("[%s:%d] Error : failed to allocate the channels table.\n", __FUNCTION__, __LINE__);
+            return 1;
+        }
+        link_connect();
     }
+    else
+    {
+        wsb.pool_size = pool_size;
+        pool_refill();
+    }
+
+    // Loop : relay all clients
+    server_run(bridge_sockfd);
+
+    close(wsb.epoll_fd);
 
     // Close the program server socket
     if(close(bridge_sockfd) != 0){
@@ -7,18 +7,42 @@ var canvas;
 /* tile set png */
 var tile_set;
 
+/* offscreen canvas with the ground and the walls, the other tiles are drawn on top */
+var background_layer;
+var background_ctx;
+
 /* client command definition */
 var action_type = {
     ACTION_DISPLAY_TILE : 0x0,
-    ACTION_DISPLAY_STR  : 0x1
+    ACTION_DISPLAY_STR  : 0x1,
+    ACTION_LOAD_MAP     : 0x5,
+    ACTION_ACKNOWLEDGE_INPUT : 0x6
 };
 
 /* server command definition */
 var command_type = {
     COMMAND_CONNECT : 0x2,
-    COMMAND_INPUT   : 0x3
+    COMMAND_INPUT   : 0x3,
+    COMMAND_CONNECT_WITH_CAPABILITIES : 0x4
 };
 
+/* client capabilities */
+var CAPABILITY_MAP_CACHE = 0x1;
+var CAPABILITY_INPUT_SEQUENCE = 0x2;
+
+/* map pack, must be in the same order than the server CONFIGURATION_MAP_FILE_NAMES */
+var MAP_ROWS = 15;
+var MAP_COLUMNS = 20;
+var map_file_names = ["test.txt", "test2.txt"];
+var map_pack = [];
+
+/* load map action size : command, map id, 32-bit hash, obstacles bitmap */
+var ACTION_LOAD_MAP_SIZE = 2 + 4 + Math.ceil(MAP_ROWS * MAP_COLUMNS / 8);
+
+/* acknowledge input action size : command, input sequence number, player row and column */
+var ACTION_ACKNOWLEDGE_INPUT_SIZE = 4;
+var NOT_ON_MAP = 0xFF;
+
 /* tile item coordonates */
 var tile_xy = {
     TILE_ID_GROUND : {x: 192, y: 0},
@@ -34,6 +58,17 @@ var tile_xy = {
     TILE_ITEM_POWER_UP_BOMBS_COUNT : {x: 0, y: 32}
 };
 
+/* tile_xy in tile id order, x then y of each tile, so drawing a tile needs no lookup by name */
+var tile_coordinates = new Uint16Array(2 * Object.keys(tile_xy).length);
+
+function tile_coordinates_update() {
+    Object.keys(tile_xy).forEach(function (name, tid) {
+        tile_coordinates[2 * tid] = tile_xy[name].x;
+        tile_coordinates[2 * tid + 1] = tile_xy[name].y;
+    });
+}
+tile_coordinates_update();
+
 /* Keyboard input value */
 var kbd = {
     UP : 0x1,
@@ -42,6 +77,51 @@ var kbd = {
     RIGHT : 0x4,
     SPACE : 0x5,
     ESCAPE : 0x6,
+    REQUEST_MAP : 0x7
+};
+
+/* tiles used by the rendering and the move prediction, see the server TGameTileID */
+var TILE_GROUND = 0;
+var TILE_WALL = 1;
+var TILE_OBSTACLE = 2;
+var TILE_CURRENT_PLAYER = 3;
+var TILE_OTHER_PLAYER = 4;
+var TILE_BOMB = 5;
+var TILE_SHIELD = 7;
+
+/* what is drawn on top of a cell background */
+var OVERLAY_OTHER_PLAYER = 0x1;
+var OVERLAY_SHIELD = 0x2;
+
+/* map as drawn by the server without the own player, the changed cells are drawn once per animation frame */
+var map_state = {
+    tiles : new Uint8Array(MAP_ROWS * MAP_COLUMNS),
+    overlays : new Uint8Array(MAP_ROWS * MAP_COLUMNS), // OVERLAY_* drawn on top of the tile
+    layer : new Uint8Array(MAP_ROWS * MAP_COLUMNS).fill(0xFF), // tile on the background layer, 0xFF if not drawn yet
+    dirty : new Uint8Array(MAP_ROWS * MAP_COLUMNS),
+    dirty_cells : new Uint16Array(MAP_ROWS * MAP_COLUMNS),
+    dirty_count : 0,
+    frame_requested : false
+};
+
+/* inputs sent but not acknowledged yet, the server handles one per tick */
+var PENDING_INPUTS_SIZE = 64;
+
+/* own player move prediction, the server acknowledges the inputs with the player location */
+var prediction = {
+    server_row : -1, // -1 when the player is not on the map
+    server_column : 0,
+    shield : false,
+    shown_row : -1, // where the player is drawn, -1 when not drawn
+    shown_column : 0,
+    last_tile_player : false, // a shield drawn right after the player is the player one
+    next_sequence : 1, // the server acknowledges 0 before it received any input
+    pending_sequences : new Uint8Array(PENDING_INPUTS_SIZE), // inputs not acknowledged yet, in a ring
+    pending_codes : new Uint8Array(PENDING_INPUTS_SIZE),
+    pending_first : 0,
+    pending_count : 0,
+    predicted_row : -1, // result of predict_location()
+    predicted_column : 0
 };
 
 window.onload = function() {
@@ -61,7 +141,184 @@ window.onload = function() {
     tile_set = new Image();
     tile_set.src = "sprites/tile.png"
 
+    background_layer = document.createElement('canvas');
+    background_layer.width = canvas.width;
+    background_layer.height = canvas.height;
+    background_ctx = background_layer.getContext('2d');
+
+    // The page is served by ws-bridge (-d), which also accepts the game connection
+    if (location.protocol == "http:") {
+        var form = document.getElementById("bbb_settings");
+        form.server_ip.value = location.hostname;
+        form.server_port.value = location.port || "80";
+    }
+
     document.addEventListener('keydown', keyboard_event);
+
+    load_map_pack();
+}
+
+/* same hash than the server : FNV-1a of every cell character */
+function map_hash(cells) {
+    var hash = 0x811c9dc5;
+    for (var i = 0; i < cells.length; i++) {
+        hash = Math.imul(hash ^ cells.charCodeAt(i), 16777619) >>> 0;
+    }
+    return hash;
+}
+
+function load_map_pack() {
+    map_file_names.forEach(function (file_name, id) {
+        var request = new XMLHttpRequest();
+        request.onload = function () {
+            if (request.status != 200)
+                return;
+            var cells = request.responseText.replace(/\n/g, "");
+            if (cells.length < MAP_ROWS * MAP_COLUMNS)
+                return;
+            cells = cells.substring(0, MAP_ROWS * MAP_COLUMNS);
+            var walls = new Uint8Array(MAP_ROWS * MAP_COLUMNS);
+            for (var cell = 0; cell < walls.length; cell++)
+                walls[cell] = (cells[cell] == 'W') ? 1 : 0;
+            map_pack[id] = {hash: map_hash(cells), walls: walls};
+        };
+        request.open("GET", "maps/" + file_name);
+        request.send();
+    });
+}
+
+function map_load(data, view, i) {
+    var id = data[i+1];
+    var hash = view.getUint32(i+2); // big endian
+    var bitmap = i + 6;
+    var map = map_pack[id];
+
+    // unknown or modified map : ask the server for every tile
+    if (!map || map.hash != hash) {
+        send_kbd_msg(kbd.REQUEST_MAP);
+        return;
+    }
+
+    for (var row = 0, cell = 0; row < MAP_ROWS; row++) {
+        for (var column = 0; column < MAP_COLUMNS; column++, cell++) {
+            var tid = 0;
+            if (map.walls[cell])
+                tid = 1;
+            else if (data[bitmap + (cell >> 3)] & (1 << (cell & 7)))
+                tid = 2;
+            canvas_set_tile(tid, row, column);
+        }
+    }
+}
+
+/* same rules than the server GameIsPlayerMoveAllowed() */
+function predict_is_move_allowed(row, column) {
+    if (row < 0 || row >= MAP_ROWS || column < 0 || column >= MAP_COLUMNS)
+        return false;
+    var tid = map_state.tiles[row * MAP_COLUMNS + column];
+    return tid != TILE_WALL && tid != TILE_OBSTACLE && tid != TILE_BOMB;
+}
+
+/* replay the inputs not acknowledged yet from the server location */
+function predict_location() {
+    var row = prediction.server_row;
+    var column = prediction.server_column;
+
+    for (var i = 0; row >= 0 && i < prediction.pending_count; i++) {
+        var code = prediction.pending_codes[(prediction.pending_first + i) % PENDING_INPUTS_SIZE];
+        var next_row = row, next_column = column;
+        if (code == kbd.UP)
+            next_row--;
+        else if (code == kbd.DOWN)
+            next_row++;
+        else if (code == kbd.LEFT)
+            next_column--;
+        else if (code == kbd.RIGHT)
+            next_column++;
+        else
+            continue;
+        if (predict_is_move_allowed(next_row, next_column)) {
+            row = next_row;
+            column = next_column;
+        }
+    }
+    prediction.predicted_row = row;
+    prediction.predicted_column = column;
+}
+
+/* get the sequence number of a sent input, and predict the move */
+function predict_input(code) {
+    var sequence = prediction.next_sequence;
+    prediction.next_sequence = (sequence + 1) & 0xFF;
+
+    // only the moves of a player on the map are predicted
+    if (prediction.server_row < 0)
+        return sequence;
+
+    // the oldest input is lost, the server location will be right at the next acknowledge
+    if (prediction.pending_count == PENDING_INPUTS_SIZE) {
+        prediction.pending_first = (prediction.pending_first + 1) % PENDING_INPUTS_SIZE;
+        prediction.pending_count--;
+    }
+    var index = (prediction.pending_first + prediction.pending_count) % PENDING_INPUTS_SIZE;
+    prediction.pending_sequences[index] = sequence;
+    prediction.pending_codes[index] = code;
+    prediction.pending_count++;
+    return sequence;
+}
+
+/* catch the own player tiles, return false if the tile is not a map one */
+function predict_tile(tid) {
+    // the player is drawn at the predicted location
+    if (tid == TILE_CURRENT_PLAYER) {
+        prediction.last_tile_player = true;
+        prediction.shield = false;
+        predict_set_player_dirty();
+        return false;
+    }
+    if (tid == TILE_SHIELD && prediction.last_tile_player) {
+        prediction.last_tile_player = false;
+        prediction.shield = true;
+        predict_set_player_dirty();
+        return false;
+    }
+    prediction.last_tile_player = false;
+    return true;
+}
+
+function predict_set_player_dirty() {
+    if (prediction.shown_row >= 0)
+        canvas_set_dirty(prediction.shown_row * MAP_COLUMNS + prediction.shown_column);
+}
+
+function predict_acknowledge(sequence, row, column) {
+    // the server processed the inputs up to this one (sequence numbers wrap)
+    while (prediction.pending_count > 0 && ((sequence - prediction.pending_sequences[prediction.pending_first]) & 0xFF) < 128) {
+        prediction.pending_first = (prediction.pending_first + 1) % PENDING_INPUTS_SIZE;
+        prediction.pending_count--;
+    }
+
+    if (row == NOT_ON_MAP || row >= MAP_ROWS || column >= MAP_COLUMNS) {
+        prediction.server_row = -1;
+        prediction.pending_count = 0;
+        return;
+    }
+    prediction.server_row = row;
+    prediction.server_column = column;
+}
+
+/* move the player where the inputs sent move it, or back where the server says it is */
+function predict_update() {
+    predict_location();
+    var row = prediction.predicted_row, column = prediction.predicted_column;
+
+    if (row != prediction.shown_row || column != prediction.shown_column) {
+        // the cell left is drawn again as the server did, and the new one with the player
+        predict_set_player_dirty();
+        prediction.shown_row = row;
+        prediction.shown_column = column;
+        predict_set_player_dirty();
+    }
 }
 
 function bbb_console_log(str) {
@@ -71,17 +328,93 @@ function bbb_console_log(str) {
 }
 
 function canvas_print_tile(tid, x, y) {
-    var tile_x = tile_xy[Object.keys(tile_xy)[tid]].x;
-    var tile_y = tile_xy[Object.keys(tile_xy)[tid]].y;
+    var tile_x = tile_coordinates[2 * tid];
+    var tile_y = tile_coordinates[2 * tid + 1];
     //console.log("tile x=" + tile_x + " y=" + tile_y + " x=" + x +" y=" + y);
     ctx.drawImage(tile_set, tile_x, tile_y, 32, 32, x, y, 32, 32);
 }
 
+/* draw the changed cells at the next animation frame, whatever the number of messages received until then */
+function canvas_request_frame() {
+    if (map_state.frame_requested)
+        return;
+    map_state.frame_requested = true;
+    requestAnimationFrame(canvas_draw_frame);
+}
+
+function canvas_set_dirty(cell) {
+    if (!map_state.dirty[cell]) {
+        map_state.dirty[cell] = 1;
+        map_state.dirty_cells[map_state.dirty_count++] = cell;
+    }
+    canvas_request_frame();
+}
+
+/* keep track of a tile drawn by the server */
+function canvas_set_tile(tid, row, column) {
+    if (row >= MAP_ROWS || column >= MAP_COLUMNS)
+        return;
+    var cell = row * MAP_COLUMNS + column;
+
+    // the server draws the players and their shield over the cell content
+    if (tid == TILE_OTHER_PLAYER)
+        map_state.overlays[cell] |= OVERLAY_OTHER_PLAYER;
+    else if (tid == TILE_SHIELD)
+        map_state.overlays[cell] |= OVERLAY_SHIELD;
+    else {
+        map_state.tiles[cell] = tid;
+        map_state.overlays[cell] = 0;
+    }
+
+    // the walls only change with the map, they are drawn once on the background layer
+    var layer_tid = (tid == TILE_WALL) ? TILE_WALL : TILE_GROUND;
+    if (tid != TILE_OTHER_PLAYER && tid != TILE_SHIELD && map_state.layer[cell] != layer_tid && tile_set.complete) {
+        background_ctx.drawImage(tile_set, tile_coordinates[2 * layer_tid], tile_coordinates[2 * layer_tid + 1], 32, 32,
+                                 column * 32, row * 32, 32, 32);
+        map_state.layer[cell] = layer_tid;
+    }
+
+    canvas_set_dirty(cell);
+}
+
+function canvas_draw_cell(cell) {
+    var row = Math.floor(cell / MAP_COLUMNS), column = cell % MAP_COLUMNS;
+    var x = column * 32, y = row * 32;
+    var tid = map_state.tiles[cell];
+
+    ctx.drawImage(background_layer, x, y, 32, 32, x, y, 32, 32);
+    if (tid != map_state.layer[cell])
+        canvas_print_tile(tid, x, y);
+    if (map_state.overlays[cell] & OVERLAY_OTHER_PLAYER)
+        canvas_print_tile(TILE_OTHER_PLAYER, x, y);
+    if (map_state.overlays[cell] & OVERLAY_SHIELD)
+        canvas_print_tile(TILE_SHIELD, x, y);
+
+    if (row == prediction.shown_row && column == prediction.shown_column) {
+        canvas_print_tile(TILE_CURRENT_PLAYER, x, y);
+        if (prediction.shield)
+            canvas_print_tile(TILE_SHIELD, x, y);
+    }
+}
+
+function canvas_draw_frame() {
+    predict_update();
+
+    for (var i = 0; i < map_state.dirty_count; i++) {
+        var cell = map_state.dirty_cells[i];
+        map_state.dirty[cell] = 0;
+        canvas_draw_cell(cell);
+    }
+    map_state.dirty_count = 0;
+    map_state.frame_requested = false;
+}
+
 function send_kbd_msg(code) {
     if (typeof ws != 'undefined') {
         if(ws.readyState == ws.OPEN) {
-            var command = String.fromCharCode(command_type.COMMAND_INPUT);
-            ws.send(command + String.fromCharCode(code) + '\0');
+            // the player move is predicted until the server acknowledges the input
+            ws.send(new Uint8Array([command_type.COMMAND_INPUT, code, predict_input(code)]));
+            canvas_request_frame();
         }
     }
 }
@@ -133,31 +466,42 @@ function server_connect() {
         tile_xy.TILE_ID_CURRENT_PLAYER.x = 0;
         tile_xy.TILE_ID_CURRENT_PLAYER.y = 0;
     }
+    tile_coordinates_update();
 
     bbb_console_log("Trying to connect to BomBerBox server.");
 
     ws = new WebSocket('ws://'+server+':'+port);
+    ws.binaryType = "arraybuffer";
     form.connect_btn.disabled = true;
 
 
     ws.onmessage = function (evt) {
+        // views on the received buffer, the commands are decoded in place
+        var data = new Uint8Array(evt.data);
+        var view = new DataView(evt.data);
         var i = 0;
-        do {
-            if (evt.data[i] == String.fromCharCode(action_type.ACTION_DISPLAY_STR)) {
-                bbb_console_log(evt.data.substring(i+2, i+2+evt.data.charCodeAt(i+1)));
-                i += evt.data.charCodeAt(i+1) + 2;
-            } else if(evt.data[i] == String.fromCharCode(action_type.ACTION_DISPLAY_TILE)) {
-                var tid = evt.data.charCodeAt(i+1);
-                var x = evt.data.charCodeAt(i+3) * 32;
-                var y = evt.data.charCodeAt(i+2) * 32;
+        while (i < data.length) {
+            if (data[i] == action_type.ACTION_DISPLAY_STR) {
+                bbb_console_log(String.fromCharCode.apply(null, data.subarray(i+2, i+2+data[i+1])));
+                i += data[i+1] + 2;
+            } else if(data[i] == action_type.ACTION_DISPLAY_TILE) {
+                if (predict_tile(data[i+1]))
+                    canvas_set_tile(data[i+1], data[i+2], data[i+3]);
                 i += 4;
-                canvas_print_tile(tid, x, y);
+            } else if(data[i] == action_type.ACTION_LOAD_MAP) {
+                map_load(data, view, i);
+                i += ACTION_LOAD_MAP_SIZE;
+            } else if(data[i] == action_type.ACTION_ACKNOWLEDGE_INPUT) {
+                predict_acknowledge(data[i+1], data[i+2], data[i+3]);
+                i += ACTION_ACKNOWLEDGE_INPUT_SIZE;
             } else {
                 // Bad message: check next byte
                 //console.log("bad msg!");
                 i++;
             }
-        } while (i < evt.data.length);
+        }
+        // the acknowledged player location is drawn with the next frame
+        canvas_request_frame();
     }
 
     ws.onerror = function () {
@@ -166,8 +510,15 @@ function server_connect() {
 
     ws.onopen = function () {
         //console.log("ws open!");
-        var command = String.fromCharCode(command_type.COMMAND_CONNECT);
-        ws.send(command + name + '\0');
+        var name_bytes = new TextEncoder().encode(name);
+        var message = new Uint8Array(2 + name_bytes.length);
+        // the player moves are predicted, and the server can send the map id instead of every tile
+        message[0] = command_type.COMMAND_CONNECT_WITH_CAPABILITIES;
+        message[1] = CAPABILITY_INPUT_SEQUENCE;
+        if (map_pack.length > 0)
+            message[1] |= CAPABILITY_MAP_CACHE;
+        message.set(name_bytes, 2);
+        ws.send(message);
     };
 
     ws.onclose = function (evt) {
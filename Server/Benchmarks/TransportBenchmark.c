@@ -0,0 +1,348 @@
+/** @file TransportBenchmark.c
+ * Compare the transports a bridge can use to relay the server commands : loopback TCP, Unix socket and shared memory rings signaled with eventfd.
+ * A child process echoes 'draw tile' commands, the relay latency is the round trip time and the CPU cost includes both processes.
+ * @author Adrien RICCIARDI
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <Ring.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many commands are relayed when no count is specified. */
+#define TRANSPORT_BENCHMARK_DEFAULT_MESSAGES_COUNT 100000
+
+/** A message has the size of a 'draw tile' command. */
+#define TRANSPORT_BENCHMARK_MESSAGE_SIZE 4
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** All benchmarked transports. */
+typedef enum
+{
+	TRANSPORT_BENCHMARK_TRANSPORT_TCP,
+	TRANSPORT_BENCHMARK_TRANSPORT_UNIX_SOCKET,
+	TRANSPORT_BENCHMARK_TRANSPORT_SHARED_MEMORY,
+	TRANSPORT_BENCHMARK_TRANSPORTS_COUNT
+} TTransportBenchmarkTransport;
+
+/** The endpoints of a transport (the bridge uses the first ones, the echoing server the second ones). */
+typedef struct
+{
+	int Sockets[2]; //!< The connected sockets.
+	TRingPair *Pointer_Ring_Pair; //!< The rings, shared by both processes.
+	int Event_File_Descriptors[2]; //!< Written to wake the bridge up (first one) or the server up (second one).
+} TTransportBenchmarkEndpoints;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The transports name. */
+static char *String_Transport_Benchmark_Transport_Names[TRANSPORT_BENCHMARK_TRANSPORTS_COUNT] =
+{
+	"TCP",
+	"Unix socket",
+	"Shared memory"
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Create two connected loopback TCP sockets.
+ * @param Pointer_Sockets On output, contain the sockets.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+static int TransportBenchmarkCreateTCPSockets(int *Pointer_Sockets)
+{
+	struct sockaddr_in Address;
+	socklen_t Address_Size = sizeof(Address);
+	int Server_Socket, Option_Value = 1, i;
+
+	Server_Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (Server_Socket == -1) return 1;
+
+	// Let the system choose the port
+	memset(&Address, 0, sizeof(Address));
+	Address.sin_family = AF_INET;
+	Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(Server_Socket, (struct sockaddr *) &Address, sizeof(Address)) == -1) || (listen(Server_Socket, 1) == -1) || (getsockname(Server_Socket, (struct sockaddr *) &Address, &Address_Size) == -1)) goto Exit_Error;
+
+	Pointer_Sockets[0] = socket(AF_INET, SOCK_STREAM, 0);
+	if (Pointer_Sockets[0] == -1) goto Exit_Error;
+	if (connect(Pointer_Sockets[0], (struct sockaddr *) &Address, sizeof(Address)) == -1) goto Exit_Error;
+	Pointer_Sockets[1] = accept(Server_Socket, NULL, NULL);
+	if (Pointer_Sockets[1] == -1) goto Exit_Error;
+	close(Server_Socket);
+
+	// Send each command at once, like the bridge and the server do
+	for (i = 0; i < 2; i++) setsockopt(Pointer_Sockets[i], IPPROTO_TCP, TCP_NODELAY, &Option_Value, sizeof(Option_Value));
+	return 0;
+
+Exit_Error:
+	printf("[%s:%d] Error : failed to create the TCP sockets (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+	close(Server_Socket);
+	return 1;
+}
+
+/** Create the endpoints of a transport.
+ * @param Transport The transport.
+ * @param Pointer_Endpoints On output, contain the endpoints.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+static int TransportBenchmarkCreateEndpoints(TTransportBenchmarkTransport Transport, TTransportBenchmarkEndpoints *Pointer_Endpoints)
+{
+	int File_Descriptor;
+
+	switch (Transport)
+	{
+		case TRANSPORT_BENCHMARK_TRANSPORT_TCP:
+			return TransportBenchmarkCreateTCPSockets(Pointer_Endpoints->Sockets);
+
+		case TRANSPORT_BENCHMARK_TRANSPORT_UNIX_SOCKET:
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pointer_Endpoints->Sockets) == -1)
+			{
+				printf("[%s:%d] Error : failed to create the Unix sockets (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+				return 1;
+			}
+			return 0;
+
+		default:
+			// The child process inherits the mapping
+			Pointer_Endpoints->Pointer_Ring_Pair = RingPairCreate(&File_Descriptor);
+			if (Pointer_Endpoints->Pointer_Ring_Pair == NULL) return 1;
+			close(File_Descriptor);
+
+			Pointer_Endpoints->Event_File_Descriptors[0] = eventfd(0, 0);
+			Pointer_Endpoints->Event_File_Descriptors[1] = eventfd(0, 0);
+			if ((Pointer_Endpoints->Event_File_Descriptors[0] == -1) || (Pointer_Endpoints->Event_File_Descriptors[1] == -1))
+			{
+				printf("[%s:%d] Error : failed to create the eventfds (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+				return 1;
+			}
+			return 0;
+	}
+}
+
+/** Release the endpoints of a transport.
+ * @param Transport The transport.
+ * @param Pointer_Endpoints The endpoints.
+ */
+static void TransportBenchmarkDestroyEndpoints(TTransportBenchmarkTransport Transport, TTransportBenchmarkEndpoints *Pointer_Endpoints)
+{
+	if (Transport == TRANSPORT_BENCHMARK_TRANSPORT_SHARED_MEMORY)
+	{
+		RingPairUnmap(Pointer_Endpoints->Pointer_Ring_Pair);
+		close(Pointer_Endpoints->Event_File_Descriptors[0]);
+		close(Pointer_Endpoints->Event_File_Descriptors[1]);
+	}
+	else
+	{
+		close(Pointer_Endpoints->Sockets[0]);
+		close(Pointer_Endpoints->Sockets[1]);
+	}
+}
+
+/** Send a message and wait for it to come back.
+ * @param Transport The transport.
+ * @param Pointer_Endpoints The endpoints.
+ * @param Pointer_Message The message.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+static int TransportBenchmarkRelay(TTransportBenchmarkTransport Transport, TTransportBenchmarkEndpoints *Pointer_Endpoints, unsigned char *Pointer_Message)
+{
+	unsigned char Buffer[TRANSPORT_BENCHMARK_MESSAGE_SIZE];
+	unsigned long long Event_Value = 1;
+	int Size = 0, Result;
+
+	if (Transport != TRANSPORT_BENCHMARK_TRANSPORT_SHARED_MEMORY)
+	{
+		if (write(Pointer_Endpoints->Sockets[0], Pointer_Message, TRANSPORT_BENCHMARK_MESSAGE_SIZE) != TRANSPORT_BENCHMARK_MESSAGE_SIZE) return 1;
+		while (Size < TRANSPORT_BENCHMARK_MESSAGE_SIZE)
+		{
+			Result = read(Pointer_Endpoints->Sockets[0], &Buffer[Size], sizeof(Buffer) - Size);
+			if (Result <= 0) return 1;
+			Size += Result;
+		}
+		return 0;
+	}
+
+	if (RingWrite(&Pointer_Endpoints->Pointer_Ring_Pair->To_Server, Pointer_Message, TRANSPORT_BENCHMARK_MESSAGE_SIZE) != TRANSPORT_BENCHMARK_MESSAGE_SIZE) return 1;
+	if (write(Pointer_Endpoints->Event_File_Descriptors[1], &Event_Value, sizeof(Event_Value)) != sizeof(Event_Value)) return 1;
+	while (Size < TRANSPORT_BENCHMARK_MESSAGE_SIZE)
+	{
+		if (read(Pointer_Endpoints->Event_File_Descriptors[0], &Event_Value, sizeof(Event_Value)) != sizeof(Event_Value)) return 1;
+		Size += RingRead(&Pointer_Endpoints->Pointer_Ring_Pair->To_Bridge, &Buffer[Size], sizeof(Buffer) - Size);
+	}
+	return 0;
+}
+
+/** Echo all received messages until the process is killed (this function never returns).
+ * @param Transport The transport.
+ * @param Pointer_Endpoints The endpoints.
+ */
+static void TransportBenchmarkEcho(TTransportBenchmarkTransport Transport, TTransportBenchmarkEndpoints *Pointer_Endpoints)
+{
+	unsigned char Buffer[256];
+	unsigned long long Event_Value;
+	int Size;
+
+	while (1)
+	{
+		if (Transport != TRANSPORT_BENCHMARK_TRANSPORT_SHARED_MEMORY)
+		{
+			Size = read(Pointer_Endpoints->Sockets[1], Buffer, sizeof(Buffer));
+			if (Size <= 0) exit(EXIT_FAILURE);
+			if (write(Pointer_Endpoints->Sockets[1], Buffer, Size) != Size) exit(EXIT_FAILURE);
+		}
+		else
+		{
+			if (read(Pointer_Endpoints->Event_File_Descriptors[1], &Event_Value, sizeof(Event_Value)) != sizeof(Event_Value)) exit(EXIT_FAILURE);
+			Size = RingRead(&Pointer_Endpoints->Pointer_Ring_Pair->To_Server, Buffer, sizeof(Buffer));
+			RingWrite(&Pointer_Endpoints->Pointer_Ring_Pair->To_Bridge, Buffer, Size);
+			Event_Value = 1;
+			if (write(Pointer_Endpoints->Event_File_Descriptors[0], &Event_Value, sizeof(Event_Value)) != sizeof(Event_Value)) exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/** Convert a time value to microseconds.
+ * @param Pointer_Time The time value.
+ * @return The time in microseconds.
+ */
+static double TransportBenchmarkGetMicroseconds(struct timeval *Pointer_Time)
+{
+	return Pointer_Time->tv_sec * 1000000.0 + Pointer_Time->tv_usec;
+}
+
+/** Sort the latencies in ascending order (qsort() callback).
+ * @param Pointer_A The first latency.
+ * @param Pointer_B The second latency.
+ * @return A negative value if A < B, 0 if A == B, a positive value if A > B.
+ */
+static int TransportBenchmarkCompareLatencies(const void *Pointer_A, const void *Pointer_B)
+{
+	double A = *(const double *) Pointer_A, B = *(const double *) Pointer_B;
+
+	return (A > B) - (A < B);
+}
+
+/** Relay the messages on a transport and display the results.
+ * @param Transport The transport.
+ * @param Messages_Count How many messages to relay.
+ * @param Pointer_Latencies A buffer large enough to store all message latencies.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+static int TransportBenchmarkRun(TTransportBenchmarkTransport Transport, int Messages_Count, double *Pointer_Latencies)
+{
+	TTransportBenchmarkEndpoints Endpoints;
+	struct rusage Self_Usage_Start, Self_Usage_End, Children_Usage_Start, Children_Usage_End;
+	struct timespec Start_Time, End_Time;
+	unsigned char Message[TRANSPORT_BENCHMARK_MESSAGE_SIZE] = {0, 1, 2, 3};
+	pid_t Child_PID;
+	double Total_Latency = 0, CPU_Time;
+	int i, Return_Value = 0;
+
+	memset(&Endpoints, 0, sizeof(Endpoints));
+	if (TransportBenchmarkCreateEndpoints(Transport, &Endpoints) != 0) return 1;
+
+	getrusage(RUSAGE_CHILDREN, &Children_Usage_Start);
+	Child_PID = fork();
+	if (Child_PID == -1)
+	{
+		printf("[%s:%d] Error : fork() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		TransportBenchmarkDestroyEndpoints(Transport, &Endpoints);
+		return 1;
+	}
+	if (Child_PID == 0) TransportBenchmarkEcho(Transport, &Endpoints);
+
+	getrusage(RUSAGE_SELF, &Self_Usage_Start);
+	for (i = 0; i < Messages_Count; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &Start_Time);
+		if (TransportBenchmarkRelay(Transport, &Endpoints, Message) != 0)
+		{
+			printf("[%s:%d] Error : failed to relay message %d (%s).\n", __FUNCTION__, __LINE__, i, strerror(errno));
+			Return_Value = 1;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &End_Time);
+		Pointer_Latencies[i] = (End_Time.tv_sec - Start_Time.tv_sec) * 1000000.0 + (End_Time.tv_nsec - Start_Time.tv_nsec) / 1000.0;
+		Total_Latency += Pointer_Latencies[i];
+	}
+	getrusage(RUSAGE_SELF, &Self_Usage_End);
+
+	// The child resources usage is available once it has been waited for
+	kill(Child_PID, SIGKILL);
+	waitpid(Child_PID, NULL, 0);
+	getrusage(RUSAGE_CHILDREN, &Children_Usage_End);
+	TransportBenchmarkDestroyEndpoints(Transport, &Endpoints);
+	if (Return_Value != 0) return 1;
+
+	CPU_Time = TransportBenchmarkGetMicroseconds(&Self_Usage_End.ru_utime) - TransportBenchmarkGetMicroseconds(&Self_Usage_Start.ru_utime);
+	CPU_Time += TransportBenchmarkGetMicroseconds(&Self_Usage_End.ru_stime) - TransportBenchmarkGetMicroseconds(&Self_Usage_Start.ru_stime);
+	CPU_Time += TransportBenchmarkGetMicroseconds(&Children_Usage_End.ru_utime) - TransportBenchmarkGetMicroseconds(&Children_Usage_Start.ru_utime);
+	CPU_Time += TransportBenchmarkGetMicroseconds(&Children_Usage_End.ru_stime) - TransportBenchmarkGetMicroseconds(&Children_Usage_Start.ru_stime);
+
+	qsort(Pointer_Latencies, Messages_Count, sizeof(double), TransportBenchmarkCompareLatencies);
+	printf("%-14s %12.2f %12.2f %12.2f %12.2f\n", String_Transport_Benchmark_Transport_Names[Transport], Total_Latency / Messages_Count, Pointer_Latencies[Messages_Count / 2], Pointer_Latencies[(Messages_Count * 99) / 100], CPU_Time / Messages_Count);
+
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	int Messages_Count = TRANSPORT_BENCHMARK_DEFAULT_MESSAGES_COUNT, Transport, Return_Value = EXIT_SUCCESS;
+	double *Pointer_Latencies;
+
+	// Check parameters
+	if (argc > 2)
+	{
+		printf("Usage : %s [Messages_Count]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc == 2) Messages_Count = atoi(argv[1]);
+	if (Messages_Count <= 0)
+	{
+		printf("Error : the messages count must be positive.\n");
+		return EXIT_FAILURE;
+	}
+
+	Pointer_Latencies = malloc(Messages_Count * sizeof(double));
+	if (Pointer_Latencies == NULL)
+	{
+		printf("[%s:%d] Error : failed to allocate the latencies buffer.\n", __FUNCTION__, __LINE__);
+		return EXIT_FAILURE;
+	}
+
+	printf("Relaying %d messages of %d bytes (times in microseconds, CPU time of both processes).\n", Messages_Count, TRANSPORT_BENCHMARK_MESSAGE_SIZE);
+	printf("%-14s %12s %12s %12s %12s\n", "Transport", "Average", "Median", "99th perc.", "CPU/message");
+	for (Transport = 0; Transport < TRANSPORT_BENCHMARK_TRANSPORTS_COUNT; Transport++)
+	{
+		if (TransportBenchmarkRun(Transport, Messages_Count, Pointer_Latencies) != 0) Return_Value = EXIT_FAILURE;
+	}
+
+	free(Pointer_Latencies);
+	return Return_Value;
+}
@@ -25,6 +25,16 @@
 /** The probability to spawn an item when a Destructible obstacle is broken. */
 #define CONFIGURATION_DESTRUCTIBLE_OBSTACLE_ITEM_SPAWNING_PERCENTAGE 35
 
+/** How many clients can be connecting in the same time (a connecting client has not sent its name yet). */
+#define CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT 64
+/** How many received bytes can be buffered for each client (a WebSocket client handshake request must fit). */
+#define CONFIGURATION_NETWORK_RECEPTION_BUFFER_SIZE 2048
+
+/** How many bridges can be connected to the server through a multiplexed link. */
+#define CONFIGURATION_MAXIMUM_LINKS_COUNT 4
+/** How many bytes can be buffered in each direction for a multiplexed link. */
+#define CONFIGURATION_NETWORK_LINK_BUFFER_SIZE 65536
+
 /** The maximum length of a 'draw text' command message. */
 #define CONFIGURATION_COMMAND_DRAW_TEXT_MESSAGE_MAXIMUM_SIZE 255
 
@@ -45,7 +55,7 @@
 /** Path to the maps directory. */
 #define CONFIGURATION_MAPS_PATH "Maps"
 
-/** All available maps. */
+/** All available maps. The map index in this list is the map ID sent to the clients, so new maps must be appended to keep the clients map pack valid. */
 #define CONFIGURATION_MAP_FILE_NAMES "test.txt", \
 	"test2.txt"
 
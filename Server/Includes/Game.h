@@ -7,6 +7,7 @@
 #define H_GAME_H
 
 #include <Configuration.h>
+#include <WebSocket.h>
 
 //-------------------------------------------------------------------------------------------------
 // Types
@@ -15,13 +16,22 @@
 typedef struct
 {
 	char String_Name[CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH]; //!< The player name.
-	int Socket; //!< The network socket used to communicate with the client.
+	int Socket; //!< The network socket used to communicate with the client (the link socket if the client is connected through a multiplexed link).
 	int Row; //!< The player Y location on the map.
 	int Column; //!< The player X location on the map.
 	int Bombs_Count; //!< Tell how many bombs the player can carry.
 	int Explosion_Range; //!< How many cells an explosion can reach.
 	int Is_Alive; //!< Tell if the player is alive or not.
 	int Shield_Timer; //!< The player is protected by a shield when this value is greater than zero. The shield is removed when the value falls to zero.
+	int Capabilities; //!< The optional protocol features supported by the client (a combination of NETWORK_CLIENT_CAPABILITY_xxx flags).
+	unsigned char Event_Sequence; //!< The sequence number of the last event received from a client having the NETWORK_CLIENT_CAPABILITY_EVENT_SEQUENCE capability.
+	int Is_WebSocket_Client; //!< Set to 1 if the client connected to the WebSocket port, so its data must be sent and received in WebSocket frames.
+	TWebSocketDecoder WebSocket_Decoder; //!< Extract the commands from the WebSocket client frames.
+	unsigned char Received_Bytes[CONFIGURATION_NETWORK_RECEPTION_BUFFER_SIZE]; //!< The bytes received from the client but not processed yet.
+	int Received_Bytes_Count; //!< How many bytes are stored in Received_Bytes.
+	int Link_ID; //!< The multiplexed link the client is connected through, or -1 if the client owns its socket.
+	int Link_Channel_ID; //!< The client channel on the multiplexed link.
+	int Is_Link_Channel_Closed; //!< Set to 1 when the bridge closed the client channel.
 } TGamePlayer;
 
 /** All available tiles. */
@@ -47,30 +47,50 @@ typedef struct
 //-------------------------------------------------------------------------------------------------
 // Variables
 //-------------------------------------------------------------------------------------------------
-/** The map itself. */
-extern TMapCell Map[CONFIGURATION_MAP_ROWS_COUNT][CONFIGURATION_MAP_COLUMNS_COUNT];
+/** The map of the current round (it points to one of the two internal map buffers, the other one is used to prepare the next round). */
+extern TMapCell (*Map)[CONFIGURATION_MAP_COLUMNS_COUNT];
 
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
-/** Load a random map from the CONFIGURATION_MAPS_PATH directory.
+/** Load a random map from the CONFIGURATION_MAPS_PATH directory into the next round map buffer. The current map is not modified, so this function can be called from another thread while a round is played.
  * @return 0 if the map was successfully loaded,
  * @return 1 if an error occurred.
  */
-int MapLoadRandom(void);
+int MapPrepareNextRandom(void);
 
-/** Tell how many spawn points the map has.
+/** Get the tile of a cell of the map prepared by MapPrepareNextRandom().
+ * @param Row The Y location.
+ * @param Column The X location.
+ * @return The cell tile.
+ */
+TGameTileID MapGetPreparedCellTileID(int Row, int Column);
+
+/** Get the ID of the map prepared by MapPrepareNextRandom().
+ * @return The map index in the CONFIGURATION_MAP_FILE_NAMES list.
+ */
+int MapGetPreparedID(void);
+
+/** Get the hash of the map file prepared by MapPrepareNextRandom(), so clients can check that their own copy of the map is the same.
+ * @return The 32-bit FNV-1a hash of all map cells characters, read from left to right and from top to bottom.
+ */
+unsigned int MapGetPreparedHash(void);
+
+/** Tell how many spawn points the map prepared by MapPrepareNextRandom() has.
  * @return The spawn points amount.
  */
-int MapGetSpawnPointsCount(void);
+int MapGetPreparedSpawnPointsCount(void);
 
-/** Get a specified spawn point coordinates. Spawn points are numbered starting from map left to right, upper to bottom.
+/** Get a specified spawn point coordinates of the map prepared by MapPrepareNextRandom(). Spawn points are numbered starting from map left to right, upper to bottom.
  * @param Spawn_Point_Index The spawn point index (leftmost and upper map spawn point is 0, index increments continuing to right then to next row).
  * @param Pointer_Row On output, contain the spawn point row.
  * @param Pointer_Column On output, contain the spawn point column.
  * @note If the spawn point index does not exist, the returned coordinates will be zero.
  */
-void MapGetSpawnPointCoordinates(int Spawn_Point_Index, int *Pointer_Row, int *Pointer_Column);
+void MapGetPreparedSpawnPointCoordinates(int Spawn_Point_Index, int *Pointer_Row, int *Pointer_Column);
+
+/** Make the map prepared by MapPrepareNextRandom() the current map. This is instant as only a pointer is changed. */
+void MapSwap(void);
 
 /** Randomly spawn an item (or nothing) at the specified location.
  * @param Row The Y location.
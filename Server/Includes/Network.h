@@ -7,6 +7,7 @@
 #define H_NETWORK_H
 
 #include <Game.h>
+#include <Protocol.h>
 
 //-------------------------------------------------------------------------------------------------
 // Types
@@ -20,30 +21,49 @@ typedef enum
 	NETWORK_EVENT_GO_LEFT, //!< The client pressed the "left" button.
 	NETWORK_EVENT_GO_RIGHT, //!< The client pressed the "right" button.
 	NETWORK_EVENT_DROP_BOMB, //!< The client pressed the "drop bomb" button.
-	NETWORK_EVENT_DISCONNECT //!< The client exited.
+	NETWORK_EVENT_DISCONNECT, //!< The client exited.
+	NETWORK_EVENT_REQUEST_MAP //!< The client could not build the map from the 'load map' command and needs the whole map to be sent.
 } TNetworkEvent;
 
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
-/** Bind the game server on the requested IP address and port.
+/** Bind the game server on the requested IP address and ports.
  * @param String_IP_Address The IP address to bind on.
- * @param Port The port to bind on.
+ * @param Port The port to bind on for the native clients.
+ * @param WebSocket_Port The port to bind on for the browser clients using the WebSocket protocol, set to 0 to disable WebSocket support.
+ * @param String_Unix_Socket_Path The Unix socket path for the native clients and the bridges running on the same host, set to NULL to disable the Unix socket.
  * @return 0 if the server was successfully created,
  * @return 1 if an error occurred.
  */
-int NetworkCreateServer(char *String_IP_Address, unsigned short Port);
+int NetworkCreateServer(char *String_IP_Address, unsigned short Port, unsigned short WebSocket_Port, char *String_Unix_Socket_Path);
 
-/** Tell whether a player has just connected or not.
- * @param Pointer_Player_Socket On output, contain the player socket.
- * @param String_Player_Name On output, contain the name of the player. The string must be CONFIGURATION_MAXIMUM_PLAYERS_COUNT bytes long.
+/** Tell whether a player has just connected or not. Native, Unix socket and WebSocket clients are accepted on their own socket, then handled the same way.
+ * @param Pointer_Player On output, contain the player socket, name, capabilities and network state.
  * @return 0 if no player connected or if an error occurred,
  * @return 1 if a player successfully connected.
  */
-int NetworkIsPlayerConnected(int *Pointer_Player_Socket, char *String_Player_Name);
+int NetworkIsPlayerConnected(TGamePlayer *Pointer_Player);
 
 void NetworkShutdownServer(void);
 
+/** Disconnect a client (only its channel is closed if it uses a multiplexed link). The Network functions ignore the player then.
+ * @param Pointer_Player The player to disconnect.
+ */
+void NetworkDisconnectPlayer(TGamePlayer *Pointer_Player);
+
+/** Receive the data of all multiplexed links with a single read per link and dispatch it to the links clients. This must be called at the beginning of each game tick.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+int NetworkReceiveLinksData(void);
+
+/** Send everything written to the multiplexed links clients with a single write per link. This must be called before a game tick ends.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+int NetworkSendLinksData(void);
+
 /** Tell if the specified client sent an event or not.
  * @param Pointer_Player The player to get event from.
  * @param Pointer_Event On output, contain the event received from the client.
@@ -62,6 +82,42 @@ int NetworkGetEvent(TGamePlayer *Pointer_Player, TNetworkEvent *Pointer_Event);
  */
 int NetworkSendCommandDrawTile(TGamePlayer *Pointer_Player, int Tile_ID, int Row, int Column);
 
+/** Encode a 'draw tile' command into a buffer without sending it, so that many commands can be prepared in advance and sent at once with NetworkSendCommands().
+ * @param Pointer_Buffer On output, contain the command. The buffer must be NETWORK_COMMAND_DRAW_TILE_SIZE bytes long.
+ * @param Tile_ID The tile the client must display.
+ * @param Row The tile Y coordinate.
+ * @param Column The tile X coordinate.
+ * @return The encoded command size in bytes.
+ */
+int NetworkEncodeCommandDrawTile(unsigned char *Pointer_Buffer, int Tile_ID, int Row, int Column);
+
+/** Encode a 'load map' command, allowing a client owning the map files to rebuild the whole map itself instead of receiving all tiles.
+ * @param Pointer_Buffer On output, contain the command. The buffer must be NETWORK_COMMAND_LOAD_MAP_SIZE bytes long.
+ * @param Map_ID The map index in the CONFIGURATION_MAP_FILE_NAMES list.
+ * @param Map_Hash The map file hash, the client must request the whole map if its own map file hash is different.
+ * @param Pointer_Obstacles_Bitmap Tell which cells contain a destructible obstacle (cell index is Row * CONFIGURATION_MAP_COLUMNS_COUNT + Column, least significant bit first). The bitmap must be NETWORK_MAP_OBSTACLES_BITMAP_SIZE bytes long.
+ * @return The encoded command size in bytes.
+ */
+int NetworkEncodeCommandLoadMap(unsigned char *Pointer_Buffer, int Map_ID, unsigned int Map_Hash, unsigned char *Pointer_Obstacles_Bitmap);
+
+/** Send already encoded commands to a client in a single write.
+ * @param Pointer_Player The player to send commands to.
+ * @param Pointer_Commands The encoded commands.
+ * @param Size The commands size in bytes.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+int NetworkSendCommands(TGamePlayer *Pointer_Player, unsigned char *Pointer_Commands, int Size);
+
+/** Tell a client having the NETWORK_CLIENT_CAPABILITY_EVENT_SEQUENCE capability that its last received event has been processed, and where its player is, so it can correct its predicted location.
+ * @param Pointer_Player The player to send command to.
+ * @param Row The player Y coordinate, or NETWORK_ACKNOWLEDGE_EVENT_NOT_ON_MAP.
+ * @param Column The player X coordinate, or NETWORK_ACKNOWLEDGE_EVENT_NOT_ON_MAP.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+int NetworkSendCommandAcknowledgeEvent(TGamePlayer *Pointer_Player, int Row, int Column);
+
 /** Send a displayable message to a client.
  * @param Pointer_Player The player to send command to.
  * @param String_Text The message the client must display.
@@ -0,0 +1,66 @@
+/** @file Protocol.h
+ * The commands exchanged between the server and the clients, and the multiplexed link frames exchanged with the bridges. Shared with the bridges, which must know the commands boundaries and the link protocol without including the whole server.
+ * @author Adrien RICCIARDI
+ */
+
+#ifndef H_PROTOCOL_H
+#define H_PROTOCOL_H
+
+#include <Configuration.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** Size in bytes of an encoded 'draw tile' command. */
+#define NETWORK_COMMAND_DRAW_TILE_SIZE 4
+/** Size in bytes of a 'draw text' command header (command code and text size), the text follows. */
+#define NETWORK_COMMAND_DRAW_TEXT_HEADER_SIZE 2
+
+/** Size in bytes of the destructible obstacles bitmap (one bit per map cell). */
+#define NETWORK_MAP_OBSTACLES_BITMAP_SIZE (((CONFIGURATION_MAP_ROWS_COUNT * CONFIGURATION_MAP_COLUMNS_COUNT) + 7) / 8)
+/** Size in bytes of an encoded 'load map' command (command code, map ID, 32-bit map hash and obstacles bitmap). */
+#define NETWORK_COMMAND_LOAD_MAP_SIZE (2 + 4 + NETWORK_MAP_OBSTACLES_BITMAP_SIZE)
+
+/** The client owns a copy of the maps and can build the map from a 'load map' command. */
+#define NETWORK_CLIENT_CAPABILITY_MAP_CACHE 0x01
+/** The client follows each event with an 8-bit sequence number and predicts its own moves, the server answers each event with an 'acknowledge event' command. */
+#define NETWORK_CLIENT_CAPABILITY_EVENT_SEQUENCE 0x02
+
+/** Size in bytes of an 'acknowledge event' command (command code, event sequence number, player row and column). */
+#define NETWORK_COMMAND_ACKNOWLEDGE_EVENT_SIZE 4
+/** The row and column sent in an 'acknowledge event' command when the player is not on the map (dead or waiting for the game to start). */
+#define NETWORK_ACKNOWLEDGE_EVENT_NOT_ON_MAP 0xFF
+
+/** A bridge sends this byte as the first byte of a connection to turn it into a multiplexed link. Then both sides exchange link frames : a 16-bit channel ID, the frame type, a 16-bit payload size (all in big endian) and the payload. */
+#define NETWORK_LINK_HELLO 6
+/** A bridge connected to the server Unix socket can send this byte instead of NETWORK_LINK_HELLO, together with a shared memory ring pair and an eventfd file descriptors (in this order). The link frames are then exchanged through the rings : the server polls its ring at each tick and writes to the eventfd when it has used the rings, the socket is only used to detect the bridge disconnection. */
+#define NETWORK_LINK_HELLO_SHARED_MEMORY 7
+/** Size in bytes of a link frame header. */
+#define NETWORK_LINK_FRAME_HEADER_SIZE 5
+/** The biggest link frame payload. */
+#define NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE 4096
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** All available commands. */
+typedef enum
+{
+	NETWORK_COMMAND_DRAW_TILE, //!< The client must draw a tile at the specified location.
+	NETWORK_COMMAND_DRAW_TEXT, //!< The client must draw a string at the dedicated location.
+	NETWORK_COMMAND_CONNECT_TO_SERVER, //!< The client tries to connect to the server.
+	NETWORK_COMMAND_GET_EVENT, //!< The client sends a button event to the server.
+	NETWORK_COMMAND_CONNECT_TO_SERVER_WITH_CAPABILITIES, //!< The client tries to connect to the server and tells which optional protocol features it supports.
+	NETWORK_COMMAND_LOAD_MAP, //!< The client must build the map from its own map files and the destructible obstacles bitmap.
+	NETWORK_COMMAND_ACKNOWLEDGE_EVENT //!< The server processed the client event having the specified sequence number, the client player is at the specified location.
+} TNetworkCommand;
+
+/** All link frame types. */
+typedef enum
+{
+	NETWORK_LINK_FRAME_TYPE_OPEN, //!< The bridge has a new client on this channel (no payload).
+	NETWORK_LINK_FRAME_TYPE_DATA, //!< The payload is the data received from or sent to the channel client.
+	NETWORK_LINK_FRAME_TYPE_CLOSE //!< The channel client disconnected, or the server rejected or disconnected it (no payload).
+} TNetworkLinkFrameType;
+
+#endif
@@ -0,0 +1,73 @@
+/** @file Ring.h
+ * Lock-free single producer single consumer byte rings, stored in a shared memory area so that a bridge running on the same host can exchange data with the server without using the network stack.
+ * @author Adrien RICCIARDI
+ */
+
+#ifndef H_RING_H
+#define H_RING_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** Size in bytes of a ring buffer, it must be a power of two. */
+#define RING_BUFFER_SIZE 65536
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** A byte ring. The indexes always increase and are wrapped when accessing the buffer. */
+typedef struct
+{
+	unsigned int Write_Index; //!< Only written by the producer.
+	unsigned char Padding_1[60]; //!< Keep the indexes in different cache lines.
+	unsigned int Read_Index; //!< Only written by the consumer.
+	unsigned char Padding_2[60]; //!< Keep the indexes in different cache lines.
+	unsigned char Buffer[RING_BUFFER_SIZE]; //!< The data.
+} TRing;
+
+/** The rings shared by the server and a bridge, one for each direction. */
+typedef struct
+{
+	TRing To_Server; //!< Written by the bridge, read by the server.
+	TRing To_Bridge; //!< Written by the server, read by the bridge.
+} TRingPair;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Create a shared memory area holding an empty ring pair. The area can be shared with another process by sending it the file descriptor.
+ * @param Pointer_File_Descriptor On output, contain the shared memory file descriptor.
+ * @return The mapped ring pair,
+ * @return NULL if an error occurred.
+ */
+TRingPair *RingPairCreate(int *Pointer_File_Descriptor);
+
+/** Map a ring pair created by another process.
+ * @param File_Descriptor The shared memory file descriptor.
+ * @return The mapped ring pair,
+ * @return NULL if the file descriptor is not a shared memory file big enough for a ring pair or if an error occurred.
+ */
+TRingPair *RingPairMap(int File_Descriptor);
+
+/** Unmap a ring pair.
+ * @param Pointer_Ring_Pair The ring pair.
+ */
+void RingPairUnmap(TRingPair *Pointer_Ring_Pair);
+
+/** Append data to a ring (only the producer can call this function).
+ * @param Pointer_Ring The ring.
+ * @param Pointer_Data The data to append.
+ * @param Size The data size in bytes.
+ * @return How many bytes were appended (less than Size if the ring is full).
+ */
+int RingWrite(TRing *Pointer_Ring, void *Pointer_Data, int Size);
+
+/** Remove data from a ring (only the consumer can call this function).
+ * @param Pointer_Ring The ring.
+ * @param Pointer_Buffer On output, contain the data.
+ * @param Buffer_Size The buffer size in bytes.
+ * @return How many bytes were removed (0 if the ring is empty).
+ */
+int RingRead(TRing *Pointer_Ring, void *Pointer_Buffer, int Buffer_Size);
+
+#endif
@@ -0,0 +1,74 @@
+/** @file WebSocket.h
+ * Minimal WebSocket (RFC 6455) server side implementation : opening handshake and binary frames encoding and decoding.
+ * @author Adrien RICCIARDI
+ */
+
+#ifndef H_WEBSOCKET_H
+#define H_WEBSOCKET_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The biggest frame header the server can send. */
+#define WEBSOCKET_MAXIMUM_HEADER_SIZE 10
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** Keep track of the frames received from a client, as they can be split or coalesced in any way by the network. */
+typedef struct
+{
+	unsigned char Header[14]; //!< The header of the frame being received (the biggest client frame header is 14 bytes long).
+	int Header_Size; //!< How many header bytes have been received.
+	int Is_Receiving_Payload; //!< Set to 1 when the header has been fully received.
+	unsigned char Opcode; //!< The current frame opcode.
+	unsigned char Mask[4]; //!< The current frame masking key.
+	unsigned long long Remaining_Payload_Size; //!< How many payload bytes of the current frame are still to receive.
+	unsigned long long Payload_Offset; //!< How many payload bytes of the current frame have been received.
+} TWebSocketDecoder;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Tell whether a received HTTP request is complete or not.
+ * @param Pointer_Request The received bytes.
+ * @param Size The received bytes count.
+ * @return 0 if the request end has not been received yet,
+ * @return The request size in bytes (following bytes are WebSocket frames).
+ */
+int WebSocketGetRequestSize(unsigned char *Pointer_Request, int Size);
+
+/** Create the response to a WebSocket upgrade request.
+ * @param Pointer_Request The complete request.
+ * @param Request_Size The request size in bytes.
+ * @param String_Response On output, contain the response to send.
+ * @param Response_Buffer_Size The response buffer size in bytes.
+ * @return 0 if the request is a valid upgrade request,
+ * @return 1 if the request must be rejected.
+ */
+int WebSocketCreateHandshakeResponse(unsigned char *Pointer_Request, int Request_Size, char *String_Response, int Response_Buffer_Size);
+
+/** Reset a decoder before decoding the frames of a new client.
+ * @param Pointer_Decoder The decoder to reset.
+ */
+void WebSocketInitializeDecoder(TWebSocketDecoder *Pointer_Decoder);
+
+/** Extract the data frames payload from the received bytes. Control frames are consumed.
+ * @param Pointer_Decoder The client decoder.
+ * @param Pointer_Data The received bytes.
+ * @param Size The received bytes count.
+ * @param Pointer_Payload On output, contain the payload bytes.
+ * @param Payload_Buffer_Size The payload buffer size in bytes. The payload is never bigger than the received bytes, so reading at most this size of frames guarantees the payload fits.
+ * @return The payload bytes count,
+ * @return -1 if the client closed the connection, broke the protocol or if the payload did not fit in the buffer.
+ */
+int WebSocketDecode(TWebSocketDecoder *Pointer_Decoder, unsigned char *Pointer_Data, int Size, unsigned char *Pointer_Payload, int Payload_Buffer_Size);
+
+/** Create the header of a binary frame.
+ * @param Pointer_Header On output, contain the header. The buffer must be WEBSOCKET_MAXIMUM_HEADER_SIZE bytes long.
+ * @param Payload_Size The size of the payload that will follow the header.
+ * @return The header size in bytes.
+ */
+int WebSocketEncodeHeader(unsigned char *Pointer_Header, int Payload_Size);
+
+#endif
@@ -8,6 +8,7 @@
 #include <Game.h>
 #include <Map.h>
 #include <Network.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -25,6 +26,23 @@ static int Game_Alive_Players_Count;
 /** How many connected players on the server. */
 static int Game_Connected_Players_Count;
 
+/** The thread preparing the next round while the current one ends. */
+static pthread_t Game_Next_Round_Thread;
+/** The next round map, encoded as 'draw tile' commands ready to be sent to the clients. */
+static unsigned char Game_Next_Round_Map_Commands[CONFIGURATION_MAP_ROWS_COUNT * CONFIGURATION_MAP_COLUMNS_COUNT * NETWORK_COMMAND_DRAW_TILE_SIZE];
+/** The next round map commands size in bytes. */
+static int Game_Next_Round_Map_Commands_Size;
+/** The next round map, encoded as a 'load map' command for the clients owning the map files. */
+static unsigned char Game_Next_Round_Load_Map_Command[NETWORK_COMMAND_LOAD_MAP_SIZE];
+/** How many spawn points the next round map has. */
+static int Game_Next_Round_Spawn_Points_Count;
+/** The row of the spawn point chosen for each player in the next round. */
+static int Game_Next_Round_Spawn_Rows[CONFIGURATION_MAXIMUM_PLAYERS_COUNT];
+/** The column of the spawn point chosen for each player in the next round. */
+static int Game_Next_Round_Spawn_Columns[CONFIGURATION_MAXIMUM_PLAYERS_COUNT];
+/** Set to 0 by the preparation thread if the next round was successfully prepared, set to 1 if an error occurred. */
+static int Game_Next_Round_Preparation_Result;
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
@@ -46,11 +64,14 @@ static inline void GameWaitForPlayersConnection(void)
 	
 	while (1)
 	{
+		// Get the data of the clients using a multiplexed link
+		NetworkReceiveLinksData();
+		
 		// Check for a new player connection if there remain free player slots
 		if (Game_Players_Count < CONFIGURATION_MAXIMUM_PLAYERS_COUNT)
 		{
 			// Did a new player attempted connection ?
-			if (NetworkIsPlayerConnected(&Game_Players[Game_Players_Count].Socket, Game_Players[Game_Players_Count].String_Name))
+			if (NetworkIsPlayerConnected(&Game_Players[Game_Players_Count]))
 			{
 				NetworkSendCommandDrawText(&Game_Players[Game_Players_Count], "Hit Space when all players are ready.");
 				printf("Client #%d connected, name : %s.\n", Game_Players_Count + 1, Game_Players[Game_Players_Count].String_Name);
@@ -81,46 +102,176 @@ static inline void GameWaitForPlayersConnection(void)
 			if (i == Game_Players_Count) return; // All players are ready
 		}
 		
+		NetworkSendLinksData();
+		
 		// Wait some time to avoid 100% CPU usage
 		nanosleep(&Waiting_Time, NULL);
 	}
 }
 
+/** Compute the absolute time of the next game tick.
+ * @param Pointer_Next_Tick_Time On output, contain the time the next tick will start at.
+ */
+static inline void GameGetNextTickTime(struct timespec *Pointer_Next_Tick_Time)
+{
+	// Get loop starting time
+	if (clock_gettime(CLOCK_MONOTONIC, Pointer_Next_Tick_Time) != 0) printf("[%s:%d] Error : clock_gettime() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+	
+	// Add the required waiting time
+	Pointer_Next_Tick_Time->tv_nsec = (Pointer_Next_Tick_Time->tv_nsec + CONFIGURATION_GAME_TICK) % 999999999; // The maximum nanoseconds value is 999999999
+	if (Pointer_Next_Tick_Time->tv_nsec < CONFIGURATION_GAME_TICK) Pointer_Next_Tick_Time->tv_sec++; // Adjust seconds if nanoseconds overlapped
+}
+
+/** Load the next round map, encode it as network commands and choose the players spawn points. This function is run by a dedicated thread to keep the game ticking meanwhile.
+ * @param Pointer_Parameters Unused.
+ * @return Always NULL, the result is stored in Game_Next_Round_Preparation_Result.
+ */
+static void *GamePrepareNextRoundThread(void __attribute__((unused)) *Pointer_Parameters)
+{
+	int i, Row, Column, Size = 0, Cell_Index = 0;
+	unsigned char Obstacles_Bitmap[NETWORK_MAP_OBSTACLES_BITMAP_SIZE] = {0};
+	TGameTileID Tile_ID;
+	
+	// Load the map in the buffer that is not used by the current round
+	if (MapPrepareNextRandom() != 0)
+	{
+		Game_Next_Round_Preparation_Result = 1;
+		return NULL;
+	}
+	
+	// Encode the whole map once, it will be sent as is to all players
+	for (Row = 0; Row < CONFIGURATION_MAP_ROWS_COUNT; Row++)
+	{
+		for (Column = 0; Column < CONFIGURATION_MAP_COLUMNS_COUNT; Column++)
+		{
+			Tile_ID = MapGetPreparedCellTileID(Row, Column);
+			Size += NetworkEncodeCommandDrawTile(&Game_Next_Round_Map_Commands[Size], Tile_ID, Row, Column);
+			
+			// Walls are known by the clients owning the map files, only the randomly generated obstacles must be sent
+			if (Tile_ID == GAME_TILE_ID_DESTRUCTIBLE_OBSTACLE) Obstacles_Bitmap[Cell_Index / 8] |= 1 << (Cell_Index % 8);
+			Cell_Index++;
+		}
+	}
+	Game_Next_Round_Map_Commands_Size = Size;
+	NetworkEncodeCommandLoadMap(Game_Next_Round_Load_Map_Command, MapGetPreparedID(), MapGetPreparedHash(), Obstacles_Bitmap);
+	
+	// Give each player its own spawn point, the round start will only have to apply them
+	Game_Next_Round_Spawn_Points_Count = MapGetPreparedSpawnPointsCount();
+	for (i = 0; i < Game_Players_Count; i++) MapGetPreparedSpawnPointCoordinates(i, &Game_Next_Round_Spawn_Rows[i], &Game_Next_Round_Spawn_Columns[i]);
+	
+	Game_Next_Round_Preparation_Result = 0;
+	return NULL;
+}
+
+/** Start preparing the next round in background.
+ * @return 0 if the preparation thread was successfully started,
+ * @return 1 if an error occurred.
+ */
+static inline int GameStartNextRoundPreparation(void)
+{
+	int Result;
+	
+	Result = pthread_create(&Game_Next_Round_Thread, NULL, GamePrepareNextRoundThread, NULL);
+	if (Result != 0)
+	{
+		printf("[%s:%d] Error : failed to create the next round preparation thread (%s).\n", __FUNCTION__, __LINE__, strerror(Result));
+		return 1;
+	}
+	return 0;
+}
+
+/** Wait for the next round preparation to terminate (it has usually terminated long before this function is called) and make the prepared map the current one.
+ * @return 0 if the next round is ready,
+ * @return 1 if an error occurred.
+ */
+static inline int GameFinishNextRoundPreparation(void)
+{
+	int Result;
+	
+	Result = pthread_join(Game_Next_Round_Thread, NULL);
+	if (Result != 0)
+	{
+		printf("[%s:%d] Error : failed to wait for the next round preparation thread (%s).\n", __FUNCTION__, __LINE__, strerror(Result));
+		return 1;
+	}
+	if (Game_Next_Round_Preparation_Result != 0) return 1;
+	
+	MapSwap();
+	return 0;
+}
+
 /** Send the map to all connected clients. */
 static inline void GameDisplayMap(void)
 {
-	int i, Row, Column;
+	int i;
 	
 	for (i = 0; i < Game_Players_Count; i++)
 	{
-		for (Row = 0; Row < CONFIGURATION_MAP_ROWS_COUNT; Row++)
-		{
-			for (Column = 0; Column < CONFIGURATION_MAP_COLUMNS_COUNT; Column++) NetworkSendCommandDrawTile(&Game_Players[i], Map[Row][Column].Tile_ID, Row, Column);
-		}
+		// Let the clients owning the map files build the map themselves
+		if (Game_Players[i].Capabilities & NETWORK_CLIENT_CAPABILITY_MAP_CACHE) NetworkSendCommands(&Game_Players[i], Game_Next_Round_Load_Map_Command, sizeof(Game_Next_Round_Load_Map_Command));
+		else NetworkSendCommands(&Game_Players[i], Game_Next_Round_Map_Commands, Game_Next_Round_Map_Commands_Size);
 	}
 }
 
+/** Tell a client to display the specified player (automatically choose the right player tile according to the client).
+ * @param Pointer_Player The player to display.
+ * @param Pointer_Destination_Player The player the command is sent to.
+ */
+static inline void GameDisplayPlayerToPlayer(TGamePlayer *Pointer_Player, TGamePlayer *Pointer_Destination_Player)
+{
+	TGameTileID Tile_ID;
+	
+	// Select the right tile to send according to the destination client
+	if (Pointer_Destination_Player == Pointer_Player) Tile_ID = GAME_TILE_ID_CURRENT_PLAYER;
+	else Tile_ID = GAME_TILE_ID_OTHER_PLAYER;
+
+	NetworkSendCommandDrawTile(Pointer_Destination_Player, Tile_ID, Pointer_Player->Row, Pointer_Player->Column);
+	
+	// Display the shield on top of the player
+	if (Pointer_Player->Shield_Timer > 0) NetworkSendCommandDrawTile(Pointer_Destination_Player, GAME_TILE_SHIELD_OVERLAY, Pointer_Player->Row, Pointer_Player->Column);
+}
+
 /** Tell all clients to display the specified player (automatically choose the right player tile according to the client).
  * @param Pointer_Player The player to display.
  */
 static inline void GameDisplayPlayer(TGamePlayer *Pointer_Player)
 {
 	int i;
-	TGameTileID Tile_ID;
 	
-	for (i = 0; i < Game_Players_Count; i++)
+	for (i = 0; i < Game_Players_Count; i++) GameDisplayPlayerToPlayer(Pointer_Player, &Game_Players[i]);
+}
+
+/** Send the whole current map and all alive players to a single client (used when the client could not build the map by itself).
+ * @param Pointer_Player The player to send the map to.
+ */
+static inline void GameDisplayCurrentMapToPlayer(TGamePlayer *Pointer_Player)
+{
+	unsigned char Map_Commands[CONFIGURATION_MAP_ROWS_COUNT * CONFIGURATION_MAP_COLUMNS_COUNT * NETWORK_COMMAND_DRAW_TILE_SIZE];
+	int i, Row, Column, Size = 0;
+	
+	for (Row = 0; Row < CONFIGURATION_MAP_ROWS_COUNT; Row++)
 	{
-		// Select the right tile to send according to the destination client
-		if (Game_Players[i].Socket == Pointer_Player->Socket) Tile_ID = GAME_TILE_ID_CURRENT_PLAYER;
-		else Tile_ID = GAME_TILE_ID_OTHER_PLAYER;
+		for (Column = 0; Column < CONFIGURATION_MAP_COLUMNS_COUNT; Column++) Size += NetworkEncodeCommandDrawTile(&Map_Commands[Size], Map[Row][Column].Tile_ID, Row, Column);
+	}
+	NetworkSendCommands(Pointer_Player, Map_Commands, Size);
 	
-		NetworkSendCommandDrawTile(&Game_Players[i], Tile_ID, Pointer_Player->Row, Pointer_Player->Column);
-		
-		// Display the shield on top of the player
-		if (Pointer_Player->Shield_Timer > 0) NetworkSendCommandDrawTile(&Game_Players[i], GAME_TILE_SHIELD_OVERLAY, Pointer_Player->Row, Pointer_Player->Column);
+	for (i = 0; i < Game_Players_Count; i++)
+	{
+		if (Game_Players[i].Is_Alive) GameDisplayPlayerToPlayer(&Game_Players[i], Pointer_Player);
 	}
 }
 
+/** Tell a client predicting its moves that its last event has been processed and where its player really is.
+ * @param Pointer_Player The player.
+ */
+static inline void GameAcknowledgeEvent(TGamePlayer *Pointer_Player)
+{
+	if (!(Pointer_Player->Capabilities & NETWORK_CLIENT_CAPABILITY_EVENT_SEQUENCE)) return;
+	
+	if (Pointer_Player->Is_Alive) NetworkSendCommandAcknowledgeEvent(Pointer_Player, Pointer_Player->Row, Pointer_Player->Column);
+	else NetworkSendCommandAcknowledgeEvent(Pointer_Player, NETWORK_ACKNOWLEDGE_EVENT_NOT_ON_MAP, NETWORK_ACKNOWLEDGE_EVENT_NOT_ON_MAP);
+}
+
 /** Send the tile to all players.
  * @param Tile_ID The tile to send.
  * @param Row The map Y cell coordinate where to display the tile.
@@ -133,10 +284,10 @@ static inline void GameDisplayTile(TGameTileID Tile_ID, int Row, int Column)
 	for (i = 0; i < Game_Players_Count; i++) NetworkSendCommandDrawTile(&Game_Players[i], Tile_ID, Row, Column);
 }
 
-/** Put all players on a different spawn point. */
+/** Put all players on the spawn point chosen for them while the round was prepared. */
 static inline void GameSpawnPlayers(void)
 {
-	int i, Row, Column;
+	int i;
 	
 	Game_Alive_Players_Count = 0;
 	
@@ -145,12 +296,9 @@ static inline void GameSpawnPlayers(void)
 		// Do not spawn a disconnected player
 		if (Game_Players[i].Socket == -1) continue;
 		
-		// Get next spawn point coordinates
-		MapGetSpawnPointCoordinates(i, &Row, &Column);
-	
-		// Put player at this location
-		Game_Players[i].Row = Row;
-		Game_Players[i].Column = Column;
+		// Put player at its spawn point
+		Game_Players[i].Row = Game_Next_Round_Spawn_Rows[i];
+		Game_Players[i].Column = Game_Next_Round_Spawn_Columns[i];
 		Game_Players[i].Is_Alive = 1;
 		Game_Alive_Players_Count++;
 		
@@ -163,6 +311,9 @@ static inline void GameSpawnPlayers(void)
 		
 		// Tell the clients to display the player
 		GameDisplayPlayer(&Game_Players[i]);
+		
+		// The client predicting its moves starts from the spawn point, the events received before the round are discarded
+		GameAcknowledgeEvent(&Game_Players[i]);
 	}
 }
 
@@ -197,6 +348,9 @@ static inline void GameSetPlayerDead(TGamePlayer *Pointer_Player)
 	Pointer_Player->Is_Alive = 0;
 	Game_Alive_Players_Count--;
 	
+	// Stop the client move prediction
+	GameAcknowledgeEvent(Pointer_Player);
+	
 	// TODO handle scoring
 	
 	printf("%s is dead.\n", Pointer_Player->String_Name);
@@ -289,6 +443,10 @@ static inline void GameProcessEvents(TGamePlayer *Pointer_Player, TNetworkEvent
 			GameRemoveDisconnectedPlayer(Pointer_Player);
 			break;
 			
+		case NETWORK_EVENT_REQUEST_MAP:
+			GameDisplayCurrentMapToPlayer(Pointer_Player);
+			break;
+			
 		default:
 			printf("[%s:%d] Warning : unknown event (%d) from socket %d.\n", __FUNCTION__, __LINE__, Event, Pointer_Player->Socket);
 			break;
@@ -345,7 +503,7 @@ static inline void GameProcessEvents(TGamePlayer *Pointer_Player, TNetworkEvent
 		// Display other players if they were here too
 		for (i = 0; i < Game_Players_Count; i++)
 		{
-			if ((Game_Players[i].Is_Alive) && (Game_Players[i].Socket != Pointer_Player->Socket) && (Game_Players[i].Row == Player_Previous_Row) && (Game_Players[i].Column == Player_Previous_Column))
+			if ((Game_Players[i].Is_Alive) && (&Game_Players[i] != Pointer_Player) && (Game_Players[i].Row == Player_Previous_Row) && (Game_Players[i].Column == Player_Previous_Column))
 			{
 				GameDisplayPlayer(&Game_Players[i]); // As all enemy players are identical, only one must be drawn even if several players are located on the same map cell
 				break;
@@ -469,12 +627,40 @@ static inline void GameHandleShields(void)
 	}
 }
 
+/** Keep the game ticking between two rounds, only handling the players disconnection.
+ * @param Seconds_Count How long to wait.
+ */
+static inline void GameWaitBetweenRounds(int Seconds_Count)
+{
+	int i, Remaining_Ticks_Count;
+	TNetworkEvent Event;
+	struct timespec Time_To_Wait;
+	
+	for (Remaining_Ticks_Count = Seconds_Count * (1000000000L / CONFIGURATION_GAME_TICK); Remaining_Ticks_Count > 0; Remaining_Ticks_Count--)
+	{
+		GameGetNextTickTime(&Time_To_Wait);
+		NetworkReceiveLinksData();
+		
+		// Drop all player events except disconnection (dead players are polled too as the round is over)
+		for (i = 0; i < Game_Players_Count; i++)
+		{
+			if (NetworkGetEvent(&Game_Players[i], &Event) != 0) printf("[%s:%d] Error : failed to get the player #%d next event.\n", __FUNCTION__, __LINE__, i + 1);
+			else if (Event == NETWORK_EVENT_DISCONNECT) GameRemoveDisconnectedPlayer(&Game_Players[i]);
+			else if (Event != NETWORK_EVENT_NONE) GameAcknowledgeEvent(&Game_Players[i]); // The winner must not see its dropped moves predicted
+		}
+		NetworkSendLinksData();
+		
+		// Wait for the required absolute time
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Time_To_Wait, NULL) != 0) printf("[%s:%d] Error : clock_nanosleep() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+	}
+}
+
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
 int GameLoop(void)
 {
-	int i, Map_Spawn_Points_Count;
+	int i;
 	TNetworkEvent Event;
 	struct timespec Time_To_Wait;
 	char String_Next_Round_Message[CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH + 64]; // 64 bytes are enough for the static text
@@ -483,30 +669,33 @@ int GameLoop(void)
 	GameWaitForPlayersConnection();
 	Game_Connected_Players_Count = Game_Players_Count;
 	
+	// Prepare the first round
+	if (GameStartNextRoundPreparation() != 0) return 1;
+	
 	// Start a game
 	while (1)
 	{
+		// Get the map prepared in background
+		if (GameFinishNextRoundPreparation() != 0)
+		{
+			printf("[%s:%d] Error : failed to load the map.\n", __FUNCTION__, __LINE__);
+			return 1;
+		}
+		
 		// Are there at least 2 players to make the game works ?
 		if (Game_Connected_Players_Count < 2)
 		{
 			// Inform all remaining players to quit
 			for (i = 0; i < Game_Players_Count; i++) NetworkSendCommandDrawText(&Game_Players[i], "Not enough players remaining, please quit the server to make it restart a game.");
+			NetworkSendLinksData();
 			printf("Only %d player remaining, restarted server.\n", Game_Connected_Players_Count);
 			return 0;
 		}
 		
-		// Try to load a map
-		if (MapLoadRandom() != 0)
-		{
-			printf("[%s:%d] Error : failed to load the map.\n", __FUNCTION__, __LINE__);
-			return 1;
-		}
-	
 		// Are there enough spawn points for all players ?
-		Map_Spawn_Points_Count = MapGetSpawnPointsCount();
-		if (Map_Spawn_Points_Count < Game_Players_Count)
+		if (Game_Next_Round_Spawn_Points_Count < Game_Players_Count)
 		{
-			printf("[%s:%d] Error : the map has only %d spawn points while %d players are expected.\n", __FUNCTION__, __LINE__, Map_Spawn_Points_Count, Game_Players_Count);
+			printf("[%s:%d] Error : the map has only %d spawn points while %d players are expected.\n", __FUNCTION__, __LINE__, Game_Next_Round_Spawn_Points_Count, Game_Players_Count);
 			return 1;
 		}
 		printf("Map successfully loaded.\n");
@@ -526,12 +715,10 @@ int GameLoop(void)
 		// Update player actions and bombs
 		while (1)
 		{
-			// Get loop starting time
-			if (clock_gettime(CLOCK_MONOTONIC, &Time_To_Wait) != 0) printf("[%s:%d] Error : clock_gettime() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+			GameGetNextTickTime(&Time_To_Wait);
 			
-			// Add the required waiting time
-			Time_To_Wait.tv_nsec = (Time_To_Wait.tv_nsec + CONFIGURATION_GAME_TICK) % 999999999; // The maximum nanoseconds value is 999999999
-			if (Time_To_Wait.tv_nsec < CONFIGURATION_GAME_TICK) Time_To_Wait.tv_sec++; // Adjust seconds if nanoseconds overlapped
+			// Read all multiplexed links once per tick
+			NetworkReceiveLinksData();
 			
 			// Handle player events
 			for (i = 0; i < Game_Players_Count; i++)
@@ -540,7 +727,11 @@ int GameLoop(void)
 				if (!Game_Players[i].Is_Alive) continue;
 				
 				if (NetworkGetEvent(&Game_Players[i], &Event) != 0) printf("[%s:%d] Error : failed to get the player #%d next event.\n", __FUNCTION__, __LINE__, i + 1);
-				else if (Event != NETWORK_EVENT_NONE) GameProcessEvents(&Game_Players[i], Event); // Avoid calling the function if there is nothing to do
+				else if (Event != NETWORK_EVENT_NONE) // Avoid calling the function if there is nothing to do
+				{
+					GameProcessEvents(&Game_Players[i], Event);
+					GameAcknowledgeEvent(&Game_Players[i]);
+				}
 			}
 			
 			// Handle bombs now that players may have moved to grant them more chances of survival
@@ -548,8 +739,16 @@ int GameLoop(void)
 			
 			GameHandleShields();
 			
+			// Send everything the tick produced for the multiplexed links clients
+			NetworkSendLinksData();
+			
 			// Exit game if there is only one (or zero) player remaining
-			if (Game_Connected_Players_Count < 2) break;
+			if (Game_Connected_Players_Count < 2)
+			{
+				// Still prepare a round to keep the map buffers consistent
+				if (GameStartNextRoundPreparation() != 0) return 1;
+				break;
+			}
 			
 			// Is there a last player standing ?
 			if (Game_Alive_Players_Count <= 1) // One player remaining or all players dead
@@ -563,15 +762,17 @@ int GameLoop(void)
 					}
 					
 					// Tell all players that he won
-					sprintf(String_Next_Round_Message, "%s has won ! %d seconds before next round...", Game_Players[i].String_Name, CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND);
+					snprintf(String_Next_Round_Message, sizeof(String_Next_Round_Message), "%.*s has won ! %d seconds before next round...", CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH, Game_Players[i].String_Name, CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND);
 				}
-				else sprintf(String_Next_Round_Message, "Everyone died. %d seconds before next round...", CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND);
+				else snprintf(String_Next_Round_Message, sizeof(String_Next_Round_Message), "Everyone died. %d seconds before next round...", CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND);
 				
 				// Send the message to all players
 				for (i = 0; i < Game_Players_Count; i++) NetworkSendCommandDrawText(&Game_Players[i], String_Next_Round_Message);
 				printf("%s\n", String_Next_Round_Message);
 				
-				usleep(CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND * 1000000);
+				// Prepare the next round while players read the message
+				if (GameStartNextRoundPreparation() != 0) return 1;
+				GameWaitBetweenRounds(CONFIGURATION_SECONDS_BETWEEN_NEXT_ROUND);
 				break;
 			}
 			else
@@ -690,8 +891,7 @@ int GameDropBomb(int Row, int Column, int Explosion_Range, TGamePlayer *Pointer_
 void GameRemoveDisconnectedPlayer(TGamePlayer *Pointer_Player)
 {
 	// Close the connection first to avoid sending data to the non-existing client
-	close(Pointer_Player->Socket);
-	Pointer_Player->Socket = -1; // Tell the Network functions to ignore this client
+	NetworkDisconnectPlayer(Pointer_Player);
 	
 	// Consider the player as dead
 	GameSetPlayerDead(Pointer_Player);
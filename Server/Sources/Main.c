@@ -15,23 +15,27 @@
 //-------------------------------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
-	char *String_IP_Address;
-	unsigned short Port;
+	char *String_IP_Address, *String_Unix_Socket_Path = NULL;
+	unsigned short Port, WebSocket_Port = 0;
 	
 	// Check parameters
-	if (argc != 3)
+	if ((argc < 3) || (argc > 5))
 	{
-		printf("Usage : %s IP_Address Port\n", argv[0]);
+		printf("Usage : %s IP_Address Port [WebSocket_Port [Unix_Socket_Path]]\n", argv[0]);
+		printf("Browser clients can directly connect to WebSocket_Port if it is specified (set it to 0 to disable it).\n");
+		printf("Native clients and bridges running on the same host can connect to Unix_Socket_Path if it is specified.\n");
 		return EXIT_FAILURE;
 	}
 	String_IP_Address = argv[1];
 	Port = atoi(argv[2]);
+	if (argc >= 4) WebSocket_Port = atoi(argv[3]);
+	if (argc == 5) String_Unix_Socket_Path = argv[4];
 	
 	// Initialize random numbers generator
 	srand(time(NULL));
 	
 	// Create the server
-	if (NetworkCreateServer(String_IP_Address, Port) != 0)
+	if (NetworkCreateServer(String_IP_Address, Port, WebSocket_Port, String_Unix_Socket_Path) != 0)
 	{
 		printf("[%s:%d] Error : could not create the server on IP %s and port %u.\n", __FUNCTION__, __LINE__, String_IP_Address, Port);
 		return EXIT_FAILURE;
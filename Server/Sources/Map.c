@@ -20,6 +20,11 @@
 /** How many maps are available. */
 #define MAPS_COUNT (sizeof(String_Maps_File_Names) / sizeof(char *))
 
+/** FNV-1a 32-bit hash initial value. */
+#define MAP_HASH_OFFSET_BASIS 2166136261U
+/** FNV-1a 32-bit hash prime. */
+#define MAP_HASH_PRIME 16777619U
+
 //-------------------------------------------------------------------------------------------------
 // Private types
 //-------------------------------------------------------------------------------------------------
@@ -33,10 +38,20 @@ typedef struct
 //-------------------------------------------------------------------------------------------------
 // Private variables
 //-------------------------------------------------------------------------------------------------
-/** How many spawn points the last loaded map have. */
-static int Map_Spawn_Points_Count;
-/** The spawn points location. */
-static TMapCellCoordinate Map_Spawn_Points_Coordinates[CONFIGURATION_MAXIMUM_PLAYERS_COUNT];
+/** The two map buffers : one is used by the current round, the other one receives the next round map. */
+static TMapCell Map_Buffers[2][CONFIGURATION_MAP_ROWS_COUNT][CONFIGURATION_MAP_COLUMNS_COUNT];
+/** Index of the map buffer used by the current round. */
+static int Map_Current_Buffer_Index = 0;
+
+/** How many spawn points each map buffer have. */
+static int Map_Spawn_Points_Count[2];
+/** The spawn points location of each map buffer. */
+static TMapCellCoordinate Map_Spawn_Points_Coordinates[2][CONFIGURATION_MAXIMUM_PLAYERS_COUNT];
+
+/** The ID of the map loaded in each buffer. */
+static int Map_IDs[2];
+/** The file hash of the map loaded in each buffer. */
+static unsigned int Map_Hashes[2];
 
 /** All available maps file name. */
 static char *String_Maps_File_Names[] = { CONFIGURATION_MAP_FILE_NAMES };
@@ -44,20 +59,24 @@ static char *String_Maps_File_Names[] = { CONFIGURATION_MAP_FILE_NAMES };
 //-------------------------------------------------------------------------------------------------
 // Public variables
 //-------------------------------------------------------------------------------------------------
-TMapCell Map[CONFIGURATION_MAP_ROWS_COUNT][CONFIGURATION_MAP_COLUMNS_COUNT];
+TMapCell (*Map)[CONFIGURATION_MAP_COLUMNS_COUNT] = Map_Buffers[0];
 
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
 /** Load a map from a text file.
  * @param String_File_Path The file location.
+ * @param Buffer_Index The map buffer to fill.
  * @return 0 if the map was successfully loaded,
  * @return 1 if an error occurred.
  */
-static inline int MapLoad(char *String_File_Path)
+static inline int MapLoad(char *String_File_Path, int Buffer_Index)
 {
-	int File_Descriptor, Row, Column;
+	int File_Descriptor, Row, Column, Spawn_Points_Count;
 	char Character;
+	unsigned int Hash = MAP_HASH_OFFSET_BASIS;
+	TMapCell (*Pointer_Map)[CONFIGURATION_MAP_COLUMNS_COUNT];
+	TMapCellCoordinate *Pointer_Spawn_Points_Coordinates;
 	
 	// Try to open the file
 	File_Descriptor = open(String_File_Path, O_RDONLY);
@@ -67,7 +86,10 @@ static inline int MapLoad(char *String_File_Path)
 		return 1;
 	}
 	
-	Map_Spawn_Points_Count = 0;
+	// Cache the buffers address
+	Pointer_Map = Map_Buffers[Buffer_Index];
+	Pointer_Spawn_Points_Coordinates = Map_Spawn_Points_Coordinates[Buffer_Index];
+	Spawn_Points_Count = 0;
 	
 	// Load the whole file content
 	for (Row = 0; Row < CONFIGURATION_MAP_ROWS_COUNT; Row++)
@@ -85,10 +107,13 @@ static inline int MapLoad(char *String_File_Path)
 				}
 			} while (Character == '\n'); // Bypass new line character
 			
+			// Hash the map content to allow the clients to check their own copy
+			Hash = (Hash ^ (unsigned char) Character) * MAP_HASH_PRIME;
+			
 			// Reset the map cell
-			Map[Row][Column].Content = MAP_CELL_CONTENT_EMPTY;
-			Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
-			Map[Row][Column].Explosion_State = MAP_EXPLOSION_STATE_NO_BOMB;
+			Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_EMPTY;
+			Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
+			Pointer_Map[Row][Column].Explosion_State = MAP_EXPLOSION_STATE_NO_BOMB;
 			
 			// Is the character allowed ?
 			switch (Character)
@@ -97,34 +122,37 @@ static inline int MapLoad(char *String_File_Path)
 					// Generate or not a destructible object in this empty cell
 					if (rand() % 100 < CONFIGURATION_DESTRUCTIBLE_OBSTACLES_GENERATION_PERCENTAGE)
 					{
-						Map[Row][Column].Content = MAP_CELL_CONTENT_DESTRUCTIBLE_OBSTACLE;
-						Map[Row][Column].Tile_ID = GAME_TILE_ID_DESTRUCTIBLE_OBSTACLE;
+						Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_DESTRUCTIBLE_OBSTACLE;
+						Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_DESTRUCTIBLE_OBSTACLE;
 					}
 					else
 					{
-						Map[Row][Column].Content = MAP_CELL_CONTENT_EMPTY;
-						Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
+						Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_EMPTY;
+						Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
 					}
 					break;
 					
 				case 'W':
-					Map[Row][Column].Content = MAP_CELL_CONTENT_WALL;
-					Map[Row][Column].Tile_ID = GAME_TILE_ID_WALL;
+					Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_WALL;
+					Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_WALL;
 					break;
 					
 				case 'S':
-					Map[Row][Column].Content = MAP_CELL_CONTENT_PLAYER_SPAWN_POINT;
-					Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
+					Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_PLAYER_SPAWN_POINT;
+					Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
 					
-					// Store the spawn point coordinates
-					Map_Spawn_Points_Coordinates[Map_Spawn_Points_Count].Row = Row;
-					Map_Spawn_Points_Coordinates[Map_Spawn_Points_Count].Column = Column;
-					Map_Spawn_Points_Count++;
+					// Store the spawn point coordinates (ignore the spawn points that can't be used)
+					if (Spawn_Points_Count < CONFIGURATION_MAXIMUM_PLAYERS_COUNT)
+					{
+						Pointer_Spawn_Points_Coordinates[Spawn_Points_Count].Row = Row;
+						Pointer_Spawn_Points_Coordinates[Spawn_Points_Count].Column = Column;
+						Spawn_Points_Count++;
+					}
 					break;
 					
 				case 'N':
-					Map[Row][Column].Content = MAP_CELL_CONTENT_NO_DESTRUCTIBLE_OBSTACLE_ZONE;
-					Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
+					Pointer_Map[Row][Column].Content = MAP_CELL_CONTENT_NO_DESTRUCTIBLE_OBSTACLE_ZONE;
+					Pointer_Map[Row][Column].Tile_ID = GAME_TILE_ID_EMPTY;
 					break;
 					
 				default:
@@ -136,44 +164,71 @@ static inline int MapLoad(char *String_File_Path)
 	}
 	close(File_Descriptor);
 	
+	Map_Spawn_Points_Count[Buffer_Index] = Spawn_Points_Count;
+	Map_Hashes[Buffer_Index] = Hash;
 	return 0;
 }
 
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
-int MapLoadRandom(void)
+int MapPrepareNextRandom(void)
 {
 	char *String_Map_File_Name;
 	char String_Map_Full_File_Path[256];
+	int Map_ID;
 	
 	// Choose a random map
-	String_Map_File_Name = String_Maps_File_Names[rand() % MAPS_COUNT];
+	Map_ID = rand() % MAPS_COUNT;
+	String_Map_File_Name = String_Maps_File_Names[Map_ID];
+	Map_IDs[Map_Current_Buffer_Index ^ 1] = Map_ID;
 	
 	// Create the map file path to load
 	snprintf(String_Map_Full_File_Path, sizeof(String_Map_Full_File_Path), "%s/%s", CONFIGURATION_MAPS_PATH, String_Map_File_Name);
 	printf("Loading map %s...\n", String_Map_Full_File_Path);
 	
-	return MapLoad(String_Map_Full_File_Path);
+	// Fill the buffer not used by the current round
+	return MapLoad(String_Map_Full_File_Path, Map_Current_Buffer_Index ^ 1);
+}
+
+TGameTileID MapGetPreparedCellTileID(int Row, int Column)
+{
+	return Map_Buffers[Map_Current_Buffer_Index ^ 1][Row][Column].Tile_ID;
 }
 
-int MapGetSpawnPointsCount(void)
+int MapGetPreparedID(void)
 {
-	return Map_Spawn_Points_Count;
+	return Map_IDs[Map_Current_Buffer_Index ^ 1];
 }
 
-void MapGetSpawnPointCoordinates(int Spawn_Point_Index, int *Pointer_Row, int *Pointer_Column)
+unsigned int MapGetPreparedHash(void)
+{
+	return Map_Hashes[Map_Current_Buffer_Index ^ 1];
+}
+
+int MapGetPreparedSpawnPointsCount(void)
+{
+	return Map_Spawn_Points_Count[Map_Current_Buffer_Index ^ 1];
+}
+
+void MapGetPreparedSpawnPointCoordinates(int Spawn_Point_Index, int *Pointer_Row, int *Pointer_Column)
 {
 	// Make sure the spawn point is existing
-	if (Spawn_Point_Index > Map_Spawn_Points_Count)
+	if (Spawn_Point_Index >= Map_Spawn_Points_Count[Map_Current_Buffer_Index ^ 1])
 	{
 		*Pointer_Row = 0;
 		*Pointer_Column = 0;
 		return;
 	}
 	
-	*Pointer_Row = Map_Spawn_Points_Coordinates[Spawn_Point_Index].Row;
-	*Pointer_Column = Map_Spawn_Points_Coordinates[Spawn_Point_Index].Column;
+	*Pointer_Row = Map_Spawn_Points_Coordinates[Map_Current_Buffer_Index ^ 1][Spawn_Point_Index].Row;
+	*Pointer_Column = Map_Spawn_Points_Coordinates[Map_Current_Buffer_Index ^ 1][Spawn_Point_Index].Column;
+}
+
+void MapSwap(void)
+{
+	Map_Current_Buffer_Index ^= 1;
+	Map = Map_Buffers[Map_Current_Buffer_Index];
 }
 
 void MapSpawnItem(int Row, int Column)
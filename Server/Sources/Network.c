@@ -6,33 +6,65 @@
 #include <arpa/inet.h>
 #include <Configuration.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <Game.h>
 #include <netinet/in.h>
 #include <Network.h>
+#include <Protocol.h>
+#include <Ring.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include <WebSocket.h>
 
 //-------------------------------------------------------------------------------------------------
 // Private types
 //-------------------------------------------------------------------------------------------------
-/** All available commands. */
-typedef enum
+/** A client that is connected but has not sent its name yet. */
+typedef struct
 {
-	NETWORK_COMMAND_DRAW_TILE, //!< The client must draw a tile at the specified location.
-	NETWORK_COMMAND_DRAW_TEXT, //!< The client must draw a string at the dedicated location.
-	NETWORK_COMMAND_CONNECT_TO_SERVER, //!< The client tries to connect to the server.
-	NETWORK_COMMAND_GET_EVENT //!< The client sends a button event to the server.
-} TNetworkCommand;
+	TGamePlayer Player; //!< The player being connected, its socket is set to -1 when the slot is free.
+	int Is_WebSocket_Handshake_Done; //!< Set to 1 when a WebSocket client request has been answered.
+	int Is_Unix_Client; //!< Set to 1 if the client connected to the Unix socket, so it can send file descriptors.
+	int Ring_Pair_File_Descriptor; //!< The shared memory sent with the shared memory link hello (-1 if none was received).
+	int Event_File_Descriptor; //!< The eventfd sent with the shared memory link hello (-1 if none was received).
+} TNetworkPendingConnection;
+
+/** A multiplexed link carrying the data of many clients of a bridge. */
+typedef struct
+{
+	int Socket; //!< The link socket, it is set to -1 when the slot is free.
+	unsigned char Received_Bytes[CONFIGURATION_NETWORK_LINK_BUFFER_SIZE]; //!< The received frames not processed yet.
+	int Received_Bytes_Count; //!< How many bytes are stored in Received_Bytes.
+	unsigned char Bytes_To_Send[CONFIGURATION_NETWORK_LINK_BUFFER_SIZE]; //!< The frames to send at the end of the tick.
+	int Bytes_To_Send_Count; //!< How many bytes are stored in Bytes_To_Send.
+	TRingPair *Pointer_Ring_Pair; //!< The rings carrying the frames instead of the socket, NULL if the frames are exchanged on the socket.
+	int Event_File_Descriptor; //!< Written to wake the bridge up when the server has used the rings.
+	int Is_Bridge_Notification_Needed; //!< Set to 1 when the rings have been used since the last bridge wake up.
+} TNetworkLink;
 
 //-------------------------------------------------------------------------------------------------
 // Private variables
 //-------------------------------------------------------------------------------------------------
 /** The server socket. */
 static int Network_Server_Socket;
+/** The WebSocket server socket (-1 if the WebSocket port is disabled). */
+static int Network_WebSocket_Server_Socket = -1;
+/** The Unix server socket (-1 if the Unix socket is disabled). */
+static int Network_Unix_Server_Socket = -1;
+
+/** The clients that are connecting. */
+static TNetworkPendingConnection Network_Pending_Connections[CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT];
+
+/** The multiplexed links. */
+static TNetworkLink Network_Links[CONFIGURATION_MAXIMUM_LINKS_COUNT];
+/** The connected players using a multiplexed link (they are stored by the Game module, so a pointer may refer to a player that has been replaced since). */
+static TGamePlayer *Pointer_Network_Link_Players[CONFIGURATION_MAXIMUM_PLAYERS_COUNT];
 
 //-------------------------------------------------------------------------------------------------
 // Private functions
@@ -40,161 +72,921 @@ static int Network_Server_Socket;
 /** Ignore SIGPIPE signal (sent when the server wants to write to a disconnected client). */
 static void NetworkSignalHandler(int __attribute__((unused)) Signal_ID) {}
 
-//-------------------------------------------------------------------------------------------------
-// Public functions
-//-------------------------------------------------------------------------------------------------
-int NetworkCreateServer(char *String_IP_Address, unsigned short Port)
+/** Create a non-blocking socket listening on the requested IP address and port.
+ * @param String_IP_Address The IP address to bind on.
+ * @param Port The port to bind on.
+ * @return The socket on success,
+ * @return -1 if an error occurred.
+ */
+static int NetworkCreateListeningSocket(char *String_IP_Address, unsigned short Port)
 {
 	struct sockaddr_in Address;
-	int Option_Value = 1;
-	struct sigaction Signal_Action;
+	int Option_Value = 1, Socket;
 	
 	// Try to create the socket
-	Network_Server_Socket = socket(AF_INET, SOCK_STREAM, 0);
-	if (Network_Server_Socket == -1)
+	Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (Socket == -1)
 	{
 		printf("[%s:%d] Error : failed to create the server socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		return 1;
+		return -1;
 	}
 	
 	// Make the socket instantly reusable
-	if (setsockopt(Network_Server_Socket, SOL_SOCKET, SO_REUSEADDR, &Option_Value, sizeof(Option_Value)) == -1)
+	if (setsockopt(Socket, SOL_SOCKET, SO_REUSEADDR, &Option_Value, sizeof(Option_Value)) == -1)
 	{
 		printf("[%s:%d] Error : failed to set the server socket as reusable (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		return 1;
+		close(Socket);
+		return -1;
 	}
 	
 	// Try to bind the server
 	Address.sin_family = AF_INET;
 	Address.sin_port = htons(Port);
 	Address.sin_addr.s_addr = inet_addr(String_IP_Address);
-	if (bind(Network_Server_Socket, (const struct sockaddr *) &Address, sizeof(Address)) == -1)
+	if (bind(Socket, (const struct sockaddr *) &Address, sizeof(Address)) == -1)
 	{
-		printf("[%s:%d] Error : failed to bind the server (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		close(Network_Server_Socket);
-		return 1;
+		printf("[%s:%d] Error : failed to bind the server on port %u (%s).\n", __FUNCTION__, __LINE__, Port, strerror(errno));
+		close(Socket);
+		return -1;
 	}
 	
 	// Tell how many connections to wait for
-	if (listen(Network_Server_Socket, CONFIGURATION_MAXIMUM_PLAYERS_COUNT) == -1)
+	if (listen(Socket, CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT) == -1)
 	{
 		printf("[%s:%d] Error : listen() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		close(Network_Server_Socket);
-		return 1;
+		close(Socket);
+		return -1;
 	}
 	
-	// Catch the SIGPIPE signal, sent when the server writes to a disconnected client
-	Signal_Action.sa_handler = NetworkSignalHandler;
-	sigemptyset(&Signal_Action.sa_mask);
-	Signal_Action.sa_flags = 0;
-	Signal_Action.sa_restorer = NULL;
-	if (sigaction(SIGPIPE, &Signal_Action, NULL) == -1)
+	// Accept all waiting clients without blocking when there are no more
+	if (fcntl(Socket, F_SETFL, fcntl(Socket, F_GETFL) | O_NONBLOCK) == -1)
 	{
-		printf("[%s:%d] Error : failed to register the signal handler (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		close(Network_Server_Socket);
-		return 1;
+		printf("[%s:%d] Error : failed to make the server socket non-blocking (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		close(Socket);
+		return -1;
 	}
 	
-	return 0;
+	return Socket;
+}
+
+/** Create a non-blocking socket listening on a Unix socket path, so that local clients don't go through the TCP stack.
+ * @param String_Path The socket path, an existing file is replaced.
+ * @return The socket on success,
+ * @return -1 if an error occurred.
+ */
+static int NetworkCreateUnixListeningSocket(char *String_Path)
+{
+	struct sockaddr_un Address;
+	int Socket;
+	
+	if (strlen(String_Path) >= sizeof(Address.sun_path))
+	{
+		printf("[%s:%d] Error : the Unix socket path is too long.\n", __FUNCTION__, __LINE__);
+		return -1;
+	}
+	
+	Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (Socket == -1)
+	{
+		printf("[%s:%d] Error : failed to create the Unix server socket (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		return -1;
+	}
+	
+	// Remove the socket file left by a previous server
+	unlink(String_Path);
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	strcpy(Address.sun_path, String_Path);
+	if (bind(Socket, (const struct sockaddr *) &Address, sizeof(Address)) == -1)
+	{
+		printf("[%s:%d] Error : failed to bind the server on Unix socket %s (%s).\n", __FUNCTION__, __LINE__, String_Path, strerror(errno));
+		close(Socket);
+		return -1;
+	}
+	
+	if (listen(Socket, CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT) == -1)
+	{
+		printf("[%s:%d] Error : listen() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		close(Socket);
+		return -1;
+	}
+	
+	return Socket;
 }
 
-int NetworkIsPlayerConnected(int *Pointer_Player_Socket, char *String_Player_Name)
+/** Tell whether a socket has received data (or has been closed) without blocking.
+ * @param Socket The socket to poll.
+ * @return 1 if the socket can be read,
+ * @return 0 if no data is available,
+ * @return -1 if an error occurred.
+ */
+static int NetworkIsSocketReadable(int Socket)
 {
 	int Events_Count;
 	fd_set File_Descriptors_Set;
 	struct timeval Select_Timeout;
-	unsigned char Command_Code;
 	
 	// Create the set of file descriptors (it must created for each call)
 	FD_ZERO(&File_Descriptors_Set);
-	FD_SET(Network_Server_Socket, &File_Descriptors_Set);
+	FD_SET(Socket, &File_Descriptors_Set);
 		
 	// Set the timeout value to zero to make select() instantly return (it must be reset each time too)
 	Select_Timeout.tv_sec = 0;
 	Select_Timeout.tv_usec = 0;
 	
 	// Use select() as it can poll a blocking socket without blocking the program
-	Events_Count = select(Network_Server_Socket + 1, &File_Descriptors_Set, NULL, NULL, &Select_Timeout);
+	Events_Count = select(Socket + 1, &File_Descriptors_Set, NULL, NULL, &Select_Timeout);
 	if (Events_Count == -1)
 	{
 		printf("[%s:%d] Error : select() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		return 0;
+		return -1;
+	}
+	
+	return Events_Count > 0;
+}
+
+/** Append the bytes available on a client socket to the client reception buffer.
+ * @param Pointer_Player The client to receive data from.
+ * @param Is_Decoding_Needed Set to 1 to extract the payload of the WebSocket frames, set to 0 to keep the received bytes as is.
+ * @return 0 on success,
+ * @return 1 if the client disconnected or if an error occurred.
+ */
+static int NetworkReceive(TGamePlayer *Pointer_Player, int Is_Decoding_Needed)
+{
+	unsigned char Frames[CONFIGURATION_NETWORK_RECEPTION_BUFFER_SIZE];
+	int Free_Size, Size;
+	
+	// Leave the data in the socket until the already received bytes are processed
+	Free_Size = sizeof(Pointer_Player->Received_Bytes) - Pointer_Player->Received_Bytes_Count;
+	if (Free_Size == 0) return 0;
+	
+	// The payload is never bigger than the frames, so reading at most the free size makes sure it fits
+	if (Is_Decoding_Needed) Size = read(Pointer_Player->Socket, Frames, Free_Size);
+	else Size = read(Pointer_Player->Socket, &Pointer_Player->Received_Bytes[Pointer_Player->Received_Bytes_Count], Free_Size);
+	if (Size == 0) return 1; // The client disconnected
+	if (Size == -1)
+	{
+		if (errno != ECONNRESET) printf("[%s:%d] Error : failed to receive data from socket %d (%s).\n", __FUNCTION__, __LINE__, Pointer_Player->Socket, strerror(errno));
+		return 1;
+	}
+	
+	// Keep only the frames payload
+	if (Is_Decoding_Needed)
+	{
+		Size = WebSocketDecode(&Pointer_Player->WebSocket_Decoder, Frames, Size, &Pointer_Player->Received_Bytes[Pointer_Player->Received_Bytes_Count], Free_Size);
+		if (Size == -1) return 1;
+	}
+	Pointer_Player->Received_Bytes_Count += Size;
+	
+	return 0;
+}
+
+/** Append the bytes available on a Unix socket client to the client reception buffer, keeping the file descriptors a bridge sends with the shared memory link hello.
+ * @param Pointer_Connection The connecting client.
+ * @return 0 on success,
+ * @return 1 if the client disconnected or if an error occurred.
+ */
+static int NetworkReceiveWithFileDescriptors(TNetworkPendingConnection *Pointer_Connection)
+{
+	TGamePlayer *Pointer_Player = &Pointer_Connection->Player;
+	union
+	{
+		struct cmsghdr Header; // Make sure the buffer is correctly aligned
+		unsigned char Buffer[CMSG_SPACE(2 * sizeof(int))];
+	} Control;
+	struct msghdr Message;
+	struct iovec Vector;
+	struct cmsghdr *Pointer_Control_Message;
+	int Free_Size, Size, File_Descriptors[2], File_Descriptors_Count = 0, i, Is_Hello;
+	
+	Free_Size = sizeof(Pointer_Player->Received_Bytes) - Pointer_Player->Received_Bytes_Count;
+	if (Free_Size == 0) return 0;
+	
+	Vector.iov_base = &Pointer_Player->Received_Bytes[Pointer_Player->Received_Bytes_Count];
+	Vector.iov_len = Free_Size;
+	memset(&Message, 0, sizeof(Message));
+	Message.msg_iov = &Vector;
+	Message.msg_iovlen = 1;
+	Message.msg_control = Control.Buffer;
+	Message.msg_controllen = sizeof(Control.Buffer);
+	
+	Size = recvmsg(Pointer_Player->Socket, &Message, MSG_CMSG_CLOEXEC);
+	if (Size == 0) return 1; // The client disconnected
+	if (Size == -1)
+	{
+		if (errno != ECONNRESET) printf("[%s:%d] Error : failed to receive data from socket %d (%s).\n", __FUNCTION__, __LINE__, Pointer_Player->Socket, strerror(errno));
+		return 1;
+	}
+	
+	// Retrieve the file descriptors (the kernel closes the ones that did not fit in the buffer)
+	for (Pointer_Control_Message = CMSG_FIRSTHDR(&Message); Pointer_Control_Message != NULL; Pointer_Control_Message = CMSG_NXTHDR(&Message, Pointer_Control_Message))
+	{
+		if ((Pointer_Control_Message->cmsg_level != SOL_SOCKET) || (Pointer_Control_Message->cmsg_type != SCM_RIGHTS)) continue;
+		
+		File_Descriptors_Count = (Pointer_Control_Message->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (File_Descriptors_Count > 2) File_Descriptors_Count = 2;
+		memcpy(File_Descriptors, CMSG_DATA(Pointer_Control_Message), File_Descriptors_Count * sizeof(int));
+		break;
+	}
+	
+	// The file descriptors are meaningful only if they come with the hello starting the connection
+	Is_Hello = (Pointer_Player->Received_Bytes_Count == 0) && (Pointer_Player->Received_Bytes[0] == NETWORK_LINK_HELLO_SHARED_MEMORY) && (Pointer_Connection->Ring_Pair_File_Descriptor == -1);
+	if (Is_Hello && (File_Descriptors_Count == 2))
+	{
+		Pointer_Connection->Ring_Pair_File_Descriptor = File_Descriptors[0];
+		Pointer_Connection->Event_File_Descriptor = File_Descriptors[1];
+	}
+	else
+	{
+		for (i = 0; i < File_Descriptors_Count; i++) close(File_Descriptors[i]);
+	}
+	Pointer_Player->Received_Bytes_Count += Size;
+	
+	return 0;
+}
+
+/** Remove the processed bytes from the beginning of a client reception buffer.
+ * @param Pointer_Player The client.
+ * @param Size How many bytes to remove.
+ */
+static void NetworkConsumeReceivedBytes(TGamePlayer *Pointer_Player, int Size)
+{
+	Pointer_Player->Received_Bytes_Count -= Size;
+	memmove(Pointer_Player->Received_Bytes, &Pointer_Player->Received_Bytes[Size], Pointer_Player->Received_Bytes_Count);
+}
+
+/** Close a multiplexed link, disconnecting all its clients.
+ * @param Link_ID The link to close.
+ */
+static void NetworkCloseLink(int Link_ID)
+{
+	int i;
+	TNetworkLink *Pointer_Link = &Network_Links[Link_ID];
+	TGamePlayer *Pointer_Player;
+	
+	close(Pointer_Link->Socket);
+	Pointer_Link->Socket = -1;
+	Pointer_Link->Received_Bytes_Count = 0;
+	Pointer_Link->Bytes_To_Send_Count = 0;
+	if (Pointer_Link->Pointer_Ring_Pair != NULL)
+	{
+		RingPairUnmap(Pointer_Link->Pointer_Ring_Pair);
+		Pointer_Link->Pointer_Ring_Pair = NULL;
+		close(Pointer_Link->Event_File_Descriptor);
+	}
+	
+	// Forget the connecting clients
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++)
+	{
+		Pointer_Player = &Network_Pending_Connections[i].Player;
+		if ((Pointer_Player->Socket != -1) && (Pointer_Player->Link_ID == Link_ID)) Pointer_Player->Socket = -1;
+	}
+	
+	// The connected players will be reported as disconnected
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PLAYERS_COUNT; i++)
+	{
+		Pointer_Player = Pointer_Network_Link_Players[i];
+		if ((Pointer_Player != NULL) && (Pointer_Player->Link_ID == Link_ID)) Pointer_Player->Is_Link_Channel_Closed = 1;
 	}
 	
-	// No client attempted to connect
-	if (Events_Count == 0) return 0;
+	printf("Multiplexed link #%d closed.\n", Link_ID);
+}
+
+/** Send all the frames waiting on a multiplexed link. The link is closed if an error occurs.
+ * @param Link_ID The link.
+ * @return 0 on success,
+ * @return 1 if an error occurred.
+ */
+static int NetworkFlushLink(int Link_ID)
+{
+	TNetworkLink *Pointer_Link = &Network_Links[Link_ID];
+	unsigned long long Event_Value = 1;
+	int Size;
 	
-	// Try to connect the client
-	*Pointer_Player_Socket = accept(Network_Server_Socket, NULL, NULL);
-	if (*Pointer_Player_Socket == -1)
+	// Append the frames to the ring, the frames that don't fit are sent at the next flush
+	if (Pointer_Link->Pointer_Ring_Pair != NULL)
 	{
-		printf("[%s:%d] Error : connect() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		Size = RingWrite(&Pointer_Link->Pointer_Ring_Pair->To_Bridge, Pointer_Link->Bytes_To_Send, Pointer_Link->Bytes_To_Send_Count);
+		if (Size > 0)
+		{
+			Pointer_Link->Bytes_To_Send_Count -= Size;
+			memmove(Pointer_Link->Bytes_To_Send, &Pointer_Link->Bytes_To_Send[Size], Pointer_Link->Bytes_To_Send_Count);
+			Pointer_Link->Is_Bridge_Notification_Needed = 1;
+		}
+		
+		// Wake the bridge up once for all the frames written and read since the last flush
+		if (Pointer_Link->Is_Bridge_Notification_Needed)
+		{
+			if (write(Pointer_Link->Event_File_Descriptor, &Event_Value, sizeof(Event_Value)) != sizeof(Event_Value))
+			{
+				printf("[%s:%d] Error : failed to wake up the bridge of multiplexed link #%d (%s).\n", __FUNCTION__, __LINE__, Link_ID, strerror(errno));
+				NetworkCloseLink(Link_ID);
+				return 1;
+			}
+			Pointer_Link->Is_Bridge_Notification_Needed = 0;
+		}
 		return 0;
 	}
 	
-	// Retrieve the client name
-	// Wait for the command code
-	do
+	if (Pointer_Link->Bytes_To_Send_Count == 0) return 0;
+	
+	// The socket is blocking, so everything is written unless the link is broken
+	if (write(Pointer_Link->Socket, Pointer_Link->Bytes_To_Send, Pointer_Link->Bytes_To_Send_Count) != Pointer_Link->Bytes_To_Send_Count)
+	{
+		printf("[%s:%d] Error : failed to send data on multiplexed link #%d (%s).\n", __FUNCTION__, __LINE__, Link_ID, strerror(errno));
+		NetworkCloseLink(Link_ID);
+		return 1;
+	}
+	Pointer_Link->Bytes_To_Send_Count = 0;
+	
+	return 0;
+}
+
+/** Append a frame to the frames to send on a multiplexed link.
+ * @param Link_ID The link.
+ * @param Channel_ID The channel the frame is for.
+ * @param Frame_Type The frame type.
+ * @param Pointer_Payload The frame payload (it can be NULL if there is no payload).
+ * @param Payload_Size The payload size in bytes, it must not exceed NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE.
+ * @return 0 on success,
+ * @return 1 if the link is closed.
+ */
+static int NetworkQueueLinkFrame(int Link_ID, int Channel_ID, TNetworkLinkFrameType Frame_Type, unsigned char *Pointer_Payload, int Payload_Size)
+{
+	TNetworkLink *Pointer_Link = &Network_Links[Link_ID];
+	unsigned char *Pointer_Frame;
+	
+	if (Pointer_Link->Socket == -1) return 1;
+	
+	// Send the previous frames now if there is not enough room left
+	if (Pointer_Link->Bytes_To_Send_Count + NETWORK_LINK_FRAME_HEADER_SIZE + Payload_Size > (int) sizeof(Pointer_Link->Bytes_To_Send))
 	{
-		if (read(*Pointer_Player_Socket, &Command_Code, 1) != 1)
+		if (NetworkFlushLink(Link_ID) != 0) return 1;
+		
+		// The bridge may not have emptied its ring yet
+		if (Pointer_Link->Bytes_To_Send_Count + NETWORK_LINK_FRAME_HEADER_SIZE + Payload_Size > (int) sizeof(Pointer_Link->Bytes_To_Send))
 		{
-			printf("[%s:%d] Error : failed to read the player name command code (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-			return 0;
+			printf("[%s:%d] Error : multiplexed link #%d is congested.\n", __FUNCTION__, __LINE__, Link_ID);
+			return 1;
 		}
-	} while (Command_Code != NETWORK_COMMAND_CONNECT_TO_SERVER);
+	}
+	
+	Pointer_Frame = &Pointer_Link->Bytes_To_Send[Pointer_Link->Bytes_To_Send_Count];
+	Pointer_Frame[0] = (unsigned char) (Channel_ID >> 8);
+	Pointer_Frame[1] = (unsigned char) Channel_ID;
+	Pointer_Frame[2] = (unsigned char) Frame_Type;
+	Pointer_Frame[3] = (unsigned char) (Payload_Size >> 8);
+	Pointer_Frame[4] = (unsigned char) Payload_Size;
+	if (Payload_Size > 0) memcpy(&Pointer_Frame[NETWORK_LINK_FRAME_HEADER_SIZE], Pointer_Payload, Payload_Size);
+	Pointer_Link->Bytes_To_Send_Count += NETWORK_LINK_FRAME_HEADER_SIZE + Payload_Size;
+	
+	return 0;
+}
+
+/** Find the client using a multiplexed link channel.
+ * @param Link_ID The link.
+ * @param Channel_ID The client channel.
+ * @param Pointer_Is_Connecting On output, tell whether the client is still connecting or is a player.
+ * @return The client,
+ * @return NULL if the channel is not used.
+ */
+static TGamePlayer *NetworkFindLinkChannelPlayer(int Link_ID, int Channel_ID, int *Pointer_Is_Connecting)
+{
+	int i;
+	TGamePlayer *Pointer_Player;
 	
-	// Get the command payload
-	if (read(*Pointer_Player_Socket, String_Player_Name, CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH - 1) < 1)
+	// Is it a connecting client ?
+	*Pointer_Is_Connecting = 1;
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++)
 	{
-		printf("[%s:%d] Error : failed to read the player name (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		return 0;
+		Pointer_Player = &Network_Pending_Connections[i].Player;
+		if ((Pointer_Player->Socket != -1) && (Pointer_Player->Link_ID == Link_ID) && (Pointer_Player->Link_Channel_ID == Channel_ID)) return Pointer_Player;
+	}
+	
+	// Is it a connected player ?
+	*Pointer_Is_Connecting = 0;
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PLAYERS_COUNT; i++)
+	{
+		Pointer_Player = Pointer_Network_Link_Players[i];
+		if ((Pointer_Player != NULL) && (Pointer_Player->Socket != -1) && (Pointer_Player->Link_ID == Link_ID) && (Pointer_Player->Link_Channel_ID == Channel_ID)) return Pointer_Player;
 	}
-	String_Player_Name[CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH - 1] = 0; // Force a terminating zero
+	
+	return NULL;
+}
+
+/** Start connecting a new client of a multiplexed link.
+ * @param Link_ID The link.
+ * @param Channel_ID The new client channel.
+ */
+static void NetworkOpenLinkChannel(int Link_ID, int Channel_ID)
+{
+	int i;
+	TNetworkPendingConnection *Pointer_Connection;
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++)
+	{
+		Pointer_Connection = &Network_Pending_Connections[i];
+		if (Pointer_Connection->Player.Socket != -1) continue;
 		
-	return 1;
+		memset(Pointer_Connection, 0, sizeof(TNetworkPendingConnection));
+		Pointer_Connection->Player.Socket = Network_Links[Link_ID].Socket;
+		Pointer_Connection->Player.Link_ID = Link_ID;
+		Pointer_Connection->Player.Link_Channel_ID = Channel_ID;
+		return;
+	}
+	
+	// Reject the client if there is no room for it
+	printf("[%s:%d] Error : too many connecting clients, rejected channel %d of multiplexed link #%d.\n", __FUNCTION__, __LINE__, Channel_ID, Link_ID);
+	NetworkQueueLinkFrame(Link_ID, Channel_ID, NETWORK_LINK_FRAME_TYPE_CLOSE, NULL, 0);
 }
 
-int NetworkGetEvent(TGamePlayer *Pointer_Player, TNetworkEvent *Pointer_Event)
+/** Dispatch the complete frames received on a multiplexed link to the channels clients.
+ * @param Link_ID The link.
+ */
+static void NetworkProcessLinkFrames(int Link_ID)
 {
-	int Events_Count;
-	fd_set File_Descriptors_Set;
-	struct timeval Select_Timeout;
-	unsigned char Command_Data[2];
+	TNetworkLink *Pointer_Link = &Network_Links[Link_ID];
+	TGamePlayer *Pointer_Player;
+	unsigned char *Pointer_Frame;
+	int Offset = 0, Channel_ID, Frame_Type, Payload_Size, Is_Connecting;
 	
-	// Ignore disconnected players
-	if (Pointer_Player->Socket == -1)
+	while (Pointer_Link->Received_Bytes_Count - Offset >= NETWORK_LINK_FRAME_HEADER_SIZE)
+	{
+		// Decode the header
+		Pointer_Frame = &Pointer_Link->Received_Bytes[Offset];
+		Channel_ID = (Pointer_Frame[0] << 8) | Pointer_Frame[1];
+		Frame_Type = Pointer_Frame[2];
+		Payload_Size = (Pointer_Frame[3] << 8) | Pointer_Frame[4];
+		if (Payload_Size > NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE)
+		{
+			printf("[%s:%d] Error : received a too big frame (%d bytes) on multiplexed link #%d.\n", __FUNCTION__, __LINE__, Payload_Size, Link_ID);
+			NetworkCloseLink(Link_ID);
+			return;
+		}
+		
+		// Wait for the whole payload
+		if (Pointer_Link->Received_Bytes_Count - Offset < NETWORK_LINK_FRAME_HEADER_SIZE + Payload_Size) break;
+		
+		switch (Frame_Type)
+		{
+			case NETWORK_LINK_FRAME_TYPE_OPEN:
+				NetworkOpenLinkChannel(Link_ID, Channel_ID);
+				break;
+				
+			case NETWORK_LINK_FRAME_TYPE_DATA:
+				// The channel may have been closed by the server
+				Pointer_Player = NetworkFindLinkChannelPlayer(Link_ID, Channel_ID, &Is_Connecting);
+				if (Pointer_Player == NULL) break;
+				
+				// A partial payload would cut a command, so close the channel if the payload can never fit
+				if (Payload_Size > (int) sizeof(Pointer_Player->Received_Bytes))
+				{
+					printf("[%s:%d] Error : the %d-byte frame of channel %d of multiplexed link #%d does not fit in the reception buffer, closing the channel.\n", __FUNCTION__, __LINE__, Payload_Size, Channel_ID, Link_ID);
+					NetworkQueueLinkFrame(Link_ID, Channel_ID, NETWORK_LINK_FRAME_TYPE_CLOSE, NULL, 0);
+					if (Is_Connecting) Pointer_Player->Socket = -1;
+					else Pointer_Player->Is_Link_Channel_Closed = 1;
+					break;
+				}
+				
+				// Otherwise leave the frame in the link buffer until the client processed enough bytes, as a direct client data stays in its socket
+				if (Payload_Size > (int) sizeof(Pointer_Player->Received_Bytes) - Pointer_Player->Received_Bytes_Count) goto Exit;
+				
+				memcpy(&Pointer_Player->Received_Bytes[Pointer_Player->Received_Bytes_Count], &Pointer_Frame[NETWORK_LINK_FRAME_HEADER_SIZE], Payload_Size);
+				Pointer_Player->Received_Bytes_Count += Payload_Size;
+				break;
+				
+			case NETWORK_LINK_FRAME_TYPE_CLOSE:
+				Pointer_Player = NetworkFindLinkChannelPlayer(Link_ID, Channel_ID, &Is_Connecting);
+				if (Pointer_Player == NULL) break;
+				
+				// A connecting client can be forgotten right now, a player disconnection is reported by NetworkGetEvent()
+				if (Is_Connecting) Pointer_Player->Socket = -1;
+				else Pointer_Player->Is_Link_Channel_Closed = 1;
+				break;
+				
+			default:
+				printf("[%s:%d] Warning : unknown frame type %d on multiplexed link #%d.\n", __FUNCTION__, __LINE__, Frame_Type, Link_ID);
+				break;
+		}
+		
+		// Rejecting a client may have broken the link
+		if (Pointer_Link->Socket == -1) return;
+		
+		Offset += NETWORK_LINK_FRAME_HEADER_SIZE + Payload_Size;
+	}
+	
+Exit:
+	// Keep the incomplete or postponed frames
+	Pointer_Link->Received_Bytes_Count -= Offset;
+	memmove(Pointer_Link->Received_Bytes, &Pointer_Link->Received_Bytes[Offset], Pointer_Link->Received_Bytes_Count);
+}
+
+/** Tell whether a file descriptor received from a bridge is an eventfd, as writing to anything else could block or corrupt a file.
+ * @param File_Descriptor The file descriptor.
+ * @return 1 if the file descriptor is an eventfd,
+ * @return 0 otherwise.
+ */
+static int NetworkIsEventFileDescriptor(int File_Descriptor)
+{
+	char String_Path[64], String_Target[32];
+	int Size;
+	
+	// An eventfd is an anonymous inode with a well-known name
+	snprintf(String_Path, sizeof(String_Path), "/proc/self/fd/%d", File_Descriptor);
+	Size = readlink(String_Path, String_Target, sizeof(String_Target) - 1);
+	if (Size == -1) return 0;
+	String_Target[Size] = 0;
+	
+	return strcmp(String_Target, "anon_inode:[eventfd]") == 0;
+}
+
+/** Turn a connecting client that sent the link hello into a multiplexed link.
+ * @param Pointer_Connection The connecting client.
+ */
+static void NetworkOpenLink(TNetworkPendingConnection *Pointer_Connection)
+{
+	int i;
+	TNetworkLink *Pointer_Link;
+	TGamePlayer *Pointer_Player = &Pointer_Connection->Player;
+	TRingPair *Pointer_Ring_Pair = NULL;
+	
+	// The mapping stays valid when the shared memory file descriptor is closed
+	if (Pointer_Connection->Ring_Pair_File_Descriptor != -1)
+	{
+		Pointer_Ring_Pair = RingPairMap(Pointer_Connection->Ring_Pair_File_Descriptor);
+		close(Pointer_Connection->Ring_Pair_File_Descriptor);
+		Pointer_Connection->Ring_Pair_File_Descriptor = -1;
+		if (Pointer_Ring_Pair == NULL) goto Exit_Error;
+		
+		if (!NetworkIsEventFileDescriptor(Pointer_Connection->Event_File_Descriptor))
+		{
+			printf("[%s:%d] Error : the bridge did not send an eventfd with the shared memory, rejected the link.\n", __FUNCTION__, __LINE__);
+			goto Exit_Error;
+		}
+	}
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_LINKS_COUNT; i++)
+	{
+		Pointer_Link = &Network_Links[i];
+		if (Pointer_Link->Socket != -1) continue;
+		
+		// The frames that followed the hello byte were received as the client data
+		Pointer_Link->Socket = Pointer_Player->Socket;
+		Pointer_Link->Received_Bytes_Count = Pointer_Player->Received_Bytes_Count - 1;
+		memcpy(Pointer_Link->Received_Bytes, &Pointer_Player->Received_Bytes[1], Pointer_Link->Received_Bytes_Count);
+		Pointer_Link->Bytes_To_Send_Count = 0;
+		Pointer_Link->Pointer_Ring_Pair = Pointer_Ring_Pair;
+		Pointer_Link->Event_File_Descriptor = Pointer_Connection->Event_File_Descriptor;
+		Pointer_Link->Is_Bridge_Notification_Needed = 0;
+		Pointer_Player->Socket = -1;
+		if (Pointer_Ring_Pair != NULL) printf("Multiplexed link #%d opened on shared memory.\n", i);
+		else printf("Multiplexed link #%d opened.\n", i);
+		
+		NetworkProcessLinkFrames(i);
+		return;
+	}
+	
+	printf("[%s:%d] Error : too many multiplexed links, rejected the new one.\n", __FUNCTION__, __LINE__);
+	
+Exit_Error:
+	if (Pointer_Ring_Pair != NULL) RingPairUnmap(Pointer_Ring_Pair);
+	if (Pointer_Connection->Event_File_Descriptor != -1) close(Pointer_Connection->Event_File_Descriptor);
+	close(Pointer_Player->Socket);
+	Pointer_Player->Socket = -1;
+}
+
+/** Send data to a client, embedding it in a WebSocket frame if needed.
+ * @param Pointer_Player The client to send data to.
+ * @param Pointer_Data The data to send.
+ * @param Size The data size in bytes.
+ * @return How many data bytes were sent (like write()),
+ * @return -1 if an error occurred.
+ */
+static int NetworkWrite(TGamePlayer *Pointer_Player, unsigned char *Pointer_Data, int Size)
+{
+	unsigned char Header[WEBSOCKET_MAXIMUM_HEADER_SIZE];
+	struct iovec Vectors[2];
+	int Header_Size, Result, Offset, Frame_Payload_Size;
+	
+	// Queue the data in frames to be sent at the end of the tick
+	if (Pointer_Player->Link_ID != -1)
 	{
-		*Pointer_Event = NETWORK_EVENT_NONE;
+		for (Offset = 0; Offset < Size; Offset += Frame_Payload_Size)
+		{
+			Frame_Payload_Size = Size - Offset;
+			if (Frame_Payload_Size > NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE) Frame_Payload_Size = NETWORK_LINK_MAXIMUM_PAYLOAD_SIZE;
+			
+			if (Pointer_Player->Is_Link_Channel_Closed || (NetworkQueueLinkFrame(Pointer_Player->Link_ID, Pointer_Player->Link_Channel_ID, NETWORK_LINK_FRAME_TYPE_DATA, &Pointer_Data[Offset], Frame_Payload_Size) != 0))
+			{
+				errno = EPIPE; // Handle a closed link like a disconnected client
+				return -1;
+			}
+		}
+		return Size;
+	}
+	
+	if (!Pointer_Player->Is_WebSocket_Client) return write(Pointer_Player->Socket, Pointer_Data, Size);
+	
+	// Send the frame header and the data with a single system call
+	Header_Size = WebSocketEncodeHeader(Header, Size);
+	Vectors[0].iov_base = Header;
+	Vectors[0].iov_len = Header_Size;
+	Vectors[1].iov_base = Pointer_Data;
+	Vectors[1].iov_len = Size;
+	Result = writev(Pointer_Player->Socket, Vectors, 2);
+	if (Result == -1) return -1;
+	
+	return Result - Header_Size;
+}
+
+/** Accept all clients waiting on a listening socket, as long as there are free pending connection slots.
+ * @param Server_Socket The listening socket.
+ * @param Is_WebSocket_Server Set to 1 if the clients are WebSocket clients.
+ * @param Is_Unix_Server Set to 1 if the listening socket is the Unix one.
+ */
+static void NetworkAcceptConnections(int Server_Socket, int Is_WebSocket_Server, int Is_Unix_Server)
+{
+	int i, Socket;
+	TNetworkPendingConnection *Pointer_Connection;
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++)
+	{
+		Pointer_Connection = &Network_Pending_Connections[i];
+		if (Pointer_Connection->Player.Socket != -1) continue;
+		
+		// Try to connect the client (the connected socket is blocking as it does not inherit the listening socket flags)
+		Socket = accept(Server_Socket, NULL, NULL);
+		if (Socket == -1)
+		{
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) printf("[%s:%d] Error : accept() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+			return;
+		}
+		
+		memset(Pointer_Connection, 0, sizeof(TNetworkPendingConnection));
+		Pointer_Connection->Player.Socket = Socket;
+		Pointer_Connection->Player.Is_WebSocket_Client = Is_WebSocket_Server;
+		Pointer_Connection->Player.Link_ID = -1;
+		Pointer_Connection->Is_Unix_Client = Is_Unix_Server;
+		Pointer_Connection->Ring_Pair_File_Descriptor = -1;
+		Pointer_Connection->Event_File_Descriptor = -1;
+		WebSocketInitializeDecoder(&Pointer_Connection->Player.WebSocket_Decoder);
+	}
+}
+
+/** Answer a WebSocket client handshake request when it has been fully received.
+ * @param Pointer_Connection The connecting client.
+ * @return 0 on success or if the request is not complete yet,
+ * @return 1 if the client must be disconnected.
+ */
+static int NetworkProcessWebSocketHandshake(TNetworkPendingConnection *Pointer_Connection)
+{
+	TGamePlayer *Pointer_Player = &Pointer_Connection->Player;
+	char String_Response[256];
+	int Request_Size, Response_Size, Payload_Size;
+	
+	// Wait for the end of the request
+	Request_Size = WebSocketGetRequestSize(Pointer_Player->Received_Bytes, Pointer_Player->Received_Bytes_Count);
+	if (Request_Size == 0)
+	{
+		if (Pointer_Player->Received_Bytes_Count == sizeof(Pointer_Player->Received_Bytes))
+		{
+			printf("[%s:%d] Error : the WebSocket handshake request is too big.\n", __FUNCTION__, __LINE__);
+			return 1;
+		}
 		return 0;
 	}
 	
-	// Create the set of file descriptors (it must created for each call)
-	FD_ZERO(&File_Descriptors_Set);
-	FD_SET(Pointer_Player->Socket, &File_Descriptors_Set);
+	// Switch to the WebSocket protocol
+	if (WebSocketCreateHandshakeResponse(Pointer_Player->Received_Bytes, Request_Size, String_Response, sizeof(String_Response)) != 0) return 1;
+	Response_Size = strlen(String_Response);
+	if (write(Pointer_Player->Socket, String_Response, Response_Size) != Response_Size)
+	{
+		printf("[%s:%d] Error : failed to send the WebSocket handshake response (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		return 1;
+	}
+	Pointer_Connection->Is_WebSocket_Handshake_Done = 1;
+	
+	// Decode the frames the client may have sent right after its request (decoding in place is safe as a frame payload is always smaller than the frame)
+	Payload_Size = WebSocketDecode(&Pointer_Player->WebSocket_Decoder, &Pointer_Player->Received_Bytes[Request_Size], Pointer_Player->Received_Bytes_Count - Request_Size, Pointer_Player->Received_Bytes, sizeof(Pointer_Player->Received_Bytes));
+	if (Payload_Size == -1) return 1;
+	Pointer_Player->Received_Bytes_Count = Payload_Size;
+	
+	return 0;
+}
+
+/** Process the data received from a connecting client.
+ * @param Pointer_Connection The connecting client.
+ * @return 0 if the client has not sent its name yet,
+ * @return 1 if the client sent its name,
+ * @return 2 if the client is a bridge opening a multiplexed link,
+ * @return -1 if the client must be disconnected.
+ */
+static int NetworkProcessPendingConnection(TNetworkPendingConnection *Pointer_Connection)
+{
+	TGamePlayer *Pointer_Player = &Pointer_Connection->Player;
+	int i, Result, Name_Offset, Name_Length;
+	unsigned char Command_Code;
+	int Is_Link_Allowed;
+	
+	// The data of a multiplexed link client is received with the link data
+	if (Pointer_Player->Link_ID == -1)
+	{
+		// Is there something to read ?
+		Result = NetworkIsSocketReadable(Pointer_Player->Socket);
+		if (Result == -1) return -1;
+		if (Result == 0) return 0;
 		
-	// Set the timeout value to zero to make select() instantly return (it must be reset each time too)
-	Select_Timeout.tv_sec = 0;
-	Select_Timeout.tv_usec = 0;
+		// The WebSocket client request must be answered before its frames can be decoded
+		if (Pointer_Connection->Is_Unix_Client) Result = NetworkReceiveWithFileDescriptors(Pointer_Connection);
+		else Result = NetworkReceive(Pointer_Player, Pointer_Player->Is_WebSocket_Client && Pointer_Connection->Is_WebSocket_Handshake_Done);
+		if (Result != 0) return -1;
+		if (Pointer_Player->Is_WebSocket_Client && !Pointer_Connection->Is_WebSocket_Handshake_Done)
+		{
+			if (NetworkProcessWebSocketHandshake(Pointer_Connection) != 0) return -1;
+		}
+	}
 	
-	// Use select() as it can poll a blocking socket without blocking the program
-	Events_Count = select(Pointer_Player->Socket + 1, &File_Descriptors_Set, NULL, NULL, &Select_Timeout);
-	if (Events_Count == -1)
+	// Discard everything preceding the command code (only a bridge directly connected to the server port can open a link)
+	Is_Link_Allowed = (Pointer_Player->Link_ID == -1) && !Pointer_Player->Is_WebSocket_Client;
+	for (i = 0; i < Pointer_Player->Received_Bytes_Count; i++)
 	{
-		printf("[%s:%d] Error : select() failed (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		Command_Code = Pointer_Player->Received_Bytes[i];
+		if ((Command_Code == NETWORK_COMMAND_CONNECT_TO_SERVER) || (Command_Code == NETWORK_COMMAND_CONNECT_TO_SERVER_WITH_CAPABILITIES)) break;
+		if (Is_Link_Allowed && (Command_Code == NETWORK_LINK_HELLO)) break;
+		if (Is_Link_Allowed && (Command_Code == NETWORK_LINK_HELLO_SHARED_MEMORY) && (Pointer_Connection->Ring_Pair_File_Descriptor != -1)) break;
+	}
+	NetworkConsumeReceivedBytes(Pointer_Player, i);
+	if (Pointer_Player->Received_Bytes_Count == 0) return 0;
+	if ((Pointer_Player->Received_Bytes[0] == NETWORK_LINK_HELLO) || (Pointer_Player->Received_Bytes[0] == NETWORK_LINK_HELLO_SHARED_MEMORY)) return 2;
+	
+	// Get the client capabilities if it sent them
+	Command_Code = Pointer_Player->Received_Bytes[0];
+	if (Command_Code == NETWORK_COMMAND_CONNECT_TO_SERVER_WITH_CAPABILITIES) Name_Offset = 2;
+	else Name_Offset = 1;
+	
+	// Wait for the command payload
+	if (Pointer_Player->Received_Bytes_Count <= Name_Offset) return 0;
+	if (Command_Code == NETWORK_COMMAND_CONNECT_TO_SERVER_WITH_CAPABILITIES) Pointer_Player->Capabilities = Pointer_Player->Received_Bytes[1];
+	else Pointer_Player->Capabilities = 0;
+	Pointer_Player->Event_Sequence = 0;
+	
+	// The name has no terminator, so all received bytes are part of it
+	Name_Length = Pointer_Player->Received_Bytes_Count - Name_Offset;
+	if (Name_Length > CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH - 1) Name_Length = CONFIGURATION_MAXIMUM_PLAYER_NAME_LENGTH - 1;
+	memcpy(Pointer_Player->String_Name, &Pointer_Player->Received_Bytes[Name_Offset], Name_Length);
+	Pointer_Player->String_Name[Name_Length] = 0; // Force a terminating zero
+	Pointer_Player->Received_Bytes_Count = 0;
+	
+	return 1;
+}
+
+/** Remember a player connected through a multiplexed link, so the link data can be dispatched to it.
+ * @param Pointer_Player The player.
+ */
+static void NetworkAddLinkPlayer(TGamePlayer *Pointer_Player)
+{
+	int i, Free_Slot_Index = -1;
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PLAYERS_COUNT; i++)
+	{
+		// The player storage is reused
+		if (Pointer_Network_Link_Players[i] == Pointer_Player) return;
+		if ((Free_Slot_Index == -1) && ((Pointer_Network_Link_Players[i] == NULL) || (Pointer_Network_Link_Players[i]->Socket == -1) || (Pointer_Network_Link_Players[i]->Link_ID == -1))) Free_Slot_Index = i;
+	}
+	
+	if (Free_Slot_Index == -1)
+	{
+		printf("[%s:%d] Error : too many multiplexed link players.\n", __FUNCTION__, __LINE__);
+		return;
+	}
+	Pointer_Network_Link_Players[Free_Slot_Index] = Pointer_Player;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int NetworkCreateServer(char *String_IP_Address, unsigned short Port, unsigned short WebSocket_Port, char *String_Unix_Socket_Path)
+{
+	struct sigaction Signal_Action;
+	int i;
+	
+	// Create the server for the native clients
+	Network_Server_Socket = NetworkCreateListeningSocket(String_IP_Address, Port);
+	if (Network_Server_Socket == -1) return 1;
+	
+	// Create the server for the browser clients
+	if (WebSocket_Port != 0)
+	{
+		Network_WebSocket_Server_Socket = NetworkCreateListeningSocket(String_IP_Address, WebSocket_Port);
+		if (Network_WebSocket_Server_Socket == -1)
+		{
+			close(Network_Server_Socket);
+			return 1;
+		}
+	}
+	
+	// Create the server for the clients and bridges running on the same host
+	if (String_Unix_Socket_Path != NULL)
+	{
+		Network_Unix_Server_Socket = NetworkCreateUnixListeningSocket(String_Unix_Socket_Path);
+		if (Network_Unix_Server_Socket == -1)
+		{
+			close(Network_Server_Socket);
+			if (Network_WebSocket_Server_Socket != -1) close(Network_WebSocket_Server_Socket);
+			return 1;
+		}
+	}
+	
+	// Free all pending connection and link slots
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++) Network_Pending_Connections[i].Player.Socket = -1;
+	for (i = 0; i < CONFIGURATION_MAXIMUM_LINKS_COUNT; i++) Network_Links[i].Socket = -1;
+	
+	// Catch the SIGPIPE signal, sent when the server writes to a disconnected client
+	Signal_Action.sa_handler = NetworkSignalHandler;
+	sigemptyset(&Signal_Action.sa_mask);
+	Signal_Action.sa_flags = 0;
+	Signal_Action.sa_restorer = NULL;
+	if (sigaction(SIGPIPE, &Signal_Action, NULL) == -1)
+	{
+		printf("[%s:%d] Error : failed to register the signal handler (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		close(Network_Server_Socket);
+		if (Network_WebSocket_Server_Socket != -1) close(Network_WebSocket_Server_Socket);
+		if (Network_Unix_Server_Socket != -1) close(Network_Unix_Server_Socket);
 		return 1;
 	}
 	
-	// Did the client sent some event ?
-	if (Events_Count == 0)
+	return 0;
+}
+
+int NetworkIsPlayerConnected(TGamePlayer *Pointer_Player)
+{
+	int i, Result;
+	TNetworkPendingConnection *Pointer_Connection;
+	
+	// Accept the new clients of all servers
+	NetworkAcceptConnections(Network_Server_Socket, 0, 0);
+	if (Network_WebSocket_Server_Socket != -1) NetworkAcceptConnections(Network_WebSocket_Server_Socket, 1, 0);
+	if (Network_Unix_Server_Socket != -1) NetworkAcceptConnections(Network_Unix_Server_Socket, 0, 1);
+	
+	// Process the data received from the connecting clients without blocking, so a slow client can't prevent others from connecting
+	for (i = 0; i < CONFIGURATION_MAXIMUM_PENDING_CONNECTIONS_COUNT; i++)
 	{
-		*Pointer_Event = NETWORK_EVENT_NONE;
-		return 0;
+		Pointer_Connection = &Network_Pending_Connections[i];
+		if (Pointer_Connection->Player.Socket == -1) continue;
+		
+		Result = NetworkProcessPendingConnection(Pointer_Connection);
+		if (Result == 1)
+		{
+			// The player is connected, free the pending connection slot
+			memcpy(Pointer_Player, &Pointer_Connection->Player, sizeof(TGamePlayer));
+			Pointer_Connection->Player.Socket = -1;
+			if (Pointer_Player->Link_ID != -1) NetworkAddLinkPlayer(Pointer_Player);
+			return 1;
+		}
+		else if (Result == 2) NetworkOpenLink(Pointer_Connection);
+		else if (Result == -1)
+		{
+			close(Pointer_Connection->Player.Socket);
+			Pointer_Connection->Player.Socket = -1;
+		}
 	}
 	
-	// Get the command
-	if (read(Pointer_Player->Socket, Command_Data, sizeof(Command_Data)) != sizeof(Command_Data))
+	return 0;
+}
+
+int NetworkGetEvent(TGamePlayer *Pointer_Player, TNetworkEvent *Pointer_Event)
+{
+	int Result, Command_Size;
+	
+	*Pointer_Event = NETWORK_EVENT_NONE;
+	
+	// Ignore disconnected players
+	if (Pointer_Player->Socket == -1) return 0;
+	
+	// The command code and the event, followed by the event sequence number if the client predicts its moves
+	if (Pointer_Player->Capabilities & NETWORK_CLIENT_CAPABILITY_EVENT_SEQUENCE) Command_Size = 3;
+	else Command_Size = 2;
+	
+	// Receive new data only when all previously received commands have been processed
+	if (Pointer_Player->Received_Bytes_Count < Command_Size)
 	{
-		if ((errno == 0) || (errno == EBADF) || (errno == ECONNRESET)) // The player disconnected
+		// The data of a multiplexed link client is received by NetworkReceiveLinksData()
+		if (Pointer_Player->Link_ID != -1)
+		{
+			if (Pointer_Player->Is_Link_Channel_Closed)
+			{
+				Pointer_Player->Socket = -1;
+				*Pointer_Event = NETWORK_EVENT_DISCONNECT;
+			}
+			return 0;
+		}
+		
+		// Did the client sent some event ?
+		Result = NetworkIsSocketReadable(Pointer_Player->Socket);
+		if (Result == -1) return 1;
+		if (Result == 0) return 0;
+		
+		if (NetworkReceive(Pointer_Player, Pointer_Player->Is_WebSocket_Client) != 0) // The player disconnected
 		{
 			close(Pointer_Player->Socket);
 			Pointer_Player->Socket = -1;
@@ -202,31 +994,122 @@ int NetworkGetEvent(TGamePlayer *Pointer_Player, TNetworkEvent *Pointer_Event)
 			return 0;
 		}
 		
-		printf("[%s:%d] Error : failed to receive the 'get event' command (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
-		return 1;
+		// Wait for the whole command
+		if (Pointer_Player->Received_Bytes_Count < Command_Size) return 0;
 	}
+	
 	// Retrieve the event content
-	*Pointer_Event = Command_Data[1];
+	*Pointer_Event = Pointer_Player->Received_Bytes[1];
+	if (Command_Size == 3) Pointer_Player->Event_Sequence = Pointer_Player->Received_Bytes[2];
+	NetworkConsumeReceivedBytes(Pointer_Player, Command_Size);
 	
 	return 0;
 }
 
+void NetworkDisconnectPlayer(TGamePlayer *Pointer_Player)
+{
+	if (Pointer_Player->Socket == -1) return;
+	
+	// Only the client channel must be closed, other clients still use the link
+	if (Pointer_Player->Link_ID == -1) close(Pointer_Player->Socket);
+	else if (!Pointer_Player->Is_Link_Channel_Closed) NetworkQueueLinkFrame(Pointer_Player->Link_ID, Pointer_Player->Link_Channel_ID, NETWORK_LINK_FRAME_TYPE_CLOSE, NULL, 0);
+	Pointer_Player->Socket = -1;
+}
+
+int NetworkReceiveLinksData(void)
+{
+	int i, Size, Free_Size, Return_Value = 0;
+	TNetworkLink *Pointer_Link;
+	unsigned char Byte;
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_LINKS_COUNT; i++)
+	{
+		Pointer_Link = &Network_Links[i];
+		if (Pointer_Link->Socket == -1) continue;
+		
+		// Frames postponed because a client reception buffer was full may fit now
+		if (Pointer_Link->Received_Bytes_Count > 0)
+		{
+			NetworkProcessLinkFrames(i);
+			if (Pointer_Link->Socket == -1) continue;
+		}
+		
+		// Leave the data in the socket or the ring until the postponed frames are processed
+		Free_Size = sizeof(Pointer_Link->Received_Bytes) - Pointer_Link->Received_Bytes_Count;
+		if (Free_Size == 0) continue;
+		
+		if (Pointer_Link->Pointer_Ring_Pair != NULL)
+		{
+			// Get the frames without any system call
+			Size = RingRead(&Pointer_Link->Pointer_Ring_Pair->To_Server, &Pointer_Link->Received_Bytes[Pointer_Link->Received_Bytes_Count], Free_Size);
+			if (Size > 0)
+			{
+				// The bridge may be waiting for room in the ring
+				Pointer_Link->Is_Bridge_Notification_Needed = 1;
+				Pointer_Link->Received_Bytes_Count += Size;
+				NetworkProcessLinkFrames(i);
+				continue;
+			}
+			
+			// The bridge sends nothing on the socket, so readable means disconnected
+			Size = recv(Pointer_Link->Socket, &Byte, 1, MSG_DONTWAIT);
+			if ((Size == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) continue;
+			NetworkCloseLink(i);
+			continue;
+		}
+		
+		// Get all the data received since the previous tick without blocking
+		Size = recv(Pointer_Link->Socket, &Pointer_Link->Received_Bytes[Pointer_Link->Received_Bytes_Count], Free_Size, MSG_DONTWAIT);
+		if (Size == -1)
+		{
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) continue;
+			
+			printf("[%s:%d] Error : failed to receive data from multiplexed link #%d (%s).\n", __FUNCTION__, __LINE__, i, strerror(errno));
+			NetworkCloseLink(i);
+			Return_Value = 1;
+			continue;
+		}
+		
+		// The bridge disconnected
+		if (Size == 0)
+		{
+			NetworkCloseLink(i);
+			continue;
+		}
+		
+		Pointer_Link->Received_Bytes_Count += Size;
+		NetworkProcessLinkFrames(i);
+	}
+	
+	return Return_Value;
+}
+
+int NetworkSendLinksData(void)
+{
+	int i, Return_Value = 0;
+	
+	for (i = 0; i < CONFIGURATION_MAXIMUM_LINKS_COUNT; i++)
+	{
+		if (Network_Links[i].Socket == -1) continue;
+		if (NetworkFlushLink(i) != 0) Return_Value = 1;
+	}
+	
+	return Return_Value;
+}
+
 int NetworkSendCommandDrawTile(TGamePlayer *Pointer_Player, int Tile_ID, int Row, int Column)
 {
 	int Result;
-	unsigned char Command_Data[4];
+	unsigned char Command_Data[NETWORK_COMMAND_DRAW_TILE_SIZE];
 	
 	// Ignore disconnected players
 	if (Pointer_Player->Socket == -1) return 0;
 	
 	// Prepare the command
-	Command_Data[0] = NETWORK_COMMAND_DRAW_TILE;
-	Command_Data[1] = (unsigned char) Tile_ID;
-	Command_Data[2] = (unsigned char) Row;
-	Command_Data[3] = (unsigned char) Column;
+	NetworkEncodeCommandDrawTile(Command_Data, Tile_ID, Row, Column);
 	
 	// Send the command
-	Result = write(Pointer_Player->Socket, Command_Data, sizeof(Command_Data));
+	Result = NetworkWrite(Pointer_Player, Command_Data, sizeof(Command_Data));
 	if ((Result == -1) && (errno == EPIPE)) GameRemoveDisconnectedPlayer(Pointer_Player);
 	else if (Result != sizeof(Command_Data))
 	{
@@ -237,6 +1120,63 @@ int NetworkSendCommandDrawTile(TGamePlayer *Pointer_Player, int Tile_ID, int Row
 	return 0;
 }
 
+int NetworkEncodeCommandDrawTile(unsigned char *Pointer_Buffer, int Tile_ID, int Row, int Column)
+{
+	Pointer_Buffer[0] = NETWORK_COMMAND_DRAW_TILE;
+	Pointer_Buffer[1] = (unsigned char) Tile_ID;
+	Pointer_Buffer[2] = (unsigned char) Row;
+	Pointer_Buffer[3] = (unsigned char) Column;
+	
+	return NETWORK_COMMAND_DRAW_TILE_SIZE;
+}
+
+int NetworkEncodeCommandLoadMap(unsigned char *Pointer_Buffer, int Map_ID, unsigned int Map_Hash, unsigned char *Pointer_Obstacles_Bitmap)
+{
+	Pointer_Buffer[0] = NETWORK_COMMAND_LOAD_MAP;
+	Pointer_Buffer[1] = (unsigned char) Map_ID;
+	
+	// Send the hash in big endian
+	Pointer_Buffer[2] = (unsigned char) (Map_Hash >> 24);
+	Pointer_Buffer[3] = (unsigned char) (Map_Hash >> 16);
+	Pointer_Buffer[4] = (unsigned char) (Map_Hash >> 8);
+	Pointer_Buffer[5] = (unsigned char) Map_Hash;
+	
+	memcpy(&Pointer_Buffer[6], Pointer_Obstacles_Bitmap, NETWORK_MAP_OBSTACLES_BITMAP_SIZE);
+	
+	return NETWORK_COMMAND_LOAD_MAP_SIZE;
+}
+
+int NetworkSendCommands(TGamePlayer *Pointer_Player, unsigned char *Pointer_Commands, int Size)
+{
+	int Result;
+	
+	// Ignore disconnected players
+	if (Pointer_Player->Socket == -1) return 0;
+	
+	// Send all commands at once
+	Result = NetworkWrite(Pointer_Player, Pointer_Commands, Size);
+	if ((Result == -1) && (errno == EPIPE)) GameRemoveDisconnectedPlayer(Pointer_Player);
+	else if (Result != Size)
+	{
+		printf("[%s:%d] Error : failed to send %d bytes of commands (%s).\n", __FUNCTION__, __LINE__, Size, strerror(errno));
+		return 1;
+	}
+	
+	return 0;
+}
+
+int NetworkSendCommandAcknowledgeEvent(TGamePlayer *Pointer_Player, int Row, int Column)
+{
+	unsigned char Command_Data[NETWORK_COMMAND_ACKNOWLEDGE_EVENT_SIZE];
+	
+	Command_Data[0] = NETWORK_COMMAND_ACKNOWLEDGE_EVENT;
+	Command_Data[1] = Pointer_Player->Event_Sequence;
+	Command_Data[2] = (unsigned char) Row;
+	Command_Data[3] = (unsigned char) Column;
+	
+	return NetworkSendCommands(Pointer_Player, Command_Data, sizeof(Command_Data));
+}
+
 int NetworkSendCommandDrawText(TGamePlayer *Pointer_Player, char *String_Text)
 {
 	unsigned char Command_Data[2 + CONFIGURATION_COMMAND_DRAW_TEXT_MESSAGE_MAXIMUM_SIZE];
@@ -254,7 +1194,7 @@ int NetworkSendCommandDrawText(TGamePlayer *Pointer_Player, char *String_Text)
 	
 	// Send the command
 	Command_Size = 2 + Text_Size; // Compute the command total size in bytes
-	Result = write(Pointer_Player->Socket, Command_Data, Command_Size);
+	Result = NetworkWrite(Pointer_Player, Command_Data, Command_Size);
 	if ((Result == -1) && (errno == EPIPE)) GameRemoveDisconnectedPlayer(Pointer_Player);
 	else if (Result != Command_Size)
 	{
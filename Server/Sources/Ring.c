@@ -0,0 +1,145 @@
+/** @file Ring.c
+ * @see Ring.h for description.
+ * @author Adrien RICCIARDI
+ */
+
+// memfd_create() is a GNU extension
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <Ring.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Copy data to or from the ring buffer, handling the buffer end.
+ * @param Pointer_Ring_Buffer The ring buffer.
+ * @param Index The ring index to start from.
+ * @param Pointer_Data The data to copy to the ring, or the buffer receiving the ring data.
+ * @param Size How many bytes to copy.
+ * @param Is_Writing Set to 1 to copy to the ring, set to 0 to copy from the ring.
+ */
+static void RingCopy(unsigned char *Pointer_Ring_Buffer, unsigned int Index, unsigned char *Pointer_Data, int Size, int Is_Writing)
+{
+	int Offset, First_Part_Size;
+
+	Offset = Index & (RING_BUFFER_SIZE - 1);
+	First_Part_Size = RING_BUFFER_SIZE - Offset;
+	if (First_Part_Size > Size) First_Part_Size = Size;
+
+	if (Is_Writing)
+	{
+		memcpy(&Pointer_Ring_Buffer[Offset], Pointer_Data, First_Part_Size);
+		memcpy(Pointer_Ring_Buffer, &Pointer_Data[First_Part_Size], Size - First_Part_Size);
+	}
+	else
+	{
+		memcpy(Pointer_Data, &Pointer_Ring_Buffer[Offset], First_Part_Size);
+		memcpy(&Pointer_Data[First_Part_Size], Pointer_Ring_Buffer, Size - First_Part_Size);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+TRingPair *RingPairCreate(int *Pointer_File_Descriptor)
+{
+	TRingPair *Pointer_Ring_Pair;
+
+	// Create an anonymous file that can be shared through a Unix socket
+	*Pointer_File_Descriptor = memfd_create("bomberbox-rings", MFD_CLOEXEC);
+	if (*Pointer_File_Descriptor == -1)
+	{
+		printf("[%s:%d] Error : failed to create the shared memory (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		return NULL;
+	}
+
+	if (ftruncate(*Pointer_File_Descriptor, sizeof(TRingPair)) == -1)
+	{
+		printf("[%s:%d] Error : failed to set the shared memory size (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		close(*Pointer_File_Descriptor);
+		return NULL;
+	}
+
+	// The file is filled with zeros, so the rings are empty
+	Pointer_Ring_Pair = RingPairMap(*Pointer_File_Descriptor);
+	if (Pointer_Ring_Pair == NULL) close(*Pointer_File_Descriptor);
+
+	return Pointer_Ring_Pair;
+}
+
+TRingPair *RingPairMap(int File_Descriptor)
+{
+	TRingPair *Pointer_Ring_Pair;
+	struct stat Status;
+
+	// Accessing a mapping beyond the end of a shorter file would raise SIGBUS
+	if (fstat(File_Descriptor, &Status) == -1)
+	{
+		printf("[%s:%d] Error : failed to get the shared memory size (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		return NULL;
+	}
+	if (!S_ISREG(Status.st_mode) || (Status.st_size < (off_t) sizeof(TRingPair)))
+	{
+		printf("[%s:%d] Error : the shared memory is not a file of at least %d bytes.\n", __FUNCTION__, __LINE__, (int) sizeof(TRingPair));
+		return NULL;
+	}
+
+	Pointer_Ring_Pair = mmap(NULL, sizeof(TRingPair), PROT_READ | PROT_WRITE, MAP_SHARED, File_Descriptor, 0);
+	if (Pointer_Ring_Pair == MAP_FAILED)
+	{
+		printf("[%s:%d] Error : failed to map the shared memory (%s).\n", __FUNCTION__, __LINE__, strerror(errno));
+		return NULL;
+	}
+
+	return Pointer_Ring_Pair;
+}
+
+void RingPairUnmap(TRingPair *Pointer_Ring_Pair)
+{
+	munmap(Pointer_Ring_Pair, sizeof(TRingPair));
+}
+
+int RingWrite(TRing *Pointer_Ring, void *Pointer_Data, int Size)
+{
+	unsigned int Write_Index, Read_Index;
+	int Free_Size;
+
+	// The consumer may be reading concurrently, the acquire barrier makes sure its reads are done before the space is reused
+	Write_Index = Pointer_Ring->Write_Index;
+	Read_Index = __atomic_load_n(&Pointer_Ring->Read_Index, __ATOMIC_ACQUIRE);
+	Free_Size = RING_BUFFER_SIZE - (Write_Index - Read_Index);
+	if (Size > Free_Size) Size = Free_Size;
+	if (Size == 0) return 0;
+
+	// Publish the index only when the data is written
+	RingCopy(Pointer_Ring->Buffer, Write_Index, Pointer_Data, Size, 1);
+	__atomic_store_n(&Pointer_Ring->Write_Index, Write_Index + Size, __ATOMIC_RELEASE);
+
+	return Size;
+}
+
+int RingRead(TRing *Pointer_Ring, void *Pointer_Buffer, int Buffer_Size)
+{
+	unsigned int Write_Index, Read_Index;
+	int Size;
+
+	Read_Index = Pointer_Ring->Read_Index;
+	Write_Index = __atomic_load_n(&Pointer_Ring->Write_Index, __ATOMIC_ACQUIRE);
+	Size = Write_Index - Read_Index;
+	if (Size > Buffer_Size) Size = Buffer_Size;
+	if (Size == 0) return 0;
+
+	// Free the space only when the data is read
+	RingCopy(Pointer_Ring->Buffer, Read_Index, Pointer_Buffer, Size, 0);
+	__atomic_store_n(&Pointer_Ring->Read_Index, Read_Index + Size, __ATOMIC_RELEASE);
+
+	return Size;
+}
@@ -0,0 +1,255 @@
+/** @file WebSocket.c
+ * @see WebSocket.h for description.
+ * @author Adrien RICCIARDI
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <cWebSockets.h>
+#include <WebSocket.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The longest client key that is accepted (a valid key is 24 characters long). */
+#define WEBSOCKET_MAXIMUM_KEY_LENGTH 64
+
+/** A frame is the last fragment of a message. */
+#define WEBSOCKET_FRAME_FLAG_FINAL 0x80
+/** A frame payload is masked. */
+#define WEBSOCKET_FRAME_FLAG_MASKED 0x80
+
+/** All opcodes starting from this one are control frames. */
+#define WEBSOCKET_OPCODE_FIRST_CONTROL_FRAME 0x08
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Retrieve the value of a request header field.
+ * @param Pointer_Request The request.
+ * @param Request_Size The request size in bytes.
+ * @param String_Field_Name The header field name (case does not matter).
+ * @param String_Value On output, contain the field value without the surrounding spaces.
+ * @param Value_Buffer_Size The value buffer size in bytes.
+ * @return 0 if the field was found,
+ * @return 1 if the field was not found or if its value is too long.
+ */
+static int WebSocketGetHeaderFieldValue(unsigned char *Pointer_Request, int Request_Size, char *String_Field_Name, char *String_Value, int Value_Buffer_Size)
+{
+	int i, Name_Length, Value_Length;
+
+	Name_Length = strlen(String_Field_Name);
+
+	// Fields start at the beginning of a line
+	for (i = 0; i < Request_Size - Name_Length - 1; i++)
+	{
+		if (Pointer_Request[i] != '\n') continue;
+		if ((strncasecmp((char *) &Pointer_Request[i + 1], String_Field_Name, Name_Length) != 0) || (Pointer_Request[i + 1 + Name_Length] != ':')) continue;
+
+		// Skip the spaces preceding the value
+		i += Name_Length + 2;
+		while ((i < Request_Size) && ((Pointer_Request[i] == ' ') || (Pointer_Request[i] == '\t'))) i++;
+
+		// Copy the value until the end of the line
+		Value_Length = 0;
+		while ((i < Request_Size) && (Pointer_Request[i] != '\r') && (Pointer_Request[i] != '\n'))
+		{
+			if (Value_Length >= Value_Buffer_Size - 1) return 1;
+			String_Value[Value_Length] = Pointer_Request[i];
+			Value_Length++;
+			i++;
+		}
+
+		// Remove trailing spaces
+		while ((Value_Length > 0) && ((String_Value[Value_Length - 1] == ' ') || (String_Value[Value_Length - 1] == '\t'))) Value_Length--;
+		String_Value[Value_Length] = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int WebSocketGetRequestSize(unsigned char *Pointer_Request, int Size)
+{
+	int i;
+
+	// The request ends with an empty line
+	for (i = 3; i < Size; i++)
+	{
+		if ((Pointer_Request[i - 3] == '\r') && (Pointer_Request[i - 2] == '\n') && (Pointer_Request[i - 1] == '\r') && (Pointer_Request[i] == '\n')) return i + 1;
+	}
+
+	return 0;
+}
+
+int WebSocketCreateHandshakeResponse(unsigned char *Pointer_Request, int Request_Size, char *String_Response, int Response_Buffer_Size)
+{
+	char String_Value[WEBSOCKET_MAXIMUM_KEY_LENGTH + 1], String_Accept_Key[WEBSOCKET_ACCEPT_KEY_SIZE];
+	int Result;
+
+	// Only GET requests can be upgraded
+	if ((Request_Size < 4) || (memcmp(Pointer_Request, "GET ", 4) != 0))
+	{
+		printf("[%s:%d] Error : the request is not a GET request.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+
+	// The client must ask for the WebSocket protocol
+	if ((WebSocketGetHeaderFieldValue(Pointer_Request, Request_Size, "Upgrade", String_Value, sizeof(String_Value)) != 0) || (strcasecmp(String_Value, "websocket") != 0))
+	{
+		printf("[%s:%d] Error : the request is not a WebSocket upgrade request.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+
+	// Only the RFC 6455 version is supported
+	if ((WebSocketGetHeaderFieldValue(Pointer_Request, Request_Size, "Sec-WebSocket-Version", String_Value, sizeof(String_Value)) != 0) || (strcmp(String_Value, "13") != 0))
+	{
+		printf("[%s:%d] Error : unsupported WebSocket protocol version.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+
+	// Compute the accept key from the client key, with the same code as the bridge so both WebSocket endpoints always agree
+	if ((WebSocketGetHeaderFieldValue(Pointer_Request, Request_Size, "Sec-WebSocket-Key", String_Value, sizeof(String_Value)) != 0) || (String_Value[0] == 0))
+	{
+		printf("[%s:%d] Error : the request WebSocket key is missing or invalid.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+	if (WEBSOCKET_accept_key(String_Value, strlen(String_Value), String_Accept_Key) != 0)
+	{
+		printf("[%s:%d] Error : failed to compute the WebSocket accept key.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+
+	Result = snprintf(String_Response, Response_Buffer_Size, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", String_Accept_Key);
+	if ((Result < 0) || (Result >= Response_Buffer_Size))
+	{
+		printf("[%s:%d] Error : the response buffer is too small.\n", __FUNCTION__, __LINE__);
+		return 1;
+	}
+
+	return 0;
+}
+
+void WebSocketInitializeDecoder(TWebSocketDecoder *Pointer_Decoder)
+{
+	memset(Pointer_Decoder, 0, sizeof(TWebSocketDecoder));
+}
+
+int WebSocketDecode(TWebSocketDecoder *Pointer_Decoder, unsigned char *Pointer_Data, int Size, unsigned char *Pointer_Payload, int Payload_Buffer_Size)
+{
+	int i = 0, Payload_Size = 0, Expected_Header_Size, Length, j;
+	unsigned char Byte;
+
+	while (i < Size)
+	{
+		if (!Pointer_Decoder->Is_Receiving_Payload)
+		{
+			Pointer_Decoder->Header[Pointer_Decoder->Header_Size] = Pointer_Data[i];
+			Pointer_Decoder->Header_Size++;
+			i++;
+			if (Pointer_Decoder->Header_Size < 2) continue;
+
+			// Clients must mask their frames
+			if (!(Pointer_Decoder->Header[1] & WEBSOCKET_FRAME_FLAG_MASKED))
+			{
+				printf("[%s:%d] Error : received an unmasked frame.\n", __FUNCTION__, __LINE__);
+				return -1;
+			}
+
+			// Wait for the extended length and the masking key
+			Length = Pointer_Decoder->Header[1] & 0x7F;
+			if (Length == 126) Expected_Header_Size = 2 + 2 + 4;
+			else if (Length == 127) Expected_Header_Size = 2 + 8 + 4;
+			else Expected_Header_Size = 2 + 4;
+			if (Pointer_Decoder->Header_Size < Expected_Header_Size) continue;
+
+			// The header is complete
+			Pointer_Decoder->Opcode = Pointer_Decoder->Header[0] & 0x0F;
+			if ((Pointer_Decoder->Opcode > WEBSOCKET_OPCODE_BINARY) && (Pointer_Decoder->Opcode < WEBSOCKET_OPCODE_FIRST_CONTROL_FRAME))
+			{
+				printf("[%s:%d] Error : received a frame with the reserved opcode %d.\n", __FUNCTION__, __LINE__, Pointer_Decoder->Opcode);
+				return -1;
+			}
+			if (Length == 126) Pointer_Decoder->Remaining_Payload_Size = (Pointer_Decoder->Header[2] << 8) | Pointer_Decoder->Header[3];
+			else if (Length == 127)
+			{
+				Pointer_Decoder->Remaining_Payload_Size = 0;
+				for (j = 2; j < 10; j++) Pointer_Decoder->Remaining_Payload_Size = (Pointer_Decoder->Remaining_Payload_Size << 8) | Pointer_Decoder->Header[j];
+			}
+			else Pointer_Decoder->Remaining_Payload_Size = Length;
+			memcpy(Pointer_Decoder->Mask, &Pointer_Decoder->Header[Expected_Header_Size - 4], sizeof(Pointer_Decoder->Mask));
+			Pointer_Decoder->Payload_Offset = 0;
+			Pointer_Decoder->Header_Size = 0;
+			Pointer_Decoder->Is_Receiving_Payload = 1;
+		}
+		else
+		{
+			// Unmask the payload, keeping only the data frames content
+			while ((i < Size) && (Pointer_Decoder->Remaining_Payload_Size > 0))
+			{
+				Byte = Pointer_Data[i] ^ Pointer_Decoder->Mask[Pointer_Decoder->Payload_Offset & 3];
+				if (Pointer_Decoder->Opcode < WEBSOCKET_OPCODE_FIRST_CONTROL_FRAME)
+				{
+					// Dropping bytes would cut a command, so the caller must never read more frame bytes than it can store
+					if (Payload_Size >= Payload_Buffer_Size)
+					{
+						printf("[%s:%d] Error : the payload does not fit in the %d-byte buffer.\n", __FUNCTION__, __LINE__, Payload_Buffer_Size);
+						return -1;
+					}
+					Pointer_Payload[Payload_Size] = Byte;
+					Payload_Size++;
+				}
+				Pointer_Decoder->Payload_Offset++;
+				Pointer_Decoder->Remaining_Payload_Size--;
+				i++;
+			}
+		}
+
+		// Wait for the next frame when the current one is complete
+		if (Pointer_Decoder->Is_Receiving_Payload && (Pointer_Decoder->Remaining_Payload_Size == 0))
+		{
+			// The client wants to disconnect (other control frames like ping are not sent by browsers and can be ignored)
+			if (Pointer_Decoder->Opcode == WEBSOCKET_OPCODE_CLOSE) return -1;
+			Pointer_Decoder->Is_Receiving_Payload = 0;
+		}
+	}
+
+	return Payload_Size;
+}
+
+int WebSocketEncodeHeader(unsigned char *Pointer_Header, int Payload_Size)
+{
+	Pointer_Header[0] = WEBSOCKET_FRAME_FLAG_FINAL | WEBSOCKET_OPCODE_BINARY;
+
+	// Short payload length fits in the second byte
+	if (Payload_Size < 126)
+	{
+		Pointer_Header[1] = (unsigned char) Payload_Size;
+		return 2;
+	}
+
+	// Use a 16-bit extended length
+	if (Payload_Size < 65536)
+	{
+		Pointer_Header[1] = 126;
+		Pointer_Header[2] = (unsigned char) (Payload_Size >> 8);
+		Pointer_Header[3] = (unsigned char) Payload_Size;
+		return 4;
+	}
+
+	// Use a 64-bit extended length
+	Pointer_Header[1] = 127;
+	Pointer_Header[2] = 0;
+	Pointer_Header[3] = 0;
+	Pointer_Header[4] = 0;
+	Pointer_Header[5] = 0;
+	Pointer_Header[6] = (unsigned char) (Payload_Size >> 24);
+	Pointer_Header[7] = (unsigned char) (Payload_Size >> 16);
+	Pointer_Header[8] = (unsigned char) (Payload_Size >> 8);
+	Pointer_Header[9] = (unsigned char) Payload_Size;
+	return 10;
+}
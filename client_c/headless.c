@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------
+// INCLUDES
+//--------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+
+#include "network.h"
+#include "map.h"
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+#define HEADLESS_MAX_SCRIPT_INPUTS  1024
+
+/** a random player drops a bomb once every this many inputs, in average **/
+#define HEADLESS_BOMB_PERIOD        8
+
+//--------------------------------------------------------------------
+// PRIVATE DEFINITIONS
+//--------------------------------------------------------------------
+/** what was received and sent since the start **/
+struct _headless_stats {
+    unsigned long bytes;
+    unsigned long commands;
+    unsigned long tiles;
+    unsigned long texts;
+    unsigned long maps;
+    unsigned long acknowledges;
+    unsigned long inputs;
+};
+
+//--------------------------------------------------------------------
+// PRIVATE VARIABLES
+//--------------------------------------------------------------------
+static struct _headless_stats stats;
+
+/** inputs played in a loop, random ones if empty **/
+static uint8_t script[HEADLESS_MAX_SCRIPT_INPUTS];
+static int script_length;
+
+static uint8_t next_sequence = 1;
+static int verbose;
+static volatile sig_atomic_t stop;
+
+//--------------------------------------------------------------------
+// PRIVATE API
+//--------------------------------------------------------------------
+void _headless_signal(int signal_number)
+{
+    (void) signal_number;
+    stop = 1;
+}
+
+//--------------------------------------------------------------------
+uint64_t _headless_now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+//--------------------------------------------------------------------
+/** read a script : one input per word (up, down, left, right, bomb or wait) **/
+int _headless_load_script(const char * path)
+{
+    FILE * file;
+    char word[16];
+
+    file = fopen(path, "r");
+    if ( ! file ) {
+        perror(path);
+        return -1;
+    }
+
+    while ( script_length < HEADLESS_MAX_SCRIPT_INPUTS && fscanf(file, "%15s", word) == 1 ) {
+        if ( ! strcmp(word, "up") ) {
+            script[script_length++] = NW_COMMAND_INPUT_UP;
+        } else if ( ! strcmp(word, "down") ) {
+            script[script_length++] = NW_COMMAND_INPUT_DOWN;
+        } else if ( ! strcmp(word, "left") ) {
+            script[script_length++] = NW_COMMAND_INPUT_LEFT;
+        } else if ( ! strcmp(word, "right") ) {
+            script[script_length++] = NW_COMMAND_INPUT_RIGHT;
+        } else if ( ! strcmp(word, "bomb") ) {
+            script[script_length++] = NW_COMMAND_INPUT_SPACE;
+        } else if ( ! strcmp(word, "wait") ) {
+            script[script_length++] = 0;
+        } else {
+            fprintf(stderr, "%s: unknown input %s\n", path, word);
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    if ( ! script_length ) {
+        fprintf(stderr, "%s: no input\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------
+/** send the next scripted or random input, 0 means no input **/
+int _headless_send_input(void)
+{
+    static int script_index;
+    uint8_t data[2];
+
+    if ( script_length ) {
+        data[0] = script[script_index];
+        script_index = (script_index + 1) % script_length;
+    } else if ( rand() % HEADLESS_BOMB_PERIOD == 0 ) {
+        // also the ready key before the round starts
+        data[0] = NW_COMMAND_INPUT_SPACE;
+    } else {
+        data[0] = NW_COMMAND_INPUT_UP + rand() % 4;
+    }
+
+    if ( ! data[0] ) {
+        return 0;
+    }
+
+    data[1] = next_sequence++;
+    stats.inputs++;
+    return nw_send_command(NW_COMMAND_INPUT, data, sizeof(data)) < 0 ? -1 : 0;
+}
+
+//--------------------------------------------------------------------
+/** count all the complete commands received **/
+void _headless_process_actions(void)
+{
+    nw_action_t action;
+    uint8_t tiles[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT], data[2];
+
+    while ( nw_get_action(&action) > 0 ) {
+        stats.commands++;
+
+        switch (action.type) {
+            case NW_ACTION_DISPLAY_TILE:
+                stats.tiles++;
+                break;
+            case NW_ACTION_DISPLAY_STR:
+                stats.texts++;
+                if ( verbose ) {
+                    printf("%s\n", (char *)action.data);
+                }
+                break;
+            case NW_ACTION_LOAD_MAP:
+                stats.maps++;
+                // same as the graphical client : every tile is needed if the map is not in the pack
+                if ( map_build(action.data, tiles) ) {
+                    data[0] = NW_COMMAND_INPUT_REQUEST_MAP;
+                    data[1] = next_sequence++;
+                    nw_send_command(NW_COMMAND_INPUT, data, sizeof(data));
+                }
+                break;
+            case NW_ACTION_ACKNOWLEDGE_INPUT:
+                stats.acknowledges++;
+                break;
+        }
+    }
+}
+
+//--------------------------------------------------------------------
+void _headless_print_stats(uint64_t elapsed_ms)
+{
+    printf("%.1f s : %lu bytes, %lu commands (%lu tiles, %lu texts, %lu maps, %lu acknowledges), %lu inputs sent\n",
+           elapsed_ms / 1000.0, stats.bytes, stats.commands, stats.tiles, stats.texts, stats.maps,
+           stats.acknowledges, stats.inputs);
+    fflush(stdout);
+}
+
+//--------------------------------------------------------------------
+void _headless_usage(const char * program)
+{
+    fprintf(stderr, "usage : %s [-s script] [-i inputs_per_second] [-t seconds] [-r report_seconds] [-m] [-v] ip port name\n", program);
+    fprintf(stderr, "  -s script : play the inputs of this file in a loop (up, down, left, right, bomb or wait words), random inputs by default\n");
+    fprintf(stderr, "  -i inputs_per_second : input rate (default 5, 0 to only receive)\n");
+    fprintf(stderr, "  -t seconds : exit after this time (default 0, run until the server disconnects)\n");
+    fprintf(stderr, "  -r report_seconds : print the counters periodically (default 0, only at exit)\n");
+    fprintf(stderr, "  -m : build the map from the maps/ pack, as the graphical client\n");
+    fprintf(stderr, "  -v : print the texts sent by the server\n");
+    exit(1);
+}
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int option, rc, timeout, input_rate = 5, duration = 0, report_period = 0, map_cache = 0;
+    uint64_t start, now, next_input, next_report;
+    uint8_t connect_data[1 + 254];
+    struct pollfd fds;
+
+    while ( (option = getopt(argc, argv, "s:i:t:r:mv")) != -1 ) {
+        switch (option) {
+            case 's':
+                if ( _headless_load_script(optarg) ) {
+                    exit(1);
+                }
+                break;
+            case 'i':
+                input_rate = atoi(optarg);
+                break;
+            case 't':
+                duration = atoi(optarg);
+                break;
+            case 'r':
+                report_period = atoi(optarg);
+                break;
+            case 'm':
+                map_cache = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                _headless_usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind < 3 || input_rate < 0 || input_rate > 1000 || duration < 0 || report_period < 0 ) {
+        _headless_usage(argv[0]);
+    }
+
+    signal(SIGINT, _headless_signal);
+    signal(SIGTERM, _headless_signal);
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL) ^ getpid());
+
+    rc = nw_connect(argv[optind], argv[optind + 1]);
+    if ( rc ) {
+        fprintf(stderr, "cannot connect to server %s:%d\n", argv[optind], atoi(argv[optind + 1]));
+        exit(1);
+    }
+
+    // the inputs are sent with a sequence number, as the graphical client does
+    connect_data[0] = NW_CAPABILITY_INPUT_SEQUENCE;
+    if ( map_cache ) {
+        if ( map_load_pack("maps/") <= 0 ) {
+            fprintf(stderr, "cannot load the maps/ pack\n");
+            exit(1);
+        }
+        connect_data[0] |= NW_CAPABILITY_MAP_CACHE;
+    }
+    strncpy((char *)&connect_data[1], argv[optind + 2], sizeof(connect_data) - 1);
+    nw_send_command(NW_COMMAND_CONNECT_WITH_CAPABILITIES, connect_data, 1 + strnlen(argv[optind + 2], sizeof(connect_data) - 1));
+
+    start = _headless_now_ms();
+    next_input = 0;
+    next_report = start + report_period * 1000;
+    fds.fd = nw_get_fd();
+    fds.events = POLLIN;
+
+    while ( ! stop ) {
+        now = _headless_now_ms();
+        if ( duration && now - start >= (uint64_t)duration * 1000 ) {
+            break;
+        }
+
+        // the connect command has no length, so no input is sent until the server answered it
+        if ( input_rate && ! next_input && stats.commands ) {
+            next_input = now;
+        }
+
+        if ( input_rate && next_input && now >= next_input ) {
+            if ( _headless_send_input() ) {
+                break;
+            }
+            next_input += 1000 / input_rate;
+        }
+
+        if ( report_period && now >= next_report ) {
+            _headless_print_stats(now - start);
+            next_report += report_period * 1000;
+        }
+
+        // sleep until the server sends something or the next input
+        timeout = -1;
+        if ( input_rate && next_input ) {
+            timeout = next_input > now ? next_input - now : 0;
+        }
+        if ( report_period && (timeout < 0 || next_report - now < (uint64_t)timeout) ) {
+            timeout = next_report > now ? next_report - now : 0;
+        }
+        if ( duration && (timeout < 0 || start + duration * 1000 - now < (uint64_t)timeout) ) {
+            timeout = start + duration * 1000 - now;
+        }
+
+        rc = poll(&fds, 1, timeout);
+        if ( rc < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if ( ! rc ) {
+            continue;
+        }
+
+        rc = nw_receive();
+        if ( rc < 0 ) {
+            break;
+        }
+        stats.bytes += rc;
+        _headless_process_actions();
+    }
+
+    _headless_print_stats(_headless_now_ms() - start);
+    return 0;
+}
@@ -5,38 +5,50 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/types.h>
+#include <poll.h>
 
 #include "ui.h"
 #include "network.h"
+#include "map.h"
+#include "predict.h"
+
+/** event check period when the window events can not be waited for **/
+#define GAME_EVENT_POLL_PERIOD_MS 10
 
 //--------------------------------------------------------------------
 // PRIVATE API
+//--------------------------------------------------------------------
+/** send an input with its sequence number, the player move is predicted until the server acknowledges it **/
+int _game_send_input(uint8_t input)
+{
+    uint8_t data[2];
+
+    data[0] = input;
+    data[1] = predict_input(input);
+
+    return nw_send_command(NW_COMMAND_INPUT, data, sizeof(data));
+}
+
 //--------------------------------------------------------------------
 int _game_keyboard_ingame(ui_keyboard_value_t value)
 {
     int rc = 0;
-    uint8_t data;
 
     switch(value) {
         case UI_KEYBOARD_UP:
-            data = NW_COMMAND_INPUT_UP;
-            rc = nw_send_command(NW_COMMAND_INPUT, &data, 1);
+            rc = _game_send_input(NW_COMMAND_INPUT_UP);
             break;
         case UI_KEYBOARD_DOWN:
-            data = NW_COMMAND_INPUT_DOWN;
-            rc = nw_send_command(NW_COMMAND_INPUT, &data, 1);
+            rc = _game_send_input(NW_COMMAND_INPUT_DOWN);
             break;
         case UI_KEYBOARD_LEFT:
-            data = NW_COMMAND_INPUT_LEFT;
-            rc = nw_send_command(NW_COMMAND_INPUT, &data, 1);
+            rc = _game_send_input(NW_COMMAND_INPUT_LEFT);
             break;
         case UI_KEYBOARD_RIGHT:
-            data = NW_COMMAND_INPUT_RIGHT;
-            rc = nw_send_command(NW_COMMAND_INPUT, &data, 1);
+            rc = _game_send_input(NW_COMMAND_INPUT_RIGHT);
             break;
         case UI_KEYBOARD_SPACE:
-            data = NW_COMMAND_INPUT_SPACE;
-            rc = nw_send_command(NW_COMMAND_INPUT, &data, 1);
+            rc = _game_send_input(NW_COMMAND_INPUT_SPACE);
             break;
         case UI_KEYBOARD_ESCAPE:
             // TODO: currently dirty exit
@@ -49,19 +61,77 @@ int _game_keyboard_ingame(ui_keyboard_value_t value)
     return rc;
 }
 
+//--------------------------------------------------------------------
+void _game_load_map(const uint8_t * load_message)
+{
+    int row, column;
+    uint8_t tiles[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT];
+
+    // map not in the pack or modified : ask the server for every tile
+    if ( map_build(load_message, tiles) ) {
+        _game_send_input(NW_COMMAND_INPUT_REQUEST_MAP);
+        return;
+    }
+
+    for ( row = 0; row < MAP_ROWS_COUNT; row++ ) {
+        for ( column = 0; column < MAP_COLUMNS_COUNT; column++ ) {
+            predict_tile(tiles[row][column], row, column);
+            ui_tile(tiles[row][column], 25 + column * 32, 87 + row * 32);
+        }
+    }
+}
+
+//--------------------------------------------------------------------
+/** show why the game stopped until the user presses escape or closes the window **/
+void _game_wait_quit(char * text, struct pollfd * ui_fds, int ui_nfds)
+{
+    int timeout;
+    ui_event_t event;
+
+    ui_text(text);
+    while (1) {
+        ui_present();
+
+        while ( ui_event(&event) > 0 ) {
+            if ( event.type == UI_EVENT_WINDOW ||
+                 ( event.type == UI_EVENT_KEYBOARD && event.value == UI_KEYBOARD_ESCAPE ) ) {
+                return;
+            }
+        }
+
+        timeout = ui_frame_delay();
+        if ( ! ui_nfds && ( timeout < 0 || timeout > GAME_EVENT_POLL_PERIOD_MS ) ) {
+            timeout = GAME_EVENT_POLL_PERIOD_MS;
+        }
+        if ( poll(ui_fds, ui_nfds, timeout) < 0 && errno != EINTR ) {
+            perror("poll");
+            return;
+        }
+    }
+}
+
 //--------------------------------------------------------------------
 int game_process(void)
 {
-    int rc;
+    struct pollfd fds[2];
+    int nfds, timeout, rc;
     ui_event_t event;
     nw_action_t action;
 
+    // sleep until the server sends something or the window gets an event
+    fds[0].events = POLLIN;
+    fds[1].fd = ui_get_fd();
+    fds[1].events = POLLIN;
+    nfds = fds[1].fd >= 0 ? 2 : 1;
+
     while (1) {
-        // process user interface
-        rc = ui_event(&event);
-        if ( rc > 0 ) {
+        // show what was drawn, at most once per display refresh
+        ui_present();
+
+        // process user interface, drawing above may have queued window events
+        while ( ui_event(&event) > 0 ) {
             if ( event.type == UI_EVENT_KEYBOARD ) {
-                // process keyboard event
+                // process keyboard event, the input is sent at once
                 _game_keyboard_ingame(event.value);
             } else if ( event.type == UI_EVENT_WINDOW ) {
                 if ( event.value == UI_WINDOW_ESCAPE ) {
@@ -71,18 +141,45 @@ int game_process(void)
             }
         }
 
-        // process server commands
+        // receive everything the server sent, then process all complete commands, they are drawn in the same frame
+        rc = nw_receive();
         memset(&action, 0,sizeof(nw_action_t));
-        rc = nw_get_action(&action);
-        if ( rc > 0 ) {
+        while ( nw_get_action(&action) > 0 ) {
             if ( action.type == NW_ACTION_DISPLAY_TILE ) {
-                ui_tile(action.data[0], 25 + action.data[2] * 32, 87 + action.data[1] * 32);
+                if ( predict_tile(action.data[0], action.data[1], action.data[2]) ) {
+                    ui_tile(action.data[0], 25 + action.data[2] * 32, 87 + action.data[1] * 32);
+                }
             } else if ( action.type == NW_ACTION_DISPLAY_STR ) {
                 ui_text(action.data);
+            } else if ( action.type == NW_ACTION_LOAD_MAP ) {
+                _game_load_map(action.data);
+            } else if ( action.type == NW_ACTION_ACKNOWLEDGE_INPUT ) {
+                predict_acknowledge(action.data[0], action.data[1], action.data[2]);
             }
+            memset(&action, 0,sizeof(nw_action_t));
+        }
+
+        // draw the player where the inputs sent move it, or back where the server says it is
+        predict_draw();
+
+        // the last commands are shown with the reason, nothing more can be received
+        if ( rc < 0 ) {
+            _game_wait_quit("Connection to the server lost, press Escape to quit.", &fds[1], nfds - 1);
+            return -1;
+        }
+
+        // wake up for the next frame only when something is waiting to be shown
+        timeout = ui_frame_delay();
+        if ( nfds == 1 && ( timeout < 0 || timeout > GAME_EVENT_POLL_PERIOD_MS ) ) {
+            // no window connection to wait on, check the events regularly
+            timeout = GAME_EVENT_POLL_PERIOD_MS;
         }
 
-        usleep(100);
+        fds[0].fd = nw_get_fd();
+        if ( poll(fds, nfds, timeout) < 0 && errno != EINTR ) {
+            perror("poll");
+            return -1;
+        }
     }
 }
 
@@ -92,6 +189,7 @@ int game_process(void)
 int main(int argc, const char *argv[])
 {
     int rc, fd;
+    uint8_t connect_data[1 + 254];
 
     if ( argc < 4 ) {
         fprintf(stderr, "usage : %s ip port name\n", argv[0]);
@@ -111,7 +209,13 @@ int main(int argc, const char *argv[])
     }
     
     // TODO: must be done as a part of game process
-    rc = nw_send_command(NW_COMMAND_CONNECT, (char *)argv[3], strlen(argv[3]));
+    // the player moves are predicted, and the server can send the map id instead of every tile
+    connect_data[0] = NW_CAPABILITY_INPUT_SEQUENCE;
+    if ( map_load_pack("maps/") > 0 ) {
+        connect_data[0] |= NW_CAPABILITY_MAP_CACHE;
+    }
+    strncpy((char *)&connect_data[1], argv[3], sizeof(connect_data) - 1);
+    rc = nw_send_command(NW_COMMAND_CONNECT_WITH_CAPABILITIES, connect_data, 1 + strnlen(argv[3], sizeof(connect_data) - 1));
 
     rc = game_process();
 
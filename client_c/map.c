@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------
+// INCLUDES
+//--------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+#define MAP_HASH_OFFSET_BASIS   2166136261U
+#define MAP_HASH_PRIME          16777619U
+
+#define MAP_TILE_EMPTY          0x0
+#define MAP_TILE_WALL           0x1
+#define MAP_TILE_OBSTACLE       0x2
+
+//--------------------------------------------------------------------
+// PRIVATE DEFINITIONS
+//--------------------------------------------------------------------
+/** must be in the same order than the server CONFIGURATION_MAP_FILE_NAMES **/
+static const char * map_file_names[] = {
+    "test.txt",
+    "test2.txt",
+};
+
+#define MAP_COUNT   (sizeof(map_file_names) / sizeof(map_file_names[0]))
+
+struct _map {
+    int loaded;
+    uint32_t hash;
+    char cells[MAP_ROWS_COUNT * MAP_COLUMNS_COUNT];
+};
+
+//--------------------------------------------------------------------
+// PRIVATE VARIABLES
+//--------------------------------------------------------------------
+static struct _map maps[MAP_COUNT];
+
+//--------------------------------------------------------------------
+// PRIVATE API
+//--------------------------------------------------------------------
+int _load_map(const char * file_path, struct _map * map)
+{
+    FILE * file;
+    int c, i = 0;
+
+    file = fopen(file_path, "r");
+    if ( ! file ) {
+        return -1;
+    }
+
+    // same hash than the server : every cell character, new lines skipped
+    map->hash = MAP_HASH_OFFSET_BASIS;
+    while ( i < MAP_ROWS_COUNT * MAP_COLUMNS_COUNT && (c = fgetc(file)) != EOF ) {
+        if ( c == '\n' ) {
+            continue;
+        }
+        map->cells[i++] = c;
+        map->hash = (map->hash ^ (uint8_t)c) * MAP_HASH_PRIME;
+    }
+    fclose(file);
+
+    if ( i != MAP_ROWS_COUNT * MAP_COLUMNS_COUNT ) {
+        return -1;
+    }
+
+    map->loaded = 1;
+    return 0;
+}
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+int map_load_pack(const char * path)
+{
+    unsigned int i;
+    int count = 0;
+    char file_path[256];
+
+    for ( i = 0; i < MAP_COUNT; i++ ) {
+        snprintf(file_path, sizeof(file_path), "%s%s", path, map_file_names[i]);
+        if ( _load_map(file_path, &maps[i]) ) {
+            fprintf(stderr, "cannot load map %s, it will be downloaded\n", file_path);
+            continue;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+//--------------------------------------------------------------------
+int map_build(const uint8_t * load_message, uint8_t tiles[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT])
+{
+    uint8_t id;
+    uint32_t hash;
+    const uint8_t * bitmap;
+    int row, column, i = 0;
+
+    // sanity check
+    if ( ! load_message || ! tiles ) {
+        return -1;
+    }
+
+    id = load_message[0];
+    hash = ((uint32_t)load_message[1] << 24) | ((uint32_t)load_message[2] << 16)
+         | ((uint32_t)load_message[3] << 8) | load_message[4];
+    bitmap = &load_message[5];
+
+    // unknown or different map : the whole map must be requested
+    if ( id >= MAP_COUNT || ! maps[id].loaded || maps[id].hash != hash ) {
+        return -1;
+    }
+
+    for ( row = 0; row < MAP_ROWS_COUNT; row++ ) {
+        for ( column = 0; column < MAP_COLUMNS_COUNT; column++, i++ ) {
+            if ( maps[id].cells[i] == 'W' ) {
+                tiles[row][column] = MAP_TILE_WALL;
+            } else if ( bitmap[i / 8] & (1 << (i % 8)) ) {
+                tiles[row][column] = MAP_TILE_OBSTACLE;
+            } else {
+                tiles[row][column] = MAP_TILE_EMPTY;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#include <stdint.h>
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+#define MAP_ROWS_COUNT      15
+#define MAP_COLUMNS_COUNT   20
+
+#define MAP_OBSTACLES_BITMAP_SIZE   (((MAP_ROWS_COUNT * MAP_COLUMNS_COUNT) + 7) / 8)
+
+/** load map message : map id, 32-bit map hash, obstacles bitmap **/
+#define MAP_LOAD_MESSAGE_SIZE   (1 + 4 + MAP_OBSTACLES_BITMAP_SIZE)
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+int map_load_pack(const char * path);
+int map_build(const uint8_t * load_message, uint8_t tiles[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT]);
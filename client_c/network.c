@@ -7,11 +7,15 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "network.h"
 
 #define NW_COMMAND_BUFFER_SIZE  255
 
+/** received data waiting to be decoded, must be a power of two **/
+#define NW_RX_BUFFER_SIZE       65536
+
 /** server message definition **/
 struct _nw_message {
     uint8_t cmd;
@@ -24,13 +28,39 @@ typedef struct _nw_message nw_message_t;
 //--------------------------------------------------------------------
 static int sockfd;
 
+/** receive ring : indexes always increase and are wrapped on access **/
+static uint8_t rx_buffer[NW_RX_BUFFER_SIZE];
+static unsigned int rx_head;    // next byte written by nw_receive()
+static unsigned int rx_tail;    // next byte decoded by nw_get_action()
+static int rx_closed;
+
+//--------------------------------------------------------------------
+// PRIVATE API
+//--------------------------------------------------------------------
+/** copy received bytes, starting offset bytes after the first undecoded one **/
+static void _nw_rx_copy(void * dst, unsigned int offset, unsigned int size)
+{
+    unsigned int start, first_part;
+
+    start = (rx_tail + offset) & (NW_RX_BUFFER_SIZE - 1);
+    first_part = NW_RX_BUFFER_SIZE - start;
+    if ( first_part > size ) {
+        first_part = size;
+    }
+
+    memcpy(dst, &rx_buffer[start], first_part);
+    memcpy((uint8_t *)dst + first_part, rx_buffer, size - first_part);
+}
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+
 //--------------------------------------------------------------------
 int nw_connect(const char * server_addr, const char * server_port)
 {
-    int numbytes;  
     struct addrinfo hints, *servinfo, *p;
     int rv;
-    char s[INET6_ADDRSTRLEN];
 
     if ( ! server_addr || ! server_port) {
         fprintf(stderr,"usage: client hostname\n");
@@ -73,6 +103,17 @@ int nw_connect(const char * server_addr, const char * server_port)
     return 0;
 }
 
+//--------------------------------------------------------------------
+int nw_get_fd(void)
+{
+    // -1 once the connection is over, poll() then ignores it
+    if ( rx_closed ) {
+        return -1;
+    }
+
+    return sockfd;
+}
+
 //--------------------------------------------------------------------
 int nw_send_command(nw_command_type_t type, void * data, size_t size)
 {
@@ -84,17 +125,22 @@ int nw_send_command(nw_command_type_t type, void * data, size_t size)
         return -1;
     }
 
-    if ( type == NW_COMMAND_CONNECT ) {
+    if ( type == NW_COMMAND_CONNECT || type == NW_COMMAND_CONNECT_WITH_CAPABILITIES ) {
         if ( size > NW_COMMAND_BUFFER_SIZE )
             size = NW_COMMAND_BUFFER_SIZE ;
 
-        msg.cmd = NW_COMMAND_CONNECT;
+        // capabilities byte, if any, is the first data byte
+        msg.cmd = type;
         memcpy(msg.buffer, data, size);
         ++size; // add command size
     } else if ( type == NW_COMMAND_INPUT ) {
+        // the input, followed by its sequence number if any
+        if ( size > 2 )
+            size = 2;
+
         msg.cmd = NW_COMMAND_INPUT;
-        msg.buffer[0] = ((uint8_t*)data)[0];
-        size = 2;
+        memcpy(msg.buffer, data, size);
+        ++size; // add command size
     }
 
     rc = send(sockfd, (char *)&msg, size, 0);
@@ -106,37 +152,114 @@ int nw_send_command(nw_command_type_t type, void * data, size_t size)
 }
 
 //--------------------------------------------------------------------
-int nw_get_action(nw_action_t * action)
+int nw_receive(void)
 {
-    uint8_t len;
+    struct iovec iov[2];
+    struct msghdr msg;
+    unsigned int offset, free_size;
     int numbytes;
 
-    // sanity check
-    if ( ! action ) {
+    if ( rx_closed ) {
         return -1;
     }
 
-    numbytes = recv(sockfd, &action->type, 1, MSG_DONTWAIT);
-    if ( numbytes <= 0 ) {
-        if ( errno == EINVAL || errno == EWOULDBLOCK ) {
+    // the commands already received must be decoded first
+    free_size = NW_RX_BUFFER_SIZE - (rx_head - rx_tail);
+    if ( ! free_size ) {
+        return 0;
+    }
+
+    // fill all the free space at once, it may wrap at the buffer end
+    offset = rx_head & (NW_RX_BUFFER_SIZE - 1);
+    iov[0].iov_base = &rx_buffer[offset];
+    iov[0].iov_len = NW_RX_BUFFER_SIZE - offset;
+    if ( iov[0].iov_len > free_size ) {
+        iov[0].iov_len = free_size;
+    }
+    iov[1].iov_base = rx_buffer;
+    iov[1].iov_len = free_size - iov[0].iov_len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+
+    numbytes = recvmsg(sockfd, &msg, MSG_DONTWAIT);
+    if ( numbytes < 0 ) {
+        if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) {
             return 0;
         }
 
         perror("recv");
+        rx_closed = 1;
+        return -1;
+    }
+
+    if ( ! numbytes ) {
+        fprintf(stderr, "server closed the connection\n");
+        rx_closed = 1;
+        return -1;
+    }
+
+    rx_head += numbytes;
+    return numbytes;
+}
+
+//--------------------------------------------------------------------
+int nw_get_action(nw_action_t * action)
+{
+    unsigned int available, size;
+    uint8_t len;
+
+    // sanity check
+    if ( ! action ) {
         return -1;
     }
-  
+
+    available = rx_head - rx_tail;
+    if ( ! available ) {
+        return 0;
+    }
+
+    // size of the command, type included, and wait until it is complete
+    _nw_rx_copy(&action->type, 0, 1);
     switch(action->type) {
         case NW_ACTION_DISPLAY_TILE:
-            recv(sockfd, &action->data[0], 3, 0);
+            size = 1 + 3;
             break;
         case NW_ACTION_DISPLAY_STR:
-            recv(sockfd, &len, 1, 0);
-            recv(sockfd, &action->data[0], len, 0);
+            if ( available < 2 ) {
+                return 0;
+            }
+            _nw_rx_copy(&len, 1, 1);
+            size = 2 + len;
+            break;
+        case NW_ACTION_LOAD_MAP:
+            size = 1 + NW_ACTION_LOAD_MAP_SIZE;
+            break;
+        case NW_ACTION_ACKNOWLEDGE_INPUT:
+            size = 1 + NW_ACTION_ACKNOWLEDGE_INPUT_SIZE;
             break;
         default:
+            // the stream can't be decoded any more
+            fprintf(stderr, "unknown server command %d\n", action->type);
             return -1;
     }
 
+    if ( available < size ) {
+        return 0;
+    }
+
+    if ( action->type == NW_ACTION_DISPLAY_STR ) {
+        // the text is null-terminated, and cut if it does not fit
+        if ( len > NW_ACTION_DATA_SIZE - 1 ) {
+            len = NW_ACTION_DATA_SIZE - 1;
+        }
+        _nw_rx_copy(&action->data[0], 2, len);
+        action->data[len] = 0;
+    } else {
+        _nw_rx_copy(&action->data[0], 1, size - 1);
+    }
+
+    rx_tail += size;
     return 1;
 }
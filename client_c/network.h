@@ -1,10 +1,22 @@
 #define NW_ACTION_DATA_SIZE 254
 
+/** load map action : map id, 32-bit map hash, obstacles bitmap **/
+#define NW_ACTION_LOAD_MAP_SIZE 43
+
+/** acknowledge input action : input sequence number, player row and column **/
+#define NW_ACTION_ACKNOWLEDGE_INPUT_SIZE 3
+
+/** client capabilities sent with NW_COMMAND_CONNECT_WITH_CAPABILITIES **/
+#define NW_CAPABILITY_MAP_CACHE 0x01
+#define NW_CAPABILITY_INPUT_SEQUENCE 0x02   // inputs are followed by a sequence number, and acknowledged
+
 
 /** client command definition **/
 enum _nw_action_type {
     NW_ACTION_DISPLAY_TILE    =   0x0,
     NW_ACTION_DISPLAY_STR     =   0x1,
+    NW_ACTION_LOAD_MAP        =   0x5,
+    NW_ACTION_ACKNOWLEDGE_INPUT =   0x6,
 };
 typedef enum _nw_action_type nw_action_type_t;
 
@@ -20,6 +32,7 @@ typedef struct _nw_action nw_action_t;
 enum _nw_command_type {
     NW_COMMAND_CONNECT =   0x2,
     NW_COMMAND_INPUT   =   0x3,
+    NW_COMMAND_CONNECT_WITH_CAPABILITIES = 0x4,
 };
 typedef enum _nw_command_type nw_command_type_t;
 
@@ -30,9 +43,12 @@ enum _nw_cmd_input_value {
     NW_COMMAND_INPUT_RIGHT,
     NW_COMMAND_INPUT_SPACE,
     NW_COMMAND_INPUT_ESCAPE,
+    NW_COMMAND_INPUT_REQUEST_MAP,
 };
 typedef enum _ui_cmd_input_value ui_cmd_input_value_t;
 
+int nw_get_fd(void);
+int nw_receive(void);
 int nw_get_action(nw_action_t * action);
 int nw_connect(const char * server_addr, const char * server_port);
 int nw_send_command(nw_command_type_t type, void * data, size_t size);
@@ -0,0 +1,265 @@
+//--------------------------------------------------------------------
+// INCLUDES
+//--------------------------------------------------------------------
+#include <string.h>
+
+#include "predict.h"
+#include "network.h"
+#include "map.h"
+#include "ui.h"
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+/** tiles sent by the server, see the server TGameTileID **/
+#define PREDICT_TILE_EMPTY          0x0
+#define PREDICT_TILE_WALL           0x1
+#define PREDICT_TILE_OBSTACLE       0x2
+#define PREDICT_TILE_CURRENT_PLAYER 0x3
+#define PREDICT_TILE_OTHER_PLAYER   0x4
+#define PREDICT_TILE_BOMB           0x5
+#define PREDICT_TILE_SHIELD         0x7
+
+/** what is drawn on top of a cell background **/
+#define PREDICT_OVERLAY_OTHER_PLAYER    0x1
+#define PREDICT_OVERLAY_SHIELD          0x2
+
+/** inputs sent but not acknowledged yet, the server handles one per tick **/
+#define PREDICT_MAX_PENDING 64
+
+/** map location on the screen **/
+#define PREDICT_SCREEN_X(column)    (25 + (column) * 32)
+#define PREDICT_SCREEN_Y(row)       (87 + (row) * 32)
+
+//--------------------------------------------------------------------
+// PRIVATE DEFINITIONS
+//--------------------------------------------------------------------
+struct _predict_input {
+    uint8_t sequence;
+    uint8_t input;
+};
+
+struct _predict_context {
+    // the map as drawn by the server, without the player
+    uint8_t background[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT];
+    uint8_t overlay[MAP_ROWS_COUNT][MAP_COLUMNS_COUNT];
+
+    // player location acknowledged by the server, row is -1 when not on the map
+    int server_row;
+    int server_column;
+    int shield;
+
+    // player location drawn, row is -1 when not drawn
+    int shown_row;
+    int shown_column;
+    int redraw;
+
+    // a shield drawn right after the player is the player one
+    int last_tile_player;
+
+    uint8_t next_sequence;
+    struct _predict_input pending[PREDICT_MAX_PENDING];
+    int pending_count;
+};
+
+//--------------------------------------------------------------------
+// PRIVATE VARIABLES
+//--------------------------------------------------------------------
+static struct _predict_context ctx = {
+    .server_row = -1,
+    .shown_row = -1,
+    .next_sequence = 1,     // the server acknowledges 0 before it received any input
+};
+
+//--------------------------------------------------------------------
+// PRIVATE API
+//--------------------------------------------------------------------
+/** same rules than the server GameIsPlayerMoveAllowed() **/
+int _predict_is_move_allowed(int row, int column)
+{
+    uint8_t tid;
+
+    // the player can't cross the map borders
+    if ( row < 0 || row >= MAP_ROWS_COUNT || column < 0 || column >= MAP_COLUMNS_COUNT ) {
+        return 0;
+    }
+
+    // neither the walls, the destructible obstacles and the bombs
+    tid = ctx.background[row][column];
+    if ( tid == PREDICT_TILE_WALL || tid == PREDICT_TILE_OBSTACLE || tid == PREDICT_TILE_BOMB ) {
+        return 0;
+    }
+
+    return 1;
+}
+
+//--------------------------------------------------------------------
+/** replay the inputs not acknowledged yet from the server location **/
+void _predict_location(int * row, int * column)
+{
+    int i, next_row, next_column;
+
+    *row = ctx.server_row;
+    *column = ctx.server_column;
+    if ( *row < 0 ) {
+        return;
+    }
+
+    for ( i = 0; i < ctx.pending_count; i++ ) {
+        next_row = *row;
+        next_column = *column;
+
+        switch (ctx.pending[i].input) {
+            case NW_COMMAND_INPUT_UP:
+                next_row--;
+                break;
+            case NW_COMMAND_INPUT_DOWN:
+                next_row++;
+                break;
+            case NW_COMMAND_INPUT_LEFT:
+                next_column--;
+                break;
+            case NW_COMMAND_INPUT_RIGHT:
+                next_column++;
+                break;
+            default:
+                continue;
+        }
+
+        if ( _predict_is_move_allowed(next_row, next_column) ) {
+            *row = next_row;
+            *column = next_column;
+        }
+    }
+}
+
+//--------------------------------------------------------------------
+/** draw a cell as the server did, once the player left it **/
+void _predict_restore_cell(int row, int column)
+{
+    int x = PREDICT_SCREEN_X(column), y = PREDICT_SCREEN_Y(row);
+
+    ui_tile(ctx.background[row][column], x, y);
+    if ( ctx.overlay[row][column] & PREDICT_OVERLAY_OTHER_PLAYER ) {
+        ui_tile(PREDICT_TILE_OTHER_PLAYER, x, y);
+    }
+    if ( ctx.overlay[row][column] & PREDICT_OVERLAY_SHIELD ) {
+        ui_tile(PREDICT_TILE_SHIELD, x, y);
+    }
+}
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+uint8_t predict_input(uint8_t input)
+{
+    uint8_t sequence = ctx.next_sequence++;
+
+    // only the moves of a player on the map are predicted
+    if ( ctx.server_row < 0 ) {
+        return sequence;
+    }
+
+    // the oldest input is lost, the server location will be right at the next acknowledge
+    if ( ctx.pending_count == PREDICT_MAX_PENDING ) {
+        memmove(&ctx.pending[0], &ctx.pending[1], (PREDICT_MAX_PENDING - 1) * sizeof(struct _predict_input));
+        ctx.pending_count--;
+    }
+
+    ctx.pending[ctx.pending_count].sequence = sequence;
+    ctx.pending[ctx.pending_count].input = input;
+    ctx.pending_count++;
+
+    return sequence;
+}
+
+//--------------------------------------------------------------------
+int predict_tile(int tid, int row, int column)
+{
+    // the player is drawn at the predicted location by predict_draw()
+    if ( tid == PREDICT_TILE_CURRENT_PLAYER ) {
+        ctx.last_tile_player = 1;
+        ctx.shield = 0;
+        ctx.redraw = 1;
+        return 0;
+    }
+
+    if ( tid == PREDICT_TILE_SHIELD && ctx.last_tile_player ) {
+        ctx.last_tile_player = 0;
+        ctx.shield = 1;
+        return 0;
+    }
+    ctx.last_tile_player = 0;
+
+    if ( row < 0 || row >= MAP_ROWS_COUNT || column < 0 || column >= MAP_COLUMNS_COUNT ) {
+        return 1;
+    }
+
+    // the server draws the players and their shield over the cell content
+    if ( tid == PREDICT_TILE_OTHER_PLAYER ) {
+        ctx.overlay[row][column] |= PREDICT_OVERLAY_OTHER_PLAYER;
+    } else if ( tid == PREDICT_TILE_SHIELD ) {
+        ctx.overlay[row][column] |= PREDICT_OVERLAY_SHIELD;
+    } else {
+        ctx.background[row][column] = tid;
+        ctx.overlay[row][column] = 0;
+    }
+
+    // the player drawn here must be drawn again on top
+    if ( row == ctx.shown_row && column == ctx.shown_column ) {
+        ctx.redraw = 1;
+    }
+
+    return 1;
+}
+
+//--------------------------------------------------------------------
+void predict_acknowledge(uint8_t sequence, uint8_t row, uint8_t column)
+{
+    int i;
+
+    // the server processed the inputs up to this one (sequence numbers wrap)
+    for ( i = 0; i < ctx.pending_count; i++ ) {
+        if ( (uint8_t)(sequence - ctx.pending[i].sequence) >= 128 ) {
+            break;
+        }
+    }
+    ctx.pending_count -= i;
+    memmove(&ctx.pending[0], &ctx.pending[i], ctx.pending_count * sizeof(struct _predict_input));
+
+    if ( row == PREDICT_NOT_ON_MAP || row >= MAP_ROWS_COUNT || column >= MAP_COLUMNS_COUNT ) {
+        ctx.server_row = -1;
+        ctx.pending_count = 0;
+        return;
+    }
+
+    ctx.server_row = row;
+    ctx.server_column = column;
+}
+
+//--------------------------------------------------------------------
+void predict_draw(void)
+{
+    int row, column;
+
+    // roll back to the server location if a move was wrongly predicted
+    _predict_location(&row, &column);
+    if ( row != ctx.shown_row || column != ctx.shown_column ) {
+        if ( ctx.shown_row >= 0 ) {
+            _predict_restore_cell(ctx.shown_row, ctx.shown_column);
+        }
+        ctx.shown_row = row;
+        ctx.shown_column = column;
+        ctx.redraw = 1;
+    }
+
+    if ( ! ctx.redraw || ctx.shown_row < 0 ) {
+        return;
+    }
+    ctx.redraw = 0;
+
+    ui_tile(PREDICT_TILE_CURRENT_PLAYER, PREDICT_SCREEN_X(column), PREDICT_SCREEN_Y(row));
+    if ( ctx.shield ) {
+        ui_tile(PREDICT_TILE_SHIELD, PREDICT_SCREEN_X(column), PREDICT_SCREEN_Y(row));
+    }
+}
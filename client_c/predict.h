@@ -0,0 +1,15 @@
+#include <stdint.h>
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+/** location acknowledged when the player is not on the map (dead, or the round is not started) **/
+#define PREDICT_NOT_ON_MAP  0xFF
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+uint8_t predict_input(uint8_t input);
+int predict_tile(int tid, int row, int column);
+void predict_acknowledge(uint8_t sequence, uint8_t row, uint8_t column);
+void predict_draw(void);
@@ -0,0 +1,207 @@
+//--------------------------------------------------------------------
+// INCLUDES
+//--------------------------------------------------------------------
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_image.h>
+
+//--------------------------------------------------------------------
+// DEFINES
+//--------------------------------------------------------------------
+#define ATLAS_MAX_TILES     256
+
+/** tiles are packed in rows of this width, unless a tile is wider **/
+#define ATLAS_ROW_WIDTH     256
+
+/** uncompressed true color image, 8 alpha bits, rows stored from the top **/
+#define TGA_TYPE_TRUE_COLOR 2
+#define TGA_DESCRIPTOR      0x28
+
+//--------------------------------------------------------------------
+// PRIVATE DEFINITIONS
+//--------------------------------------------------------------------
+struct _atlas_tile {
+    int tid;
+    SDL_Surface * surface;
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+//--------------------------------------------------------------------
+// PRIVATE API
+//--------------------------------------------------------------------
+/** read one pixel whatever the image format **/
+Uint32 _get_pixel(SDL_Surface * surface, int x, int y)
+{
+    int bpp = surface->format->BytesPerPixel;
+    uint8_t * p = (uint8_t *)surface->pixels + y * surface->pitch + x * bpp;
+
+    switch (bpp) {
+        case 1:
+            return *p;
+        case 2:
+            return *(uint16_t *)p;
+        case 3:
+            if ( SDL_BYTEORDER == SDL_BIG_ENDIAN ) {
+                return p[0] << 16 | p[1] << 8 | p[2];
+            }
+            return p[0] | p[1] << 8 | p[2] << 16;
+        default:
+            return *(uint32_t *)p;
+    }
+}
+
+//--------------------------------------------------------------------
+/** copy a tile in the atlas pixels, stored as BGRA **/
+void _copy_tile(struct _atlas_tile * tile, uint8_t * pixels, int atlas_width)
+{
+    int x, y;
+    uint8_t * dst;
+
+    SDL_LockSurface(tile->surface);
+    for ( y = 0; y < tile->h; y++ ) {
+        dst = pixels + ((tile->y + y) * atlas_width + tile->x) * 4;
+        for ( x = 0; x < tile->w; x++ ) {
+            SDL_GetRGBA(_get_pixel(tile->surface, x, y), tile->surface->format,
+                        &dst[2], &dst[1], &dst[0], &dst[3]);
+            dst += 4;
+        }
+    }
+    SDL_UnlockSurface(tile->surface);
+}
+
+//--------------------------------------------------------------------
+int _write_tga(const char * path, uint8_t * pixels, int width, int height)
+{
+    FILE * file;
+    uint8_t header[18];
+
+    memset(header, 0, sizeof(header));
+    header[2] = TGA_TYPE_TRUE_COLOR;
+    header[12] = width & 0xFF;
+    header[13] = width >> 8;
+    header[14] = height & 0xFF;
+    header[15] = height >> 8;
+    header[16] = 32;
+    header[17] = TGA_DESCRIPTOR;
+
+    file = fopen(path, "wb");
+    if ( ! file ) {
+        perror(path);
+        return -1;
+    }
+
+    if ( fwrite(header, sizeof(header), 1, file) != 1 ||
+         fwrite(pixels, width * height * 4, 1, file) != 1 ) {
+        perror(path);
+        fclose(file);
+        return -1;
+    }
+
+    return fclose(file);
+}
+
+//--------------------------------------------------------------------
+int _write_index(const char * path, struct _atlas_tile * tiles, int count)
+{
+    FILE * file;
+    int i;
+
+    file = fopen(path, "w");
+    if ( ! file ) {
+        perror(path);
+        return -1;
+    }
+
+    // one line per tile : id x y width height
+    for ( i = 0; i < count; i++ ) {
+        fprintf(file, "%d %d %d %d %d\n", tiles[i].tid, tiles[i].x, tiles[i].y, tiles[i].w, tiles[i].h);
+    }
+
+    return fclose(file);
+}
+
+//--------------------------------------------------------------------
+// PUBLIC API
+//--------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    struct _atlas_tile tiles[ATLAS_MAX_TILES];
+    int i, count, x, y, row_height, width, height, rc;
+    uint8_t * pixels;
+
+    if ( argc < 4 || argc - 3 > ATLAS_MAX_TILES ) {
+        fprintf(stderr, "usage : %s atlas.tga atlas.idx tile.png...\n", argv[0]);
+        exit(1);
+    }
+
+    // the tile id is the file name, as 0x3.png
+    count = argc - 3;
+    width = ATLAS_ROW_WIDTH;
+    for ( i = 0; i < count; i++ ) {
+        tiles[i].tid = strtol(basename(argv[i + 3]), NULL, 0);
+        if ( tiles[i].tid < 0 || tiles[i].tid >= ATLAS_MAX_TILES ) {
+            fprintf(stderr, "invalid tile id %s\n", argv[i + 3]);
+            exit(1);
+        }
+
+        tiles[i].surface = IMG_Load(argv[i + 3]);
+        if ( ! tiles[i].surface ) {
+            fprintf(stderr, "cannot load tile %s: %s\n", argv[i + 3], IMG_GetError());
+            exit(1);
+        }
+
+        tiles[i].w = tiles[i].surface->w;
+        tiles[i].h = tiles[i].surface->h;
+        if ( tiles[i].w > width ) {
+            width = tiles[i].w;
+        }
+    }
+
+    // place the tiles from left to right, a new row starts below the highest tile
+    x = 0;
+    y = 0;
+    row_height = 0;
+    for ( i = 0; i < count; i++ ) {
+        if ( x + tiles[i].w > width ) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+        tiles[i].x = x;
+        tiles[i].y = y;
+        x += tiles[i].w;
+        if ( tiles[i].h > row_height ) {
+            row_height = tiles[i].h;
+        }
+    }
+    height = y + row_height;
+
+    pixels = calloc(width * height, 4);
+    if ( ! pixels ) {
+        fprintf(stderr, "OOM condition\n");
+        exit(1);
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        _copy_tile(&tiles[i], pixels, width);
+        SDL_FreeSurface(tiles[i].surface);
+        tiles[i].surface = NULL;
+    }
+
+    rc = _write_tga(argv[1], pixels, width, height);
+    free(pixels);
+    if ( rc || _write_index(argv[2], tiles, count) ) {
+        exit(1);
+    }
+
+    printf("%d tiles packed in %dx%d\n", count, width, height);
+    return 0;
+}
@@ -3,27 +3,57 @@
 //--------------------------------------------------------------------
 #include <stdlib.h>
 #include <stdio.h>
-#include <dirent.h>
 
 #include "ui.h"
 
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 #include <SDL/SDL_ttf.h>
+#include <SDL/SDL_syswm.h>
 
 //--------------------------------------------------------------------
 // DEFINES
 //--------------------------------------------------------------------
 #define DISPLAY_MAX_TILES   256
 
+/** every tile packed in one image by tile_atlas, see Makefile **/
+#define DISPLAY_TILE_ATLAS  "ressources/tiles.tga"
+#define DISPLAY_TILE_INDEX  "ressources/tiles.idx"
+#define DISPLAY_BACKGROUND  "ressources/0xFF.png"
+#define DISPLAY_WIDTH       689
+#define DISPLAY_HEIGHT      650
+
+/** regions updated in a frame before they are merged in one rectangle **/
+#define DISPLAY_MAX_DIRTY_RECTS 64
+
+/** rendered messages kept, the server repeats a few ones **/
+#define DISPLAY_TEXT_CACHE_SIZE 16
+#define DISPLAY_TEXT_MAX_LENGTH 256
+
+/** minimum time between two presents, the display refresh period (60 Hz) **/
+#define DISPLAY_FRAME_PERIOD_MS 16
+
 //--------------------------------------------------------------------
 // PRIVATE DEFINITIONS
 //--------------------------------------------------------------------
+struct _ui_text_entry {
+    char          text[DISPLAY_TEXT_MAX_LENGTH];
+    SDL_Surface * surface;      // NULL if the entry is free
+    Uint32        last_used;
+};
+
 struct _ui_context {
     SDL_Surface * screen;
-    SDL_Surface * tiles[DISPLAY_MAX_TILES];
+    SDL_Surface * tile_atlas;
+    SDL_Rect      tiles[DISPLAY_MAX_TILES];     // tile location in the atlas, empty if unknown
+    SDL_Surface * background;
     TTF_Font    * text_font;
-    SDL_Surface * text_surface;
+    SDL_Surface * text_surface;     // text shown, owned by text_cache
+    struct _ui_text_entry text_cache[DISPLAY_TEXT_CACHE_SIZE];
+    Uint32        text_clock;
+    SDL_Rect      dirty_rects[DISPLAY_MAX_DIRTY_RECTS];
+    int           dirty_count;
+    Uint32        last_present;
 };
 
 //--------------------------------------------------------------------
@@ -34,51 +64,157 @@ static struct _ui_context * ctx = NULL;
 //--------------------------------------------------------------------
 // PRIVATE API
 //--------------------------------------------------------------------
-int _load_tiles(const char * path)
+/** remember a region drawn since the last present **/
+void _add_dirty_rect(const SDL_Rect * rect)
 {
-    DIR * dir;
-    char absolute_path[256];
-    struct dirent * file;
+    int i, x1, y1, x2, y2;
+
+    // nothing visible was drawn (clipped blit)
+    if ( ! rect->w || ! rect->h ) {
+        return;
+    }
+
+    if ( ctx->dirty_count < DISPLAY_MAX_DIRTY_RECTS ) {
+        ctx->dirty_rects[ctx->dirty_count++] = *rect;
+        return;
+    }
+
+    // too many regions (round start) : update their bounding box at once
+    x1 = rect->x;
+    y1 = rect->y;
+    x2 = rect->x + rect->w;
+    y2 = rect->y + rect->h;
+    for ( i = 0; i < ctx->dirty_count; i++ ) {
+        if ( ctx->dirty_rects[i].x < x1 ) x1 = ctx->dirty_rects[i].x;
+        if ( ctx->dirty_rects[i].y < y1 ) y1 = ctx->dirty_rects[i].y;
+        if ( ctx->dirty_rects[i].x + ctx->dirty_rects[i].w > x2 ) x2 = ctx->dirty_rects[i].x + ctx->dirty_rects[i].w;
+        if ( ctx->dirty_rects[i].y + ctx->dirty_rects[i].h > y2 ) y2 = ctx->dirty_rects[i].y + ctx->dirty_rects[i].h;
+    }
+    ctx->dirty_rects[0].x = x1;
+    ctx->dirty_rects[0].y = y1;
+    ctx->dirty_rects[0].w = x2 - x1;
+    ctx->dirty_rects[0].h = y2 - y1;
+    ctx->dirty_count = 1;
+}
+
+//--------------------------------------------------------------------
+/** load an image converted to the screen format, so it is blitted without conversion **/
+SDL_Surface * _load_image(const char * path, int alpha)
+{
+    SDL_Surface * image, * converted;
+
+    image = IMG_Load(path);
+    if ( ! image ) {
+        fprintf(stderr, "cannot load %s: %s\n", path, IMG_GetError());
+        return NULL;
+    }
+
+    // the tiles keep their transparency
+    if ( alpha ) {
+        converted = SDL_DisplayFormatAlpha(image);
+    } else {
+        converted = SDL_DisplayFormat(image);
+    }
+    SDL_FreeSurface(image);
+
+    if ( ! converted ) {
+        fprintf(stderr, "cannot convert %s: %s\n", path, SDL_GetError());
+    }
+
+    return converted;
+}
+
+//--------------------------------------------------------------------
+int _load_tiles(const char * atlas, const char * index)
+{
+    FILE * file;
+    int tid, x, y, w, h;
 
     // sanity check
-    if ( ! path || ! ctx ) {
+    if ( ! atlas || ! index || ! ctx ) {
         return -1;
     }
 
-    dir = opendir(path);
-    if ( ! dir ) {
+    ctx->tile_atlas = _load_image(atlas, 1);
+    if ( ! ctx->tile_atlas ) {
         return -1;
     }
 
-    while( file = readdir(dir) )
-    {
-        if (!strcmp (file->d_name, "."))
-            continue;
-        if (!strcmp (file->d_name, ".."))    
-            continue;
-        if ( ! strstr(file->d_name, "png") ) {
-            continue;
-        }
+    file = fopen(index, "r");
+    if ( ! file ) {
+        perror(index);
+        return -1;
+    }
 
-        int tid = strtol(file->d_name, NULL, 0);
-        if ( tid >= DISPLAY_MAX_TILES ) {
-            fprintf(stderr, "load tiles: invalide ID\n");
-            closedir(dir);
+    // one line per tile : id x y width height
+    while ( fscanf(file, "%d %d %d %d %d", &tid, &x, &y, &w, &h) == 5 ) {
+        if ( tid < 0 || tid >= DISPLAY_MAX_TILES ||
+             x < 0 || y < 0 || x + w > ctx->tile_atlas->w || y + h > ctx->tile_atlas->h ) {
+            fprintf(stderr, "load tiles: invalide tile %d\n", tid);
+            fclose(file);
             return -1;
         }
 
-        strncpy(absolute_path, path, 256);
-        strncat(absolute_path, file->d_name, 256);
-        printf("ADD %s to %d\n", absolute_path, tid);
-        ctx->tiles[tid] = IMG_Load(absolute_path);
-        if ( ! ctx->tiles[tid] ) {
-            fprintf(stderr, "cannot load tile %s\n", absolute_path);
+        ctx->tiles[tid].x = x;
+        ctx->tiles[tid].y = y;
+        ctx->tiles[tid].w = w;
+        ctx->tiles[tid].h = h;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+//--------------------------------------------------------------------
+/** rendered text, from the cache or rasterized once and replacing the least recently used one **/
+SDL_Surface * _render_text(const char * str)
+{
+    SDL_Color text_foreground = { 255, 255, 255, 0 };
+    SDL_Color text_background = { 0, 0, 0, 0 };
+    struct _ui_text_entry * entry = NULL;
+    SDL_Surface * rendered;
+    int i;
+
+    ctx->text_clock++;
+    for ( i = 0; i < DISPLAY_TEXT_CACHE_SIZE; i++ ) {
+        if ( ctx->text_cache[i].surface && ! strcmp(ctx->text_cache[i].text, str) ) {
+            ctx->text_cache[i].last_used = ctx->text_clock;
+            return ctx->text_cache[i].surface;
+        }
+
+        // the text shown is never replaced, it is still cleared by the next one
+        if ( ctx->text_cache[i].surface && ctx->text_cache[i].surface == ctx->text_surface ) {
             continue;
         }
+
+        if ( ! entry || ! ctx->text_cache[i].surface ||
+             ( entry->surface && ctx->text_cache[i].last_used < entry->last_used ) ) {
+            entry = &ctx->text_cache[i];
+        }
     }
 
-    closedir(dir);
-    return 0;
+    rendered = TTF_RenderText_Shaded(ctx->text_font, str, text_foreground, text_background);
+    if ( ! rendered ) {
+        fprintf(stderr, "cannot render text: %s\n", TTF_GetError());
+        return NULL;
+    }
+
+    if ( entry->surface ) {
+        SDL_FreeSurface(entry->surface);
+    }
+
+    // blitted without conversion next times
+    entry->surface = SDL_DisplayFormat(rendered);
+    if ( entry->surface ) {
+        SDL_FreeSurface(rendered);
+    } else {
+        entry->surface = rendered;
+    }
+    strncpy(entry->text, str, DISPLAY_TEXT_MAX_LENGTH - 1);
+    entry->text[DISPLAY_TEXT_MAX_LENGTH - 1] = '\0';
+    entry->last_used = ctx->text_clock;
+
+    return entry->surface;
 }
 
 //--------------------------------------------------------------------
@@ -108,7 +244,13 @@ int ui_init(void)
         return -1;
     }
     ctx->text_surface = NULL;
-    memset(&ctx->tiles[0], 0, DISPLAY_MAX_TILES * sizeof(SDL_Surface*));
+    ctx->text_clock = 0;
+    memset(&ctx->text_cache[0], 0, DISPLAY_TEXT_CACHE_SIZE * sizeof(struct _ui_text_entry));
+    ctx->dirty_count = 0;
+    ctx->last_present = 0;
+    ctx->tile_atlas = NULL;
+    ctx->background = NULL;
+    memset(&ctx->tiles[0], 0, DISPLAY_MAX_TILES * sizeof(SDL_Rect));
 
     rc = SDL_Init(SDL_INIT_VIDEO);
     if ( rc < 0 ) {
@@ -117,22 +259,29 @@ int ui_init(void)
         return -1;
     }
 
-    ctx->screen = SDL_SetVideoMode(689, 650, 32, SDL_HWSURFACE);
+    ctx->screen = SDL_SetVideoMode(DISPLAY_WIDTH, DISPLAY_HEIGHT, 32, SDL_HWSURFACE);
     if ( ! ctx->screen ) {
         fprintf(stderr, "Failed to load video mode: %s\n", SDL_GetError());
         free(ctx);
         return -1;
     }
 
-    rc = _load_tiles("ressources/");
+    rc = _load_tiles(DISPLAY_TILE_ATLAS, DISPLAY_TILE_INDEX);
     if ( rc ) {
         fprintf(stderr, "cannot load tiles\n");
         free(ctx);
+        return -1;
+    }
+
+    ctx->background = _load_image(DISPLAY_BACKGROUND, 0);
+    if ( ! ctx->background ) {
+        free(ctx);
+        return -1;
     }
 
     pos.x=0;
     pos.y=0;
-    SDL_BlitSurface(ctx->tiles[255], NULL, ctx->screen, &pos);
+    SDL_BlitSurface(ctx->background, NULL, ctx->screen, &pos);
     SDL_Flip(ctx->screen);
     
     return rc;
@@ -141,10 +290,8 @@ int ui_init(void)
 //--------------------------------------------------------------------
 int ui_text(char * str)
 {
-    SDL_Surface * back;
     SDL_Rect text_location;
-    SDL_Color text_foreground = { 255, 255, 255 };
-    SDL_Color text_background = { 0, 0, 0 };
+    SDL_Surface * text_surface;
 
     // sanity check
     if ( ! str ) {
@@ -152,23 +299,32 @@ int ui_text(char * str)
         return -1;
     }
 
-    text_location.x = 10;
-    text_location.y = 600;
-
-    if ( ctx->text_surface ) {
-        back = SDL_CreateRGBSurface(0, 600, 30, 32, 0, 0, 0, 0);
-        SDL_FillRect(back, NULL, SDL_MapRGB(back->format, 0, 0, 0));
-        SDL_BlitSurface(back, NULL, ctx->screen, &text_location);
+    text_surface = _render_text(str);
+    if ( ! text_surface ) {
+        return -1;
+    }
 
-        SDL_FreeSurface(back);
-        SDL_FreeSurface(ctx->text_surface);
+    // already shown
+    if ( text_surface == ctx->text_surface ) {
+        return 0;
     }
 
-    ctx->text_surface = TTF_RenderText_Shaded(ctx->text_font, str,
-                            text_foreground, text_background);
+    // clear the previous text
+    if ( ctx->text_surface ) {
+        text_location.x = 10;
+        text_location.y = 600;
+        text_location.w = 600;
+        text_location.h = 30;
+        SDL_FillRect(ctx->screen, &text_location, SDL_MapRGB(ctx->screen->format, 0, 0, 0));
+        _add_dirty_rect(&text_location);
+    }
+    ctx->text_surface = text_surface;
 
+    // the blit sets the location size to the drawn region
+    text_location.x = 10;
+    text_location.y = 600;
     SDL_BlitSurface(ctx->text_surface, NULL, ctx->screen, &text_location);
-    SDL_Flip(ctx->screen);
+    _add_dirty_rect(&text_location);
 
     return 0;
 }
@@ -182,7 +338,7 @@ int ui_tile(int tid, int x, int y)
         return -1;
     }
 
-    if ( ! ctx->tiles[tid] ) {
+    if ( tid < 0 || tid >= DISPLAY_MAX_TILES || ! ctx->tiles[tid].w ) {
         fprintf(stderr, "tile not found %d\n", tid);
         return -1;
     }
@@ -190,14 +346,79 @@ int ui_tile(int tid, int x, int y)
     pos.x = x;
     pos.y = y;
 
-    SDL_BlitSurface(ctx->tiles[tid], NULL, ctx->screen, &pos);
-    SDL_Flip(ctx->screen);
+    // shown by the next ui_present()
+    SDL_BlitSurface(ctx->tile_atlas, &ctx->tiles[tid], ctx->screen, &pos);
+    _add_dirty_rect(&pos);
+
+    return 0;
+}
+
+//--------------------------------------------------------------------
+int ui_present(void)
+{
+    Uint32 now;
+
+    if ( ! ctx || ! ctx->screen ) {
+        return -1;
+    }
+
+    if ( ! ctx->dirty_count ) {
+        return 0;
+    }
+
+    // at most one present per display refresh, the regions drawn meanwhile are kept
+    now = SDL_GetTicks();
+    if ( now - ctx->last_present < DISPLAY_FRAME_PERIOD_MS ) {
+        return 0;
+    }
+
+    SDL_UpdateRects(ctx->screen, ctx->dirty_count, ctx->dirty_rects);
+    ctx->dirty_count = 0;
+    ctx->last_present = now;
+
+    return 1;
+}
+
+//--------------------------------------------------------------------
+int ui_frame_delay(void)
+{
+    Uint32 elapsed;
+
+    if ( ! ctx || ! ctx->dirty_count ) {
+        return -1;
+    }
+
+    elapsed = SDL_GetTicks() - ctx->last_present;
+    if ( elapsed >= DISPLAY_FRAME_PERIOD_MS ) {
+        return 0;
+    }
+
+    return DISPLAY_FRAME_PERIOD_MS - elapsed;
+}
+
+//--------------------------------------------------------------------
+int ui_get_fd(void)
+{
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+    if ( SDL_GetWMInfo(&info) <= 0 ) {
+        return -1;
+    }
+
+#if defined(SDL_VIDEO_DRIVER_X11)
+    // the window events are read from the X server connection
+    if ( info.subsystem == SDL_SYSWM_X11 ) {
+        return ConnectionNumber(info.info.x11.display);
+    }
+#endif
+
+    return -1;
 }
 
 //--------------------------------------------------------------------
 int ui_event(ui_event_t * event)
 {
-    int rc;
     SDL_Event sdl_event;
 
     // sanity check
@@ -205,40 +426,41 @@ int ui_event(ui_event_t * event)
         return -1;
     }
 
-    rc = SDL_PollEvent(&sdl_event);
-    if ( ! rc ) {
-        return 0;
-    }
-
-    if ( sdl_event.type == SDL_KEYDOWN ) {
-        SDLKey keyPressed = sdl_event.key.keysym.sym;
-        event->type = UI_EVENT_KEYBOARD;
-
-        switch (keyPressed) {
-            case SDLK_UP:
-                event->value = UI_KEYBOARD_UP;
-                break;
-            case SDLK_DOWN:
-                event->value = UI_KEYBOARD_DOWN;
-                break;
-            case SDLK_LEFT:
-                event->value = UI_KEYBOARD_LEFT;
-                break;
-            case SDLK_RIGHT:
-                event->value = UI_KEYBOARD_RIGHT;
-                break;
-            case SDLK_SPACE:
-                event->value = UI_KEYBOARD_SPACE;
-                break;
-            case SDLK_ESCAPE:
-                event->value = UI_KEYBOARD_ESCAPE;
-                break;
+    // skip the events not handled, 0 is returned only when the queue is empty
+    while ( SDL_PollEvent(&sdl_event) ) {
+        if ( sdl_event.type == SDL_KEYDOWN ) {
+            SDLKey keyPressed = sdl_event.key.keysym.sym;
+            event->type = UI_EVENT_KEYBOARD;
+
+            switch (keyPressed) {
+                case SDLK_UP:
+                    event->value = UI_KEYBOARD_UP;
+                    break;
+                case SDLK_DOWN:
+                    event->value = UI_KEYBOARD_DOWN;
+                    break;
+                case SDLK_LEFT:
+                    event->value = UI_KEYBOARD_LEFT;
+                    break;
+                case SDLK_RIGHT:
+                    event->value = UI_KEYBOARD_RIGHT;
+                    break;
+                case SDLK_SPACE:
+                    event->value = UI_KEYBOARD_SPACE;
+                    break;
+                case SDLK_ESCAPE:
+                    event->value = UI_KEYBOARD_ESCAPE;
+                    break;
+                default:
+                    continue;
+            }
+
+            return 1;
+        } else if (sdl_event.type == SDL_QUIT ) {
+            event->type = UI_EVENT_WINDOW;
+            event->value = UI_WINDOW_ESCAPE;
+            return 1;
         }
-        
-        return 1;
-    } else if (sdl_event.type == SDL_QUIT ) {
-        event->type = UI_EVENT_WINDOW;
-        event->value = UI_WINDOW_ESCAPE;
     }
 
     return 0;
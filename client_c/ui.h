@@ -43,4 +43,7 @@ typedef struct _ui_event ui_event_t;
 int ui_init(void);
 int ui_text(char * str);
 int ui_tile(int tid, int x, int y);
+int ui_present(void);
+int ui_frame_delay(void);
+int ui_get_fd(void);
 int ui_event(ui_event_t * event);